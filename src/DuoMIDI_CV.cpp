@@ -38,7 +38,7 @@ struct DuoMIDI_CV : Module {
 		NUM_LIGHTS
 	};
 
-	midi::InputQueue midiInput;
+	MidiPortIn midiInput;
 
 	int channels1, channels2;
 	enum PolyMode {
@@ -75,6 +75,11 @@ struct DuoMIDI_CV : Module {
 	uint8_t aftertouches[32];
 	int assignedChannels[32];
 	std::vector<uint8_t> heldNotes;
+	VoiceStats voiceStats;
+	dsp::ClockDivider statsDivider;
+	EngineStats engineStats;
+	MidiCapture capture;
+	SmfPlayer player;
 
 	int rotateIndex;
 
@@ -98,6 +103,8 @@ struct DuoMIDI_CV : Module {
 	DuoMIDI_CV() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		heldNotes.reserve(128);
+		statsDivider.setDivision(64);
+		voiceStats.tickTime = 64.f * APP->engine->getSampleTime();
 		for (int c = 0; c < 32; c++) {
 			pitchFilters[c].setTau(1 / 30.f);
 			modFilters[c].setTau(1 / 30.f);
@@ -119,6 +126,7 @@ struct DuoMIDI_CV : Module {
 
 	/** Resets performance state */
 	void panic() {
+		TRACE_SCOPE("panic");
 		pedal = false;
 		for (int c = 0; c < 32; c++) {
 			notes[c] = 60;
@@ -144,11 +152,25 @@ struct DuoMIDI_CV : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		EngineStats::Scope statsScope(engineStats, args.sampleRate);
+		TRACE_SCOPE("DuoMIDI_CV process");
+		capture.step();
 		midi::Message msg;
-		while (midiInput.shift(&msg)) {
-			processMessage(msg);
+		if (!midiInput.empty()) {
+			TRACE_SCOPE("drain");
+			while (midiInput.shift(&msg)) {
+				engineStats.countMessage(msg);
+				capture.capture(msg);
+				if (msg.bytes[0] >= 0xf8)
+					player.onRealtime(msg.bytes[0]);
+				processMessage(msg);
+			}
 		}
+		player.process(args.sampleRate, [this](const midi::Message& m) {
+			processMessage(m);
+		});
 
+		TRACE_BEGIN(outputsTrace);
 		inputs[NOTESTOP1_INPUT].setChannels(channels1);
 		inputs[NOTESTOP2_INPUT].setChannels(channels2);
 		outputs[PITCH1_OUTPUT].setChannels(channels1);
@@ -164,56 +186,23 @@ struct DuoMIDI_CV : Module {
 		outputs[BENT_PITCH1_OUTPUT].setChannels(channels1);
 		outputs[BENT_PITCH2_OUTPUT].setChannels(channels2);
 
-		for (int c = 0; c < channels1; c++) {
-			if (inputs[NOTESTOP1_INPUT].getVoltage(c) >= 1.f) {
-				velocities[c] = 0;
-				aftertouches[c] = 0;
-				bends[c] = 8192;
-				mods[c] = 0;
-				pitchFilters[c].reset();
-				modFilters[c].reset();
-			}
-			outputs[PITCH1_OUTPUT].setVoltage((notes[c] - 60.f) / 12.f, c);
-			outputs[GATE1_OUTPUT].setVoltage(gates[c] ? 10.f : 0.f, c);
-			outputs[VELOCITY1_OUTPUT].setVoltage(rescale(velocities[c], 0, 127, 0.f, 10.f), c);
-			outputs[AFTERTOUCH1_OUTPUT].setVoltage(rescale(aftertouches[c], 0, 127, 0.f, 10.f), c);
-			outputs[RETRIGGER1_OUTPUT].setVoltage(retriggerPulses[c].process(args.sampleTime) ? 10.f : 0.f, c);
-		}
-		for (int c = 0; c < channels2; c++) {
-			if (inputs[NOTESTOP2_INPUT].getVoltage(c) >= 1.f) {
-				velocities[16 + c] = 0;
-				aftertouches[16 + c] = 0;
-				bends[16 + c] = 8192;
-				mods[16 + c] = 0;
-				pitchFilters[16 + c].reset();
-				modFilters[16 + c].reset();
-			}
-			outputs[PITCH2_OUTPUT].setVoltage((notes[16 + c] - 60.f) / 12.f, c);
-			outputs[GATE2_OUTPUT].setVoltage(gates[16 + c] ? 10.f : 0.f, c);
-			outputs[VELOCITY2_OUTPUT].setVoltage(rescale(velocities[16 + c], 0, 127, 0.f, 10.f), c);
-			outputs[AFTERTOUCH2_OUTPUT].setVoltage(rescale(aftertouches[16 + c], 0, 127, 0.f, 10.f), c);
-			outputs[RETRIGGER2_OUTPUT].setVoltage(retriggerPulses[16 + c].process(args.sampleTime) ? 10.f : 0.f, c);
-		}
+		noteStop(0, channels1);
+		noteStop(1, channels2);
 
+		float bendVoltages[32] = {};// per voice, what BENT PITCH adds
 		if (polyMode == MPE_MODE) {
 			outputs[PITCH_BEND1_OUTPUT].setChannels(channels1);
 			outputs[PITCH_BEND2_OUTPUT].setChannels(channels2);
 			outputs[MOD1_OUTPUT].setChannels(channels1);
 			outputs[MOD2_OUTPUT].setChannels(channels2);
 			for (int c = 0; c < channels1; c++) {
-				if (bends[c] > 8192)
-					outputs[PITCH_BEND1_OUTPUT].setVoltage(pitchFilters[c].process(args.sampleTime, rescale(bends[c], 0, 1 << 14, -5.f, 5.f)*(bendRangeUp/60.f)), c);
-				else
-					outputs[PITCH_BEND1_OUTPUT].setVoltage(pitchFilters[c].process(args.sampleTime, rescale(bends[c], 0, 1 << 14, -5.f, 5.f)*(bendRangeDown/60.f)), c);
-				outputs[BENT_PITCH1_OUTPUT].setVoltage((outputs[PITCH1_OUTPUT].getVoltage(c) + outputs[PITCH_BEND1_OUTPUT].getVoltage(c)), c);
+				bendVoltages[c] = bendVoltage(c, args.sampleTime);
+				outputs[PITCH_BEND1_OUTPUT].setVoltage(bendVoltages[c], c);
 				outputs[MOD1_OUTPUT].setVoltage(modFilters[c].process(args.sampleTime, rescale(mods[c], 0, 127, 0.f, 10.f)), c);
 			}
 			for (int c = 0; c < channels2; c++) {
-				if (bends[16 + c] > 8192)
-					outputs[PITCH_BEND2_OUTPUT].setVoltage(pitchFilters[16 + c].process(args.sampleTime, rescale(bends[16 + c], 0, 1 << 14, -5.f, 5.f)*(bendRangeUp/60.f)), c);
-				else
-					outputs[PITCH_BEND2_OUTPUT].setVoltage(pitchFilters[16 + c].process(args.sampleTime, rescale(bends[16 + c], 0, 1 << 14, -5.f, 5.f)*(bendRangeDown/60.f)), c);
-				outputs[BENT_PITCH2_OUTPUT].setVoltage((outputs[PITCH2_OUTPUT].getVoltage(c) + outputs[PITCH_BEND2_OUTPUT].getVoltage(c)), c);
+				bendVoltages[16 + c] = bendVoltage(16 + c, args.sampleTime);
+				outputs[PITCH_BEND2_OUTPUT].setVoltage(bendVoltages[16 + c], c);
 				outputs[MOD2_OUTPUT].setVoltage(modFilters[16 + c].process(args.sampleTime, rescale(mods[16 + c], 0, 127, 0.f, 10.f)), c);
 			}
 		}
@@ -222,28 +211,100 @@ struct DuoMIDI_CV : Module {
 			outputs[PITCH_BEND2_OUTPUT].setChannels(1);
 			outputs[MOD1_OUTPUT].setChannels(1);
 			outputs[MOD2_OUTPUT].setChannels(1);
-			if (bends[0] > 8192)
-				outputs[PITCH_BEND1_OUTPUT].setVoltage(pitchFilters[0].process(args.sampleTime, rescale(bends[0], 0, 1 << 14, -5.f, 5.f)*(bendRangeUp/60.f)));
-			else
-				outputs[PITCH_BEND1_OUTPUT].setVoltage(pitchFilters[0].process(args.sampleTime, rescale(bends[0], 0, 1 << 14, -5.f, 5.f)*(bendRangeDown/60.f)));
-			outputs[PITCH_BEND2_OUTPUT].setVoltage(outputs[PITCH_BEND1_OUTPUT].getVoltage());
-			outputs[MOD1_OUTPUT].setVoltage(modFilters[0].process(args.sampleTime, rescale(mods[0], 0, 127, 0.f, 10.f)));
-			outputs[MOD2_OUTPUT].setVoltage(outputs[MOD1_OUTPUT].getVoltage());
-			for (int c = 0; c < channels1; c++)
-				outputs[BENT_PITCH1_OUTPUT].setVoltage((outputs[PITCH1_OUTPUT].getVoltage(c) + outputs[PITCH_BEND1_OUTPUT].getVoltage()), c);
-			for (int c = 0; c < channels2; c++)
-				outputs[BENT_PITCH2_OUTPUT].setVoltage((outputs[PITCH2_OUTPUT].getVoltage(c) + outputs[PITCH_BEND2_OUTPUT].getVoltage()), c);
+			float bend = bendVoltage(0, args.sampleTime);
+			float mod = modFilters[0].process(args.sampleTime, rescale(mods[0], 0, 127, 0.f, 10.f));
+			outputs[PITCH_BEND1_OUTPUT].setVoltage(bend);
+			outputs[PITCH_BEND2_OUTPUT].setVoltage(bend);
+			outputs[MOD1_OUTPUT].setVoltage(mod);
+			outputs[MOD2_OUTPUT].setVoltage(mod);
+			std::fill(bendVoltages, bendVoltages + 32, bend);
 		}
 
+		voiceOutputs(0, channels1, bendVoltages);
+		voiceOutputs(1, channels2, bendVoltages + 16);
+		for (int c = 0; c < channels1; c++)
+			outputs[RETRIGGER1_OUTPUT].setVoltage(retriggerPulses[c].process(args.sampleTime) ? 10.f : 0.f, c);
+		for (int c = 0; c < channels2; c++)
+			outputs[RETRIGGER2_OUTPUT].setVoltage(retriggerPulses[16 + c].process(args.sampleTime) ? 10.f : 0.f, c);
+
 		outputs[CLOCK_OUTPUT].setVoltage(clockPulse.process(args.sampleTime) ? 10.f : 0.f);
 		outputs[CLOCK_DIV_OUTPUT].setVoltage(clockDividerPulse.process(args.sampleTime) ? 10.f : 0.f);
 		outputs[START_OUTPUT].setVoltage(startPulse.process(args.sampleTime) ? 10.f : 0.f);
 		outputs[STOP_OUTPUT].setVoltage(stopPulse.process(args.sampleTime) ? 10.f : 0.f);
 		outputs[CONTINUE_OUTPUT].setVoltage(continuePulse.process(args.sampleTime) ? 10.f : 0.f);
+		TRACE_END(outputsTrace, "outputs");
+
+		if (statsDivider.process())
+			tickVoiceStats();
+	}
+
+	/** NOTE STOP gates of a bank (0 : voices 1 ~ 16, 1 : voices 17 ~ 32) reset their voices */
+	void noteStop(int bank, int channels) {
+		engine::Input& input = inputs[NOTESTOP1_INPUT + bank];
+		if (!input.isConnected()) return;
+		for (int c = 0; c < channels; c++) {
+			if (input.getVoltage(c) < 1.f)
+				continue;
+			int v = 16 * bank + c;
+			velocities[v] = 0;
+			aftertouches[v] = 0;
+			bends[v] = 8192;
+			mods[v] = 0;
+			pitchFilters[v].reset();
+			modFilters[v].reset();
+		}
+	}
+
+	/** Smoothed pitch bend of voice v in volts, scaled by the range of its direction */
+	float bendVoltage(int v, float sampleTime) {
+		float range = (bends[v] > 8192) ? bendRangeUp : bendRangeDown;
+		return pitchFilters[v].process(sampleTime, rescale(bends[v], 0, 1 << 14, -5.f, 5.f)*(range/60.f));
+	}
+
+	/** PITCH, BENT PITCH, GATE, VELOCITY and AFTERTOUCH of a bank, 4 channels at a time,
+	straight from the voice state : outputs are only written. Lanes past channels get 0,
+	as Rack keeps unused channels */
+	void voiceOutputs(int bank, int channels, const float* bendVoltages) {
+		using simd::float_4;
+		const uint8_t* n = notes + 16 * bank;
+		const bool* g = gates + 16 * bank;
+		const uint8_t* vel = velocities + 16 * bank;
+		const uint8_t* at = aftertouches + 16 * bank;
+		for (int c = 0; c < channels; c += 4) {
+			float_4 active = float_4(0.f, 1.f, 2.f, 3.f) < float_4(channels - c);
+			float_4 pitch = (float_4(n[c], n[c + 1], n[c + 2], n[c + 3]) - 60.f) / 12.f;
+			float_4 gate = float_4(g[c], g[c + 1], g[c + 2], g[c + 3]) * 10.f;
+			float_4 velocity = float_4(vel[c], vel[c + 1], vel[c + 2], vel[c + 3]) / 127.f * 10.f;
+			float_4 aftertouch = float_4(at[c], at[c + 1], at[c + 2], at[c + 3]) / 127.f * 10.f;
+			outputs[PITCH1_OUTPUT + bank].setVoltageSimd(simd::ifelse(active, pitch, 0.f), c);
+			outputs[BENT_PITCH1_OUTPUT + bank].setVoltageSimd(simd::ifelse(active, pitch + float_4::load(bendVoltages + c), 0.f), c);
+			outputs[GATE1_OUTPUT + bank].setVoltageSimd(simd::ifelse(active, gate, 0.f), c);
+			outputs[VELOCITY1_OUTPUT + bank].setVoltageSimd(simd::ifelse(active, velocity, 0.f), c);
+			outputs[AFTERTOUCH1_OUTPUT + bank].setVoltageSimd(simd::ifelse(active, aftertouch, 0.f), c);
+		}
+	}
+
+	/** Sounding voices, held notes and voices kept on only by the pedal, for the usage histogram */
+	void tickVoiceStats() {
+		int voices = 0;
+		int pedalHeld = 0;
+		for (int c = 0; c < 32; c++) {
+			if (!gates[c])
+				continue;
+			voices++;
+			if (pedal && std::find(heldNotes.begin(), heldNotes.end(), notes[c]) == heldNotes.end())
+				pedalHeld++;
+		}
+		voiceStats.tick(voices, (int) heldNotes.size(), pedalHeld);
+	}
+
+	void onSampleRateChange() override {
+		voiceStats.tickTime = 64.f * APP->engine->getSampleTime();
 	}
 
 	void processMessage(midi::Message msg) {
 		// DEBUG("MIDI: %01x %01x %02x %02x", msg.getStatus(), msg.getChannel(), msg.getNote(), msg.getValue());
+		TRACE_SCOPE("processMessage");
 
 		switch (msg.getStatus()) {
 			// note off
@@ -362,6 +423,16 @@ struct DuoMIDI_CV : Module {
 		}
 	}
 
+	/** Voice after rotateIndex in bank 1 (0 ~ channels1 - 1) then bank 2 (16 ~ 16 + channels2 - 1),
+	back to firstIx after the last one */
+	int nextRotateIndex(int firstIx) {
+		int ix = rotateIndex + 1;
+		if ((ix >= channels1) && (ix < 16))
+			ix = channels2 ? 16 : firstIx;
+		else if (ix >= 16 + channels2)
+			ix = firstIx;
+		return ix;
+	}
 	int assignChannel(uint8_t note, int* channel) {
 		if (channels1 == 1 && channels2 == 0)
 			return 0;
@@ -384,24 +455,12 @@ struct DuoMIDI_CV : Module {
 			case ROTATE_MODE: {
 				// Find next available channel
 				for (int i = 0; i < (channels1 + channels2); i++) {
-					rotateIndex++;
-					if (rotateIndex >= channels1) {
-						if (channels2) {
-							if (rotateIndex < 16)
-								rotateIndex = 16;
-							else if (rotateIndex >= 16 + channels2)
-								rotateIndex = 0;
-						}
-						else
-							rotateIndex = 0;
-					}
+					rotateIndex = nextRotateIndex(0);
 					if (!gates[rotateIndex])
 						return rotateIndex;
 				}
 				// No notes are available. Advance rotateIndex once more.
-				rotateIndex++;
-				if (rotateIndex >= (16 + channels2))
-					rotateIndex = 0;
+				rotateIndex = nextRotateIndex(0);
 				return rotateIndex;
 			} break;
 
@@ -445,25 +504,17 @@ struct DuoMIDI_CV : Module {
 					} // fallthrough
 
 					case ROTATE_MPE: {
+						// voice 0 is the master channel, bank 1 has no other voice with a single channel
+						int firstIx = (channels1 > 1) ? 1 : 16;
 						for (int i = 1; i < (channels1 + channels2); i++) {
-							rotateIndex++;
-							if (rotateIndex >= channels1) {
-								if (channels2) {
-									if (rotateIndex < 16)
-										rotateIndex = 16;
-								}
-								else
-									rotateIndex = 1;
-							}
+							rotateIndex = nextRotateIndex(firstIx);
 							if (!gates[rotateIndex]) {
 								assignedChannels[*channel] = rotateIndex;
 								return rotateIndex;
 							}
 						}
 						// No notes are available. Advance rotateIndex once more.
-						rotateIndex++;
-						if (rotateIndex >= (16 + channels2))
-							rotateIndex = 1;
+						rotateIndex = nextRotateIndex(firstIx);
 						assignedChannels[*channel] = rotateIndex;
 						return rotateIndex;
 					} break;
@@ -496,6 +547,7 @@ struct DuoMIDI_CV : Module {
 	}
 
 	void pressNote(uint8_t note, int* channel) {
+		TRACE_SCOPE("allocate");
 		// Remove existing similar note
 		auto it = std::find(heldNotes.begin(), heldNotes.end(), note);
 		if (it != heldNotes.end())
@@ -514,6 +566,8 @@ struct DuoMIDI_CV : Module {
 			bends[*channel] = lastBend;
 			mods[*channel] = lastMod;
 		}
+		if (gates[*channel] && (notes[*channel] != note))
+			voiceStats.steal();
 		// Set note
 		notes[*channel] = note;
 		gates[*channel] = true;
@@ -630,6 +684,7 @@ struct DuoMIDI_CV : Module {
 			json_object_set_new(rootJ, "lastMod", json_integer(mods[0]));
 		}
 		json_object_set_new(rootJ, "midi", midiInput.toJson());
+		json_object_set_new(rootJ, "player", player.toJson());
 		return rootJ;
 	}
 
@@ -665,6 +720,10 @@ struct DuoMIDI_CV : Module {
 		json_t* midiJ = json_object_get(rootJ, "midi");
 		if (midiJ)
 			midiInput.fromJson(midiJ);
+
+		json_t* playerJ = json_object_get(rootJ, "player");
+		if (playerJ)
+			player.fromJson(playerJ);
 	}
 };
 
@@ -937,7 +996,7 @@ struct DuoMIDI_CVPanicItem : MenuItem {
 struct DuoMIDI_CVWidget : ModuleWidget {
 	DuoMIDI_CVWidget(DuoMIDI_CV* module) {
 		setModule(module);
-		setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DuoMIDI-CV.svg")));
+		setPanel(pluginSvg("res/DuoMIDI-CV.svg"));
 
 		addChild(createWidget<ScrewBlack>(Vec(RACK_GRID_WIDTH, 0)));
 		addChild(createWidget<ScrewBlack>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, 0)));
@@ -969,10 +1028,16 @@ struct DuoMIDI_CVWidget : ModuleWidget {
 		addOutput(createOutput<DLXPortPoly>(Vec(155.572, 307.833), module, DuoMIDI_CV::CLOCK_DIV_OUTPUT));
 
 
-		MidiWidget* midiWidget = createWidget<MidiWidget>(Vec(54.892, 43.941));
-		midiWidget->box.size = Vec(100.217, 82.922);
-		midiWidget->setMidiPort(module ? &module->midiInput : NULL);
-		addChild(midiWidget);
+		// MIDI driver / device / channel display, built once the panel is first drawn
+		DeferredWidget* details = createWidget<DeferredWidget>(Vec(0, 0));
+		details->box.size = box.size;
+		details->build = [=](Widget* parent) {
+			MidiWidget* midiWidget = createWidget<MidiWidget>(Vec(54.892, 43.941));
+			midiWidget->box.size = Vec(100.217, 82.922);
+			midiWidget->setMidiPort(module ? &module->midiInput : NULL);
+			parent->addChild(midiWidget);
+		};
+		addChild(details);
 	}
 
 	void appendContextMenu(Menu* menu) override {
@@ -1015,6 +1080,24 @@ struct DuoMIDI_CVWidget : ModuleWidget {
 		panicItem->text = "Panic";
 		panicItem->module = module;
 		menu->addChild(panicItem);
+
+		VoiceStatsItem* statsItem = createMenuItem<VoiceStatsItem>("Voice usage", RIGHT_ARROW);
+		statsItem->stats = &module->voiceStats;
+		menu->addChild(statsItem);
+
+		EngineStatsItem* engineItem = createMenuItem<EngineStatsItem>("Diagnostics", RIGHT_ARROW);
+		engineItem->stats = &module->engineStats;
+		engineItem->ports = &module->midiInput;
+		engineItem->numPorts = 1;
+		menu->addChild(engineItem);
+
+		MidiCaptureItem* captureItem = createMenuItem<MidiCaptureItem>("Record input...");
+		captureItem->capture = &module->capture;
+		menu->addChild(captureItem);
+
+		SmfPlayerItem* playerItem = createMenuItem<SmfPlayerItem>("File playback", RIGHT_ARROW);
+		playerItem->player = &module->player;
+		menu->addChild(playerItem);
 	}
 };
 
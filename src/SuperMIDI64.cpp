@@ -1,5 +1,5 @@
 /*
-Super MIDI 64 : Midi to 4x16ch CV with MPE and regular Polyphonic modes
+Super MIDI 64 : Midi to 4x16ch CV (8x16ch with expander) with MPE and regular Polyphonic modes
 Copyright (C) 2020 Anthony Lexander Matos
 
 Based on MIDIpolyMPE, Copyright (C) 2019 Pablo Delaloza
@@ -50,10 +50,11 @@ struct SuperMIDI64 : Module {
 		NUM_LIGHTS
 	};
 ////MIDI
-	midi::InputQueue midiInput;
+	static const int NUM_PORTS = 4;
+	MidiPortIn midiInput[NUM_PORTS];// [0] on the MIDI LCD, [1] ~ [3] from the context menu, merged by arrival time through the MidiHub
+	MidiBatch midiBatch;
 	int MPEmasterCh = 0;// 0 ~ 15
 	int midiActivity = 0;
-	bool resetMidi = false;
 	int mdriverJx = -1;
 	int mchannelJx = -1;
 	std::string mdeviceJx = "";
@@ -135,26 +136,29 @@ struct SuperMIDI64 : Module {
 	};
 	NoteData noteData[128];
 
+	static const int MAX_VOICES = 128;// 64 on the panel + 64 on the expander
+	static const int MAX_CCS = 40;// 20 on the panel + 20 on the expander
+
 	std::vector<uint8_t> cachedNotes;// Stolen notes (UNISON_MODE and REASSIGN_MODE cache all played)
 	std::vector<uint8_t> cachedMPE[16];// MPE stolen notes
 
-	uint8_t notes[64] = {0};
-	uint8_t vels[64] = {0};
-	uint8_t rvels[64] = {0};
+	uint8_t notes[MAX_VOICES] = {0};
+	uint8_t vels[MAX_VOICES] = {0};
+	uint8_t rvels[MAX_VOICES] = {0};
 	int16_t mpex[16] = {0};
 	uint16_t mpey[16] = {0};
 	uint16_t mpez[16] = {0};
 	uint8_t mpePlusLB[16] = {0};
 	uint8_t chAfTch = 0;
 	int16_t mPBnd = 0;
-	uint8_t midiCCsVal[20] = {0};
+	uint8_t midiCCsVal[MAX_CCS] = {0};
 
 	int midiCCs[20] = {128,1,4,7,10,11,12,13,64,70,71,74,16,17,18,19,80,81,82,83};
-	bool gates[64] = {false};
+	bool gates[MAX_VOICES] = {false};
 
 	float xpitch[16] = {0.f};
-	float drift[64] = {0.f};
-	bool pedalgates[64] = {false}; // gates set to TRUE by pedal if current gate. FALSE by pedal.
+	float drift[MAX_VOICES] = {0.f};
+	bool pedalgates[MAX_VOICES] = {false}; // gates set to TRUE by pedal if current gate. FALSE by pedal.
 	bool pedal = false;
 	int rotateIndex = 0;
 	int stealIndex = 0;
@@ -183,15 +187,67 @@ struct SuperMIDI64 : Module {
 	float dataKnob = 0.f;
 	int frameData = 0;
 	int autoFocusOff = 0;
+	/** Display edit posted from the UI thread, applied by process() before the MIDI drain */
+	struct UiCommand {
+		enum Kind {FOCUS, RESET_MIDI, PORT_CHANNEL, PORT_TRANSPOSE, MPE_MASTER};
+		static const int KEEP = -2;
+		Kind kind;
+		int cursorIx;// KEEP or the new value
+		int learnCC;
+		int learnNote;
+		bool autoFocus;// restart the focus timeout, otherwise cancel it
+		int port;// PORT_ edits : input port and its new remap channel or transpose
+		int value;// also the MPE_MASTER channel
+	};
+	SpscRing<UiCommand, 64> uiCommands;
+	std::vector<UiCommand> uiBacklog;// UI thread only, refused by the full ring, retried by the widget step
+	uint32_t uiPosted = 0;// UI thread only
+	uint32_t uiApplied = 0;// engine thread only, published with the display
+	/** What the LCDs show, published by the engine at UI rate */
+	struct Display {
+		int polyModeIx = ROTATE_MODE;
+		int cursorIx = -1;
+		int learnCC = -1;
+		int learnNote = -1;
+		int numVOout = 1;
+		int numVOper = 16;
+		int pbMPE = 96;
+		int pbMainDwn = -2;
+		int pbMainUp = 2;
+		int driftcents = 10;
+		int trnsps = 0;
+		int noteMin = 0;
+		int noteMax = 127;
+		int velMin = 1;
+		int velMax = 127;
+		int displayYcc = 74;
+		int displayZcc = 128;
+		int midiCCs[20] = {};
+		bool mpePbOut = true;
+		bool MPEmode = false;
+		int MPEmasterCh = 0;
+		int midiActivity = 0;
+		uint32_t uiApplied = 0;
+	};
+	SnapshotBuffer<Display> display;
+	dsp::ClockDivider displayDivider;
+	VoiceStats voiceStats;
+	dsp::ClockDivider statsDivider;
+	EngineStats engineStats;
+	MidiCapture capture;
+	SmfPlayer player;
+	bool showDiagnostics = false;// engine counters on the MIDI LCD channel line
 	//uint8_t MPEchMap[16];
 	//std::vector<uint8_t> dynMPEch;
+	bool expanderOn = false;
+	SuperMIDI64XConfig xConfig[2];// expander CC numbers (rightExpander producer/consumer)
 
 	dsp::ExponentialFilter MPExFilter[16];
 	dsp::ExponentialFilter MPEyFilter[16];
 	dsp::ExponentialFilter MPEzFilter[16];
-	dsp::ExponentialFilter MCCsFilter[20];
+	dsp::ExponentialFilter MCCsFilter[MAX_CCS];
 	dsp::ExponentialFilter mPBndFilter;
-	dsp::PulseGenerator reTrigger[64];	// retrigger for stolen notes
+	dsp::PulseGenerator reTrigger[MAX_VOICES];	// retrigger for stolen notes
 	dsp::SchmittTrigger PlusOneTrigger;
 	dsp::SchmittTrigger MinusOneTrigger;
 
@@ -203,6 +259,11 @@ struct SuperMIDI64 : Module {
 		configParam(RETRIG_PARAM, 0.f, 1.f, 1.f);
 		configParam(DATAKNOB_PARAM, -1.f, 1.f, 0.f);
 		configParam(BENDPITCH_PARAM, 0.f, 1.f, 1.f);
+		rightExpander.producerMessage = &xConfig[0];
+		rightExpander.consumerMessage = &xConfig[1];
+		displayDivider.setDivision(static_cast<uint32_t>(APP->engine->getSampleRate() / 60.f));// ~60 display snapshots per second
+		statsDivider.setDivision(64);
+		voiceStats.tickTime = 64.f * APP->engine->getSampleTime();
 		//onReset();
 	}
 ///////////////////////////////////////////////////////////////////////////////////////
@@ -254,10 +315,25 @@ struct SuperMIDI64 : Module {
 		json_object_set_new(rootJ, "noteMax", json_integer(noteMax));
 		json_object_set_new(rootJ, "velMin", json_integer(velMin));
 		json_object_set_new(rootJ, "velMax", json_integer(velMax));
+		for (int p = 1; p < NUM_PORTS; p++)
+			json_object_set_new(rootJ, string::f("midi%d", p + 1).c_str(), midiInput[p].toJson());
+		json_t *portChannelJ = json_array();
+		json_t *portTrnspJ = json_array();
+		for (int p = 0; p < NUM_PORTS; p++) {
+			json_array_append_new(portChannelJ, json_integer(midiInput[p].remapChannel));
+			json_array_append_new(portTrnspJ, json_integer(midiInput[p].transpose));
+		}
+		json_object_set_new(rootJ, "portChannel", portChannelJ);
+		json_object_set_new(rootJ, "portTrnsp", portTrnspJ);
+		json_object_set_new(rootJ, "hubCapacity", json_integer(MidiHub::get()->getCapacity()));
+		json_object_set_new(rootJ, "showDiagnostics", json_boolean(showDiagnostics));
+		json_object_set_new(rootJ, "player", player.toJson());
 		return rootJ;
 	}
 ///////////////////////////////////////////////////////////////////////////////////////
 	void dataFromJson(json_t *rootJ) override {
+		json_t *hubCapacityJ = json_object_get(rootJ, "hubCapacity");// plugin-wide, before any port opens a device
+		if (hubCapacityJ) MidiHub::get()->setCapacity(json_integer_value(hubCapacityJ));
 		json_t *midiJ = json_object_get(rootJ, "midi");
 		if (midiJ)	{
 			json_t* driverJ = json_object_get(midiJ, "driver");
@@ -266,7 +342,7 @@ struct SuperMIDI64 : Module {
 			if (deviceNameJ) mdeviceJx = json_string_value(deviceNameJ);
 			json_t* channelJ = json_object_get(midiJ, "channel");
 			if (channelJ) mchannelJx = json_integer_value(channelJ);
-			midiInput.fromJson(midiJ);
+			midiInput[0].fromJson(midiJ);
 		}
 		json_t *polyModeIxJ = json_object_get(rootJ, "polyModeIx");
 		if (polyModeIxJ) polyModeIx = json_integer_value(polyModeIxJ);
@@ -279,12 +355,11 @@ struct SuperMIDI64 : Module {
 		if (pbMPEJ) pbMPE = json_integer_value(pbMPEJ);
 		json_t *mpePbOutJ = json_object_get(rootJ, "mpePbOut");
 		if (mpePbOutJ) mpePbOut = static_cast<bool>(json_integer_value(mpePbOutJ));
-		json_t *numVoJ = json_object_get(rootJ, "numVo");
-		if (numVoJ) numVo = json_integer_value(numVoJ);
 		json_t *numVOperJ = json_object_get(rootJ, "numVOper");
 		if (numVOperJ) numVOper = json_integer_value(numVOperJ);
 		json_t *numVOoutJ = json_object_get(rootJ, "numVOout");
-		if (numVOoutJ) numVOout = json_integer_value(numVOoutJ);
+		if (numVOoutJ) numVOout = clamp(static_cast<int>(json_integer_value(numVOoutJ)), 1, 8);// 5 ~ 8 are on the expander bus
+		updateNumVo();// "numVo" is saved for older versions, it follows the outputs
 		json_t *MPEmasterChJ = json_object_get(rootJ, "MPEmasterCh");
 		if (MPEmasterChJ) MPEmasterCh = json_integer_value(MPEmasterChJ);
 		json_t *midiAccJ = json_object_get(rootJ, "midiAcc");
@@ -343,24 +418,43 @@ struct SuperMIDI64 : Module {
 		if (velMinJ) velMin = json_integer_value(velMinJ);
 		json_t *velMaxJ = json_object_get(rootJ, "velMax");
 		if (velMaxJ) velMax = json_integer_value(velMaxJ);
+		for (int p = 1; p < NUM_PORTS; p++) {
+			json_t *portJ = json_object_get(rootJ, string::f("midi%d", p + 1).c_str());
+			if (portJ) midiInput[p].fromJson(portJ);
+		}
+		json_t *portChannelJ = json_object_get(rootJ, "portChannel");
+		json_t *portTrnspJ = json_object_get(rootJ, "portTrnsp");
+		for (int p = 0; p < NUM_PORTS; p++) {
+			json_t *chJ = portChannelJ ? json_array_get(portChannelJ, p) : NULL;
+			if (chJ) midiInput[p].remapChannel = static_cast<int>(json_integer_value(chJ));
+			json_t *trJ = portTrnspJ ? json_array_get(portTrnspJ, p) : NULL;
+			if (trJ) midiInput[p].transpose = static_cast<int>(json_integer_value(trJ));
+		}
+		json_t *showDiagnosticsJ = json_object_get(rootJ, "showDiagnostics");
+		if (showDiagnosticsJ) showDiagnostics = json_boolean_value(showDiagnosticsJ);
+		json_t *playerJ = json_object_get(rootJ, "player");
+		if (playerJ) player.fromJson(playerJ);
 	}
 ///////////////////////////////////////////////////////////////////////////////////////
 	void resetVoices(){
+		TRACE_SCOPE("resetVoices");
 		float lambdaf = 100.f * APP->engine->getSampleTime();
 		pedal = false;
 		lights[SUSTHOLD_LIGHT].value = 0.f;
 		int OUTcount = 0, VOcount = 0; //Iterating across 4 outputs using single 64-index array
-		for (int i = 0; i < 64; i++) { //64 for non-MPE
+		for (int i = 0; i < MAX_VOICES; i++) { //64 for non-MPE, 128 with expander
 			notes[i] = 60;
 			gates[i] = false;
 			pedalgates[i] = false;
 			vels[i] = 0;
 			rvels[i] = 0;
-			lights[CH_LIGHT+ i].value = 0.f;
-			outputs[GATE_OUTPUT+ OUTcount].setVoltage(0.f, i - OUTcount*16);
-			if (++ VOcount == 16) { //Increment VOcount. If incrementation corresponds to next output, adjust to match
-				OUTcount ++;
-				VOcount = 0;
+			if (i < 64) {//expander gates are cleared with the bus
+				lights[CH_LIGHT+ i].value = 0.f;
+				outputs[GATE_OUTPUT+ OUTcount].setVoltage(0.f, i - OUTcount*16);
+				if (++ VOcount == 16) { //Increment VOcount. If incrementation corresponds to next output, adjust to match
+					OUTcount ++;
+					VOcount = 0;
+				}
 			}
 		}
 		for (int i = 0; i < 16; i++) { //16 for MPE-only
@@ -393,13 +487,143 @@ struct SuperMIDI64 : Module {
 		}
 		learnCC = -1;
 		learnNote = -1;
-		for (int i=0; i < 20; i++){
+		for (int i=0; i < MAX_CCS; i++){
 			MCCsFilter[i].lambda = lambdaf;
 			midiCCsVal[i] = 0;
 		}
 		mPBndFilter.lambda = lambdaf;
 		midiActivity = 96;
-		resetMidi = false;
+	}
+	///////////////////////////////////////////////////////////////////////////////////////
+	/** UI thread : queue a cursor / learn change for the engine */
+	void postFocus(int cursor, int lrnCC, int lrnNote, bool autoFocus){
+		UiCommand cmd;
+		cmd.kind = UiCommand::FOCUS;
+		cmd.cursorIx = cursor;
+		cmd.learnCC = lrnCC;
+		cmd.learnNote = lrnNote;
+		cmd.autoFocus = autoFocus;
+		postUiCommand(cmd);
+	}
+	/** UI thread : queue a voice reset (click on the MIDI LCD) */
+	void postResetMidi(){
+		UiCommand cmd;
+		cmd.kind = UiCommand::RESET_MIDI;
+		postUiCommand(cmd);
+	}
+	/** UI thread : queue a channel remap (PORT_CHANNEL) or transpose (PORT_TRANSPOSE) for an input port */
+	void postPortEdit(UiCommand::Kind kind, int port, int value){
+		UiCommand cmd;
+		cmd.kind = kind;
+		cmd.port = port;
+		cmd.value = value;
+		postUiCommand(cmd);
+	}
+	/** UI thread : queue a new MPE master channel, 0 ~ 15 */
+	void postMpeMaster(int channel){
+		UiCommand cmd;
+		cmd.kind = UiCommand::MPE_MASTER;
+		cmd.value = channel;
+		postUiCommand(cmd);
+	}
+	/** UI thread : hand a command to the engine. Returns false if the ring is full,
+	the command then waits in uiBacklog, in order, until flushUiCommands() gets it through
+	*/
+	bool postUiCommand(const UiCommand &cmd){
+		if (!uiBacklog.empty() || !uiCommands.push(cmd)) {
+			uiBacklog.push_back(cmd);
+			return false;
+		}
+		uiPosted ++;
+		return true;
+	}
+	/** UI thread : retry the commands the full ring refused, once per widget step */
+	void flushUiCommands(){
+		size_t sent = 0;
+		while ((sent < uiBacklog.size()) && uiCommands.push(uiBacklog[sent])) {
+			sent ++;
+			uiPosted ++;
+		}
+		uiBacklog.erase(uiBacklog.begin(), uiBacklog.begin() + sent);
+	}
+	/** Engine thread : decay the activity meter and publish what the LCDs show */
+	void publishDisplay(){
+		if (midiActivity > 3) midiActivity -= 4;
+		else midiActivity = 0;
+		Display &d = display.writeBuffer();
+		d.polyModeIx = polyModeIx;
+		d.cursorIx = cursorIx;
+		d.learnCC = learnCC;
+		d.learnNote = learnNote;
+		d.numVOout = numVOout;
+		d.numVOper = numVOper;
+		d.pbMPE = pbMPE;
+		d.pbMainDwn = pbMainDwn;
+		d.pbMainUp = pbMainUp;
+		d.driftcents = driftcents;
+		d.trnsps = trnsps;
+		d.noteMin = noteMin;
+		d.noteMax = noteMax;
+		d.velMin = velMin;
+		d.velMax = velMax;
+		d.displayYcc = displayYcc;
+		d.displayZcc = displayZcc;
+		std::copy(midiCCs, midiCCs + 20, d.midiCCs);
+		d.mpePbOut = mpePbOut;
+		d.MPEmode = MPEmode;
+		d.MPEmasterCh = MPEmasterCh;
+		d.midiActivity = midiActivity;
+		d.uiApplied = uiApplied;
+		display.publish();
+	}
+	/** Engine thread : sounding, cached and pedal-held voices for the usage histogram */
+	void tickVoiceStats(){
+		bool sustainHold = (params[SUSTHOLD_PARAM].getValue() > 0.5f);
+		int voices = 0, pedalHeld = 0;
+		for (int i = 0; i < MAX_VOICES; i++) {
+			if (gates[i]) voices ++;
+			else if (sustainHold && pedalgates[i]) {
+				voices ++;
+				pedalHeld ++;
+			}
+		}
+		int cached = static_cast<int>(cachedNotes.size());
+		for (int i = 0; i < 16; i++)
+			cached += static_cast<int>(cachedMPE[i].size());// MPE steals stack per channel
+		voiceStats.tick(voices, cached, pedalHeld);
+	}
+	/** UI thread : edits posted but not in this snapshot yet, it still shows the old state */
+	bool uiPending(const Display *d) const {
+		return (uiPosted != d->uiApplied) || !uiBacklog.empty();
+	}
+	/** Engine thread : apply the queued display edits. Returns true if any was applied */
+	bool applyUiCommands(){
+		if (uiCommands.empty()) return false;
+		while (const UiCommand *cmd = uiCommands.front()) {
+			switch (cmd->kind) {
+				case UiCommand::FOCUS: {
+					if (cmd->cursorIx != UiCommand::KEEP) cursorIx = cmd->cursorIx;
+					if (cmd->learnCC != UiCommand::KEEP) learnCC = cmd->learnCC;
+					if (cmd->learnNote != UiCommand::KEEP) learnNote = cmd->learnNote;
+					autoFocusOff = cmd->autoFocus ? static_cast<int>(10 * APP->engine->getSampleRate()) : 0;
+				}break;
+				case UiCommand::RESET_MIDI: {
+					resetVoices();
+				}break;
+				case UiCommand::PORT_CHANNEL: {
+					midiInput[cmd->port].remapChannel.store(cmd->value, std::memory_order_relaxed);
+				}break;
+				case UiCommand::PORT_TRANSPOSE: {
+					midiInput[cmd->port].transpose.store(cmd->value, std::memory_order_relaxed);
+				}break;
+				case UiCommand::MPE_MASTER: {
+					MPEmasterCh = cmd->value;
+				}break;
+			}
+			uiCommands.pop();
+			uiApplied ++;
+		}
+		return true;
 	}
 	///////////////////////////////////////////////////////////////////////////////////////
 	void onAdd() override{
@@ -431,7 +655,7 @@ struct SuperMIDI64 : Module {
 		midiCCs[19] = 83;
 		numVOper = 16;
 		if (numVOout != 1) {  //When resetting from a state with more than 1 active output, reset the channels of the extra outputs then output count to 1
-				for (int i = numVOout; i > 1; i--) {
+				for (int i = std::min(numVOout, 4); i > 1; i--) {//expander outputs follow the bus
 					outputs[X_OUTPUT+ i- 1].setChannels(0);
 					outputs[Y_OUTPUT+ i- 1].setChannels(0);
 					outputs[Z_OUTPUT+ i- 1].setChannels(0);
@@ -441,7 +665,7 @@ struct SuperMIDI64 : Module {
 				}
 				numVOout = 1;
 		}
-		numVo = numVOout * numVOper;  //The number of voices = the number of active outputs multiplied by the number of voices per output
+		updateNumVo();  //The number of voices = the number of active outputs multiplied by the number of voices per output
 		trnsps = 0;
 		pbMainDwn = -12;
 		pbMainUp = 12;
@@ -465,8 +689,26 @@ struct SuperMIDI64 : Module {
 	 	rotateIndex = 0;
 	 	stealIndex = 0;
 	}
+///////////////////////////////////////////////////////////////////////////////////////
+	/** Outputs that can sound, 5 ~ 8 are on the expander bus */
+	int linkedOuts() const {
+		return std::min(numVOout, expanderOn ? 8 : 4);
+	}
+	/** Voices the allocator spreads notes over. numVOout stays as set while the expander is unlinked */
+	void updateNumVo() {
+		numVo = linkedOuts() * numVOper;
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	/** Pushes a note on a note cache. A note already there moves to the back, so a key
+	struck again before its note-off is cached once and its note-off clears it */
+	void cacheNote(std::vector<uint8_t> &cache, uint8_t note) {
+		std::vector<uint8_t>::iterator it = std::find(cache.begin(), cache.end(), note);
+		if (it != cache.end()) cache.erase(it);
+		cache.push_back(note);
+	}
 ///////////////////////////////////////////////////////////////////////////////////////
 	int getPolyIndex(int nowIndex) {
+		TRACE_SCOPE("allocate");
 		for (int i = 0; i < numVo; i++) {
 			nowIndex++;
 			if (nowIndex > (numVo - 1))
@@ -477,15 +719,17 @@ struct SuperMIDI64 : Module {
 			}
 		}
 		// All taken = steal (rotates)
+		voiceStats.steal();
 		stealIndex++;
 		if (stealIndex > (numVo - 1))
 			stealIndex = 0;
 		if ((polyModeIx < REASSIGN_MODE) && (gates[stealIndex]))//&&(polyMode > MPE_MODE).cannot reach here if MPE mode true
-			cachedNotes.push_back(notes[stealIndex]);
+			cacheNote(cachedNotes, notes[stealIndex]);
 		return stealIndex;
 	}
 ///////////////////////////////////////////////////////////////////////////////////////
 	int getAltPolyIndex(int nowIndex) {  //This alternate function rotates the index across all active outputs, e.g. A[1] -> B[1] -> C[1] -> D[1] -> A[2]...
+		TRACE_SCOPE("allocate");
 		for (int i = 0; i < numVo; i++) {
 			nowIndex += numVOper;
 			if (nowIndex >= numVo)
@@ -496,11 +740,12 @@ struct SuperMIDI64 : Module {
 			}
 		}
 		// All taken = steal (rotates)
+		voiceStats.steal();
 		stealIndex += numVOper;
 		if (stealIndex > (numVo - 1))
 			stealIndex = (((stealIndex - numVo + 1) == numVOper)? 0 : stealIndex - numVo + 1);
 		if ((polyModeIx < REASSIGN_MODE) && (gates[stealIndex]))//&&(polyMode > MPE_MODE).cannot reach here if MPE mode true
-			cachedNotes.push_back(notes[stealIndex]);
+			cacheNote(cachedNotes, notes[stealIndex]);
 		return stealIndex;
 	}
 ///////////////////////////////////////////////////////////////////////////////////////
@@ -550,7 +795,10 @@ struct SuperMIDI64 : Module {
 				//uint8_t ixch;
 				if (channel + 1 > numVOch) numVOch = channel + 1;
 				rotateIndex = channel; // ASSIGN VOICE Index
-				if (gates[channel]) cachedMPE[channel].push_back(notes[channel]);///if gate push note to mpe_buffer
+				if (gates[channel]) {///if gate push note to mpe_buffer
+					cacheNote(cachedMPE[channel], notes[channel]);
+					voiceStats.steal();
+				}
 //				std::vector<uint8_t>::iterator it = std::find(dynMPEch.begin(), dynMPEch.end(), channel);
 //				if (it != dynMPEch.end()) {//found = get the index of the channel
 //					 ixch = std::distance(dynMPEch.begin(), it);
@@ -585,11 +833,11 @@ struct SuperMIDI64 : Module {
 				rotateIndex = getPolyIndex(-1);
 			} break;
 			case REASSIGN_MODE: {
-				cachedNotes.push_back(note);
+				cacheNote(cachedNotes, note);
 				rotateIndex = getPolyIndex(-1);
 			} break;
 			case UNISON_MODE: {
-				cachedNotes.push_back(note);
+				cacheNote(cachedNotes, note);
 				bool retrignow = static_cast<bool>(params[RETRIG_PARAM].getValue());
 				for (int i = 0; i < numVo; i++) {
 					notes[i] = note;
@@ -602,7 +850,7 @@ struct SuperMIDI64 : Module {
 				return;/////  R E T U R N !!!!!!!
 			} break;
 			case UNISONLWR_MODE: {
-				cachedNotes.push_back(note);
+				cacheNote(cachedNotes, note);
 				uint8_t lnote = *min_element(cachedNotes.begin(),cachedNotes.end());
 				bool retrignow = static_cast<bool>(params[RETRIG_PARAM].getValue()) && (lnote < notes[0]);
 				for (int i = 0; i < numVo; i++) {
@@ -616,7 +864,7 @@ struct SuperMIDI64 : Module {
 				return;/////  R E T U R N !!!!!!!
 			} break;
 			case UNISONUPR_MODE:{
-				cachedNotes.push_back(note);
+				cacheNote(cachedNotes, note);
 				uint8_t unote = *max_element(cachedNotes.begin(),cachedNotes.end());
 				bool retrignow = static_cast<bool>(params[RETRIG_PARAM].getValue()) && (unote > notes[0]);
 				for (int i = 0; i < numVo; i++) {
@@ -814,6 +1062,7 @@ struct SuperMIDI64 : Module {
 	}
 ///////////////////////////////////////////////////////////////////////////////////////
 	void processMessage(midi::Message msg) {
+		TRACE_SCOPE("processMessage");
 		switch (msg.getStatus()) {
 				// note off
 			case 0x8: {
@@ -927,6 +1176,15 @@ struct SuperMIDI64 : Module {
 				return;
 			}
 		}
+		if (expanderOn) {
+			SuperMIDI64XConfig *xcfg = static_cast<SuperMIDI64XConfig*>(rightExpander.consumerMessage);
+			for (int i = 0; i < 20; i++){
+				if (xcfg->midiCCs[i] == msg.getNote()){
+					midiCCsVal[20 + i] = msg.getValue();
+					return;
+				}
+			}
+		}
 	}
 ///////////////////////////////////////////////////////////////////////////////////////
 	void dataPlus(){
@@ -959,15 +1217,15 @@ struct SuperMIDI64 : Module {
 				} else {
 					if (numVOper < 16) {  //In non-MPE modes, dataPlus here increments the number of voices-per-output rather than the total number of voices
 						numVOper ++;
-						numVo = numVOout * numVOper;  //Update total number of voices to match
+						updateNumVo();  //Update total number of voices to match
 					}
 					resetVoices();
 				}
 			}break;
 			case OUTS_SELECTOR: {  //Added incrementable setting for number of active outputs
-				if (numVOout < 4) {
+				if (numVOout < (expanderOn ? 8 : 4)) {
 					numVOout ++;
-					numVo = numVOout * numVOper;
+					updateNumVo();
 				}
 				resetVoices();
 			}break;
@@ -1046,7 +1304,7 @@ struct SuperMIDI64 : Module {
 				} else {
 					if (numVOper > 1) {  //In non-MPE modes, dataPlus here increments the number of voices-per-output rather than the total number of voices
 						numVOper --;
-						numVo = numVOout * numVOper;  //Update total number of voices to match
+						updateNumVo();  //Update total number of voices to match
 						if (numVo == 1) polyModeIx = UNISON_MODE;
 					}
 					resetVoices();
@@ -1055,14 +1313,16 @@ struct SuperMIDI64 : Module {
 			case OUTS_SELECTOR: {
 				if (numVOout > 1) {  //Added decrementable setting for number of active outputs
 					numVOout --;
-					numVo = numVOper * numVOout;
-					//Reset channels on the now-deactivated output
-					outputs[X_OUTPUT+ numVOout].setChannels(0);
-					outputs[Y_OUTPUT+ numVOout].setChannels(0);
-					outputs[Z_OUTPUT+ numVOout].setChannels(0);
-					outputs[VEL_OUTPUT+ numVOout].setChannels(0);
-					outputs[RVEL_OUTPUT+ numVOout].setChannels(0);
-					outputs[GATE_OUTPUT+ numVOout].setChannels(0);
+					updateNumVo();
+					//Reset channels on the now-deactivated output (expander outputs follow the bus)
+					if (numVOout < 4) {
+						outputs[X_OUTPUT+ numVOout].setChannels(0);
+						outputs[Y_OUTPUT+ numVOout].setChannels(0);
+						outputs[Z_OUTPUT+ numVOout].setChannels(0);
+						outputs[VEL_OUTPUT+ numVOout].setChannels(0);
+						outputs[RVEL_OUTPUT+ numVOout].setChannels(0);
+						outputs[GATE_OUTPUT+ numVOout].setChannels(0);
+					}
           if (numVOout < 2 && polyModeIx == ROTATE_OUT_MODE) polyModeIx = ROTATE_MODE;  //If using ROTATE OUT mode and the number of outputs is reduced to 1, revert to basic ROTATE mode
 				}
 				resetVoices();
@@ -1113,15 +1373,55 @@ struct SuperMIDI64 : Module {
 	}
 ///////////////////////////////////////////////////////////////////////////////////////
 	void onSampleRateChange() override {
+		displayDivider.setDivision(static_cast<uint32_t>(APP->engine->getSampleRate() / 60.f));
+		voiceStats.tickTime = 64.f * APP->engine->getSampleTime();
 		resetVoices();
 	}
+///////////////////////////////////////////////////////////////////////////////////////
+	struct VoiceOuts {
+		float *x, *y, *z, *vel, *rvel, *gate;
+	};
+	VoiceOuts voiceOuts(int outIx, SuperMIDI64XBus *xbus) {// outputs 0 ~ 3 on the panel, 4 ~ 7 on the expander bus
+		VoiceOuts vo;
+		if (outIx < 4) {
+			vo.x = outputs[X_OUTPUT + outIx].voltages;
+			vo.y = outputs[Y_OUTPUT + outIx].voltages;
+			vo.z = outputs[Z_OUTPUT + outIx].voltages;
+			vo.vel = outputs[VEL_OUTPUT + outIx].voltages;
+			vo.rvel = outputs[RVEL_OUTPUT + outIx].voltages;
+			vo.gate = outputs[GATE_OUTPUT + outIx].voltages;
+		}else {
+			vo.x = xbus->x[outIx - 4];
+			vo.y = xbus->y[outIx - 4];
+			vo.z = xbus->z[outIx - 4];
+			vo.vel = xbus->vel[outIx - 4];
+			vo.rvel = xbus->rvel[outIx - 4];
+			vo.gate = xbus->gate[outIx - 4];
+		}
+		return vo;
+	}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////
 //////   STEP START
 ///////////////////////
 	void process(const ProcessArgs &args) override {
-		for (int i = 0; i < numVOout; i++) {  //For each active output, set channels to number of voices-per-output
+		EngineStats::Scope statsScope(engineStats, args.sampleRate);// closes on every return below
+		TRACE_SCOPE("SuperMIDI64 process");
+		capture.step();
+		bool uiEdited = applyUiCommands();
+		SuperMIDI64XBus *xbus = NULL;
+		bool linked = (rightExpander.module && (rightExpander.module->model == modelSuperMIDI64X));
+		if (linked != expanderOn) {// outputs 5 ~ 8 come or go, numVOout stays : Rack links expanders after a patch loads
+			expanderOn = linked;
+			if (linkedOuts() * numVOper != numVo) {// notes on voices without outputs are released
+				updateNumVo();
+				resetVoices();
+			}
+		}
+		if (expanderOn) xbus = static_cast<SuperMIDI64XBus*>(rightExpander.module->leftExpander.producerMessage);
+		int outsOn = linkedOuts();
+		for (int i = 0; i < std::min(numVOout, 4); i++) {  //For each active output, set channels to number of voices-per-output
 			outputs[X_OUTPUT+ i].setChannels(numVOper);
 			outputs[Y_OUTPUT+ i].setChannels(numVOper);
 			outputs[Z_OUTPUT+ i].setChannels(numVOper);
@@ -1131,9 +1431,22 @@ struct SuperMIDI64 : Module {
 		}
 
 		midi::Message msg;
-		while (midiInput.shift(&msg)) {
-			processMessage(msg);
+		bool moreMsgs = !MidiPortIn::allEmpty(midiInput, NUM_PORTS);
+		while (moreMsgs) {// drain the merged ports in batches, dropping superseded bend/CC/aftertouch values
+			TRACE_SCOPE("drain");
+			midiBatch.clear();
+			while (!midiBatch.full() && (moreMsgs = MidiPortIn::shiftOldest(midiInput, NUM_PORTS, &msg))) {
+				engineStats.countMessage(msg);
+				capture.capture(msg);
+				if (msg.bytes[0] >= 0xf8) player.onRealtime(msg.bytes[0]);
+				midiBatch.push(msg);
+			}
+			if (learnCC < 0) engineStats.countCoalesced(midiBatch.coalesce());// learning takes the first message received
+			for (int i = 0; i < midiBatch.size; i++)
+				processMessage(midiBatch.msgs[i]);
 		}
+		player.process(args.sampleRate, [this](const midi::Message &m) {processMessage(m);});// file events due on this sample
+		TRACE_BEGIN(outputsTrace);
 		float pbVo = 0.f, pbVoice = 0.f;
 		if (mPBnd < 0){
 			pbVo = mPBndFilter.process(1.f ,rescale(mPBnd, -8192, 0, -5.f, 0.f));
@@ -1145,20 +1458,20 @@ struct SuperMIDI64 : Module {
 		outputs[PBEND_OUTPUT].setVoltage(pbVo);
 		bool sustainHold = (params[SUSTHOLD_PARAM].getValue() > .5 );
 		if (polyModeIx > MPEPLUS_MODE){
-			int OUTcount = 0, VOcount = 0;  //Iterating across 4 outputs using single 64-index array
-			for (int i = 0; i < numVo; i++) {
-				float lastGate = ((gates[i] || (sustainHold && pedalgates[i])) && (!(reTrigger[i].process(args.sampleTime))))? 10.f : 0.f;
-				float thispitch = ((notes[i] - 60 + trnsps) / 12.f) + (params[BENDPITCH_PARAM].getValue() == 1.f ? pbVoice : 0);
-				outputs[GATE_OUTPUT+ OUTcount].setVoltage(lastGate, i - OUTcount*numVOper);
-				outputs[X_OUTPUT+ OUTcount].setVoltage(thispitch, i - OUTcount*numVOper);
-				outputs[Y_OUTPUT+ OUTcount].setVoltage(thispitch + drift[i] , i - OUTcount*numVOper);	//drifted out
-				outputs[VEL_OUTPUT+ OUTcount].setVoltage(rescale(vels[i], 0, 127, 0.f, 10.f), i - OUTcount*numVOper);
-				outputs[RVEL_OUTPUT+ OUTcount].setVoltage(rescale(rvels[i], 0, 127, 0.f, 10.f), i - OUTcount*numVOper);
-				outputs[Z_OUTPUT+ OUTcount].setVoltage(rescale(noteData[notes[i]].aftertouch, 0, 127, 0.f, 10.f), i - OUTcount*numVOper);
-				lights[CH_LIGHT+ i].value = ((i == rotateIndex)? 0.2f : 0.f) + (lastGate * .08f);
-				if (++ VOcount == numVOper) {  //Increment VOcount. If incrementation corresponds to next output, adjust to match
-					OUTcount ++;
-					VOcount = 0;
+			float bendVoice = (params[BENDPITCH_PARAM].getValue() == 1.f ? pbVoice : 0);
+			int i = 0;  //Iterating across 4 (8 with expander) outputs using single voice-index array
+			for (int OUTcount = 0; OUTcount < outsOn; OUTcount++) {
+				VoiceOuts vo = voiceOuts(OUTcount, xbus);
+				for (int c = 0; c < numVOper; c++, i++) {
+					float lastGate = ((gates[i] || (sustainHold && pedalgates[i])) && (!(reTrigger[i].process(args.sampleTime))))? 10.f : 0.f;
+					float thispitch = ((notes[i] - 60 + trnsps) / 12.f) + bendVoice;
+					vo.gate[c] = lastGate;
+					vo.x[c] = thispitch;
+					vo.y[c] = thispitch + drift[i];	//drifted out
+					vo.vel[c] = rescale(vels[i], 0, 127, 0.f, 10.f);
+					vo.rvel[c] = rescale(rvels[i], 0, 127, 0.f, 10.f);
+					vo.z[c] = rescale(noteData[notes[i]].aftertouch, 0, 127, 0.f, 10.f);
+					if (i < 64) lights[CH_LIGHT+ i].value = ((i == rotateIndex)? 0.2f : 0.f) + (lastGate * .08f);
 				}
 			}
 		} else {/// MPE MODE!!!
@@ -1182,7 +1495,19 @@ struct SuperMIDI64 : Module {
 			else
 				outputs[MM_OUTPUT + i].setVoltage(MCCsFilter[i].process(1.f ,rescale(midiCCsVal[i], 0, 127, 0.f, 10.f)));
 		}
-		if (resetMidi) resetVoices();// resetMidi from MIDI widget;
+		if (expanderOn) {//// EXPANDER BUS (Rack swaps the buffers at the end of the sample)
+			SuperMIDI64XConfig *xcfg = static_cast<SuperMIDI64XConfig*>(rightExpander.consumerMessage);
+			for (int i = 0; i < 20; i++){
+				if (xcfg->midiCCs[i] == 128)
+					xbus->cc[i] = MCCsFilter[20 + i].process(1.f ,rescale(chAfTch, 0, 127, 0.f, 10.f));
+				else
+					xbus->cc[i] = MCCsFilter[20 + i].process(1.f ,rescale(midiCCsVal[20 + i], 0, 127, 0.f, 10.f));
+			}
+			xbus->numVOout = (polyModeIx > MPEPLUS_MODE)? std::max(numVOout - 4, 0) : 0;
+			xbus->numVOper = numVOper;
+			rightExpander.module->leftExpander.messageFlipRequested = true;
+		}
+		TRACE_END(outputsTrace, "outputs");
 		if (autoFocusOff > 0){
 			autoFocusOff --;
 			if (autoFocusOff < 1){
@@ -1192,6 +1517,8 @@ struct SuperMIDI64 : Module {
 				cursorIx = -1;
 			}
 		}
+		if (displayDivider.process() || uiEdited) publishDisplay();// edits show on the next frame
+		if (statsDivider.process()) tickVoiceStats();
 		//// PANEL KNOB AND BUTTONS
 		dataKnob = params[DATAKNOB_PARAM].getValue();
 		if ( dataKnob > 0.07f){
@@ -1227,26 +1554,24 @@ struct SuperMIDI64 : Module {
 // Main Display///////////////////////////////////////////////////////////////////////////////////////
 struct PolyModeDisplayC : TransparentWidget {
 	PolyModeDisplayC(){
-		font = APP->window->loadFont(mFONT_FILE);
+		font = pluginFont();
 	}
 	SuperMIDI64 *module;
+	const SuperMIDI64::Display *disp;// the widget's copy of the engine snapshot
+	FramebufferWidget *fb = NULL;// caches the drawing, redrawn when dirty
 	float mdfontSize = 11.f;
-	std::string sMode = "";
-	std::string sVo = "";
-	std::string sOut = "";  //Added string for number of active outputs
-	std::string sPBM = "";
-	std::string snoteMin = "";
-	std::string snoteMax = "";
-	std::string svelMin = "";
-	std::string svelMax = "";
-	std::string yyDisplay = "";
-	std::string zzDisplay = "";
+	char sVo[24] = "";
+	char sOut[24] = "";  //Added string for number of active outputs
+	char snoteMin[16] = "";
+	char snoteMax[16] = "";
+	char svelMin[8] = "";
+	char svelMax[8] = "";
 	std::shared_ptr<Font> font;
-	std::string polyModeStr[10] = {
+	const char *polyModeStr[10] = {
 		"M. P. E.",
 		"M. P. E. Plus",
 		"R O T A T E",
-    	"R O T A T E Out",
+		"R O T A T E Out",
 		"R E U S E",
 		"R E S E T",
 		"R E A S S I G N",
@@ -1254,8 +1579,9 @@ struct PolyModeDisplayC : TransparentWidget {
 		"U N I S O N Lower",
 		"U N I S O N Upper",
 	};
-	std::string noteName[12] = {"C","C#","D","Eb","E","F","F#","G","Ab","A","Bb","B"};
-	int drawFrame = 0;
+	const char *noteName[12] = {"C","C#","D","Eb","E","F","F#","G","Ab","A","Bb","B"};
+	SuperMIDI64::Display shown;// values the cached drawing was made from
+	bool firstDraw = true;
 	int cursorIxI = 0;
 	int flashFocus = 0;
 	unsigned char lrnflash = 0x55;
@@ -1265,23 +1591,41 @@ struct PolyModeDisplayC : TransparentWidget {
 	unsigned char rgbf2 = 0xdd;
 	unsigned char rgbf3 = 0xdd;
 
-	void draw(const DrawArgs &args) override {
-		if (cursorIxI != module->cursorIx){
-			cursorIxI = module->cursorIx;
-			flashFocus = 64;
-		}
-		sMode = polyModeStr[module->polyModeIx];
-		if (module->polyModeIx < 2){
-			sVo =  "Vo chnl PB: " + std::to_string(module->pbMPE);
-			sOut = "";
-		}else{
-			sVo = "Vo per Out: " + std::to_string(module->numVOper);
-			sOut = "Active Outs: " + std::to_string(module->numVOout);
+	void step() override {
+		bool changed = firstDraw || (shown.polyModeIx != disp->polyModeIx) || (shown.pbMPE != disp->pbMPE) || (shown.numVOper != disp->numVOper)
+			|| (shown.numVOout != disp->numVOout) || (shown.noteMin != disp->noteMin) || (shown.noteMax != disp->noteMax)
+			|| (shown.velMin != disp->velMin) || (shown.velMax != disp->velMax) || (shown.cursorIx != disp->cursorIx) || (shown.learnNote != disp->learnNote);
+		if (changed) {
+			firstDraw = false;
+			shown = *disp;
+			if (shown.polyModeIx < 2){
+				snprintf(sVo, sizeof(sVo), "Vo chnl PB: %d", shown.pbMPE);
+				sOut[0] = 0;
+			}else{
+				snprintf(sVo, sizeof(sVo), "Vo per Out: %d", shown.numVOper);
+				snprintf(sOut, sizeof(sOut), "Active Outs: %d", shown.numVOout);
+			}
+			snprintf(snoteMin, sizeof(snoteMin), "%s%d", noteName[shown.noteMin % 12], (shown.noteMin / 12) - 2);
+			snprintf(snoteMax, sizeof(snoteMax), "%s%d", noteName[shown.noteMax % 12], (shown.noteMax / 12) - 2);
+			snprintf(svelMin, sizeof(svelMin), "%d", shown.velMin);
+			snprintf(svelMax, sizeof(svelMax), "%d", shown.velMax);
+			if (cursorIxI != shown.cursorIx){
+				cursorIxI = shown.cursorIx;
+				flashFocus = 64;
+			}
+		}else if (flashFocus > 0) {// focus flash still fading
+			flashFocus --;
+			changed = true;
 		}
-		snoteMin = noteName[module->noteMin % 12] + std::to_string((module->noteMin / 12) - 2);
-		snoteMax = noteName[module->noteMax % 12] + std::to_string((module->noteMax / 12) - 2);
-		svelMin = std::to_string(module->velMin);
-		svelMax = std::to_string(module->velMax);
+		if (changed && fb) fb->dirty = true;
+		TransparentWidget::step();
+	}
+	void draw(const DrawArgs &args) override {
+		const char *sMode = polyModeStr[shown.polyModeIx];
+		const char *snoteMinD = snoteMin;
+		const char *snoteMaxD = snoteMax;
+		const char *svelMinD = svelMin;
+		const char *svelMaxD = svelMax;
 		gb1 = rgbx;
 		gb2 = rgbx;
 		gb3 = rgbx;
@@ -1306,7 +1650,7 @@ struct PolyModeDisplayC : TransparentWidget {
 			}break;
 			case SuperMIDI64::VOICES_SELECTOR:{ //numVoicesPerOutput/PB MPE
 				nvgBeginPath(args.vg);
-				if (module->polyModeIx < 2) {  //In MPE modes, react as full-width button
+				if (shown.polyModeIx < 2) {  //In MPE modes, react as full-width button
 					nvgRoundedRect(args.vg, 1.f, 14.f, 134.f, 12.f, 3.f);
 				}else{  //In non-MPE modes, react as half-width button on left side
 					nvgRoundedRect(args.vg, 1.f, 14.f, 67.f, 12.f, 3.f);
@@ -1324,9 +1668,8 @@ struct PolyModeDisplayC : TransparentWidget {
 				nvgBeginPath(args.vg);
 				nvgRoundedRect(args.vg, 19.f, 28.f, 29.f, 12.f, 3.f);
 				gb1f = 0;
-				if (module->learnNote == SuperMIDI64::NOTE_RANGE_SELECTOR) {
-					snoteMin = "LRN";
-					//if ((lrnflash += 16) > 255) lrnflash = 0;
+				if (shown.learnNote == SuperMIDI64::NOTE_RANGE_SELECTOR) {
+					snoteMinD = "LRN";
 					gb1 = 0;
 					rgblrn = 0;
 				}else{
@@ -1337,9 +1680,8 @@ struct PolyModeDisplayC : TransparentWidget {
 				nvgBeginPath(args.vg);
 				nvgRoundedRect(args.vg, 48.f, 28.f, 29.f, 12.f, 3.f);
 				gb2f = 0;
-				if (module->learnNote == SuperMIDI64::NOTE_RANGE_SELECTOR + 1) {
-					snoteMax = "LRN";
-					//if ((lrnflash += 16) > 255) lrnflash = 0;
+				if (shown.learnNote == SuperMIDI64::NOTE_RANGE_SELECTOR + 1) {
+					snoteMaxD = "LRN";
 					gb2 = 0;
 					rgblrn = 0;
 				}else{
@@ -1350,9 +1692,8 @@ struct PolyModeDisplayC : TransparentWidget {
 				nvgBeginPath(args.vg);
 				nvgRoundedRect(args.vg, 93.f, 28.f, 20.f, 12.f, 3.f);
 				gb3f = 0;
-				if (module->learnNote == SuperMIDI64::VEL_RANGE_SELECTOR) {
-					svelMin = "LRN";
-					//if ((lrnflash += 16) > 255) lrnflash = 0;
+				if (shown.learnNote == SuperMIDI64::VEL_RANGE_SELECTOR) {
+					svelMinD = "LRN";
 					gb3 = 0;
 					rgblrn = 0;
 				}else{
@@ -1363,9 +1704,8 @@ struct PolyModeDisplayC : TransparentWidget {
 				nvgBeginPath(args.vg);
 				nvgRoundedRect(args.vg, 113.f, 28.f, 20.f, 12.f, 3.f);
 				gb4f = 0;
-				if (module->learnNote == SuperMIDI64::VEL_RANGE_SELECTOR + 1) {
-					svelMax = "LRN";
-					//if ((lrnflash += 16) > 255) lrnflash = 0;
+				if (shown.learnNote == SuperMIDI64::VEL_RANGE_SELECTOR + 1) {
+					svelMaxD = "LRN";
 					gb4 = 0;
 					rgblrn = 0;
 				}else{
@@ -1376,7 +1716,6 @@ struct PolyModeDisplayC : TransparentWidget {
 				goto noFocus;
 			}
 		}
-		if (flashFocus > 0)	flashFocus --;
 		nvgFillColor(args.vg, nvgRGBA(lrnflash, rgblrn, 0, 0xc0 + flashFocus)); //SELECTED
 		nvgFill(args.vg);
 		//nvgGlobalCompositeBlendFunc(args.vg,  NVG_ONE , NVG_ONE);
@@ -1385,28 +1724,28 @@ struct PolyModeDisplayC : TransparentWidget {
 		nvgFontFaceId(args.vg, font->handle);
 		nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
 		nvgFillColor(args.vg, nvgRGB(rgbx, rgbx, rgbf1));
-		nvgTextBox(args.vg, 1.f, 10.5f, 134.f, sMode.c_str(), NULL);
-		if (module->polyModeIx < 2) {  //One button in MPE modes
+		nvgTextBox(args.vg, 1.f, 10.5f, 134.f, sMode, NULL);
+		if (shown.polyModeIx < 2) {  //One button in MPE modes
 			nvgFillColor(args.vg, nvgRGB(rgbx, rgbx, rgbf2));
-			nvgTextBox(args.vg, 1.f, 23.5f, 134.f, sVo.c_str(), NULL);
+			nvgTextBox(args.vg, 1.f, 23.5f, 134.f, sVo, NULL);
 		}else{  //Two buttons in non-MPE modes
 			nvgFillColor(args.vg, nvgRGB(rgbx, rgbx, rgbf2));
-			nvgTextBox(args.vg, 1.f, 23.5f, 67.f, sVo.c_str(), NULL);
+			nvgTextBox(args.vg, 1.f, 23.5f, 67.f, sVo, NULL);
 			nvgFillColor(args.vg, nvgRGB(rgbx, rgbx, rgbf3));
-			nvgTextBox(args.vg, 67.f, 23.5f, 67.f, sOut.c_str(), NULL);
+			nvgTextBox(args.vg, 67.f, 23.5f, 67.f, sOut, NULL);
 		}
 		nvgFillColor(args.vg, nvgRGB(rgbx, gb1 & gb2, gb1f & gb2f));
 		nvgTextBox(args.vg, 1.f, 36.5f, 18.f, "nte:", NULL);
 		nvgFillColor(args.vg, nvgRGB(rgbx, gb1, gb1f));
-		nvgTextBox(args.vg, 19.f, 36.5f, 29.f, snoteMin.c_str(), NULL);
+		nvgTextBox(args.vg, 19.f, 36.5f, 29.f, snoteMinD, NULL);
 		nvgFillColor(args.vg, nvgRGB(rgbx, gb2, gb2f));
-		nvgTextBox(args.vg, 48.f, 36.5f, 29.f, snoteMax.c_str(), NULL);
+		nvgTextBox(args.vg, 48.f, 36.5f, 29.f, snoteMaxD, NULL);
 		nvgFillColor(args.vg, nvgRGB(rgbx, gb3 & gb4, gb3f & gb4f));
 		nvgTextBox(args.vg, 77.f, 36.5f, 16.f, "vel:", NULL);
 		nvgFillColor(args.vg, nvgRGB(rgbx, gb3, gb3f));
-		nvgTextBox(args.vg, 93.f, 36.5f, 20.f, svelMin.c_str(), NULL);
+		nvgTextBox(args.vg, 93.f, 36.5f, 20.f, svelMinD, NULL);
 		nvgFillColor(args.vg, nvgRGB(rgbx, gb4, gb4f));
-		nvgTextBox(args.vg, 113.f, 36.5f, 20.f, svelMax.c_str(), NULL);
+		nvgTextBox(args.vg, 113.f, 36.5f, 20.f, svelMaxD, NULL);
 	}
 	void onButton(const event::Button &e) override {
 		if ((e.button == GLFW_MOUSE_BUTTON_LEFT) && (e.action == GLFW_PRESS)){
@@ -1421,328 +1760,370 @@ struct PolyModeDisplayC : TransparentWidget {
 					if (e.pos.x > module->coords[SuperMIDI64::VEL_RANGE_SELECTOR + 1].x) i = SuperMIDI64::VEL_RANGE_SELECTOR + 1;
 					else i = SuperMIDI64::VEL_RANGE_SELECTOR;
 				}
-				if (module->cursorIx != i){
-					module->cursorIx = i;
-					module->learnNote = i;
-					module->autoFocusOff = 10 * APP->engine->getSampleRate();
-				} else if (module->learnNote == i)	{
-					module->learnNote = -1;
-					module->autoFocusOff = 10 * APP->engine->getSampleRate();
-				}else {
-					module->learnNote = -1;
-					module->cursorIx = -1;
-					module->autoFocusOff = 0;
-				}
+				if (disp->cursorIx != i) module->postFocus(i, -1, i, true);
+				else if (disp->learnNote == i) module->postFocus(SuperMIDI64::UiCommand::KEEP, -1, -1, true);
+				else module->postFocus(-1, -1, -1, false);
 			} else {
-				module->learnNote = -1;
 				if (row == 1) {
-					if (module->polyModeIx > 1) {
+					if (disp->polyModeIx > 1) {
 						if (e.pos.x > 67.f) i = SuperMIDI64::OUTS_SELECTOR;
 						else i = SuperMIDI64::VOICES_SELECTOR;
 					}
 					else i = SuperMIDI64::VOICES_SELECTOR;
 				}
 				else i = SuperMIDI64::POLYMODE_SELECTOR;
-				if (module->cursorIx != i)	{
-					module->cursorIx = i;
-					module->autoFocusOff = 10 * APP->engine->getSampleRate();
-				}else {
-					module->cursorIx = -1;
-					module->autoFocusOff = 0;
-				}
+				if (disp->cursorIx != i) module->postFocus(i, -1, -1, true);
+				else module->postFocus(-1, -1, -1, false);
 			}
-			module->learnCC = -1;
 		}
 	}
 };
 ///////////////////////////////////////////////////////////////////////////////////////
-struct MidiccDisplayC : OpaqueWidget {
-	MidiccDisplayC(){
-	font = APP->window->loadFont(mFONT_FILE);
+struct MidiccLcdsC : Widget {
+	static const int NUM_FIELDS = SuperMIDI64::NUM_LCDS_SELECTORS - SuperMIDI64::Y_LCD;// Y Z RELVEL TRNSP PBENDx2 CCx20
+	static const int FIRST_CC_FIELD = SuperMIDI64::CC_LCD - SuperMIDI64::Y_LCD;
+	/** One LCD field, id = coords[] index - Y_LCD */
+	struct Field {
+		Rect box;// relative to this widget
+		char sDisplay[12] = "";
+		int ccNumber = -1;
+		int pbDwn = 222;
+		int pbUp = 222;
+		int trnsps = 222;
+		int driftcents = 0;
+		int mymode = 0;
+		bool focusOn = false;
+		int flashFocus = 0;
+		bool canlearn = true;
+		bool canedit = true;
+		int polychanged = -1;
+		int lrncol = 0;
+	};
+	MidiccLcdsC(){
+		font = pluginFont();
 	}
 	SuperMIDI64 *module;
+	const SuperMIDI64::Display *disp;// the widget's copy of the engine snapshot
+	FramebufferWidget *fb = NULL;// caches the drawing, redrawn when dirty
 	float mdfontSize = 11.f;
-	std::string sDisplay = "";
-	int displayID = -1;
-	int ccNumber = -1;
-	int pbDwn = 222;
-	int pbUp = 222;
-	int trnsps = 222;
-	int driftcents = 0;
-	bool learnOn = false;
-	int mymode = 0;
-	bool focusOn = false;
-	int flashFocus = 0;
-	bool canlearn = true;
-	bool canedit = true;
-	int polychanged = -1;
-	int lrncol = 0;
+	Field fields[NUM_FIELDS];
+	int firstField = 0;// this widget steps, draws and clicks fields firstField ~ endField - 1
+	int endField = NUM_FIELDS;
 	std::shared_ptr<Font> font;
-	void draw(const DrawArgs &args) override{
-			switch (displayID){
-				case 0:{
-					if (module->polyModeIx < SuperMIDI64::ROTATE_MODE) {
-						if ((ccNumber != module->displayYcc) || (polychanged != module->polyModeIx)) {
-							ccNumber = module->displayYcc;
-							polychanged = module->polyModeIx;
-							displayedCC();
-						}
-						canedit = (module->polyModeIx == SuperMIDI64::MPE_MODE);
-					}else{
-						if ((driftcents != module->driftcents) || (polychanged != module->polyModeIx)) {
-							driftcents = module->driftcents;
-							polychanged = module->polyModeIx;
-							sDisplay = "+-" + std::to_string(module->driftcents) + "cnt";
-						}
-						canedit = true;
-					}
-					canlearn = false;
-				}break;
-				case 1:{
-					if (ccNumber != module->displayZcc) {
-						ccNumber = module->displayZcc;
-						//mymode = 0;
-						displayedCC();
-					}
-					canedit = (module->polyModeIx == SuperMIDI64::MPE_MODE);
-					canlearn = false;
-				}break;
-				case 2:{
-					switch (module->polyModeIx) {
-						case SuperMIDI64::MPE_MODE: {
-							if (module->mpePbOut) sDisplay = "chnPB";
-							else sDisplay = "relVel";
-							canedit = true;
-						}break;
-						case SuperMIDI64::MPEPLUS_MODE: {
-							sDisplay = "chnPB";
-							canedit = false;
-						}break;
-						default: {
-							sDisplay = "relVel";
-							canedit = false;
-						}break;
-					}
-					canlearn = false;
-				}break;
-				case 3:{
-					if (trnsps != module->trnsps){
-						trnsps = module->trnsps;
-						if (trnsps > 0) sDisplay = "t+" + std::to_string(trnsps);
-						else if (trnsps < 0) sDisplay = "t" + std::to_string(trnsps);
-						else sDisplay = "t 0";
-					}
-					canedit = true;
-					canlearn = false;
-				}break;
-				case 4:{
-					if (pbDwn != module->pbMainDwn){
-						pbDwn = module->pbMainDwn;
-						if (pbDwn > 0) sDisplay = "d+" + std::to_string(pbDwn);
-						else if (pbDwn < 0) sDisplay = "d" + std::to_string(pbDwn);
-						else sDisplay = "d 0";
-					};
-					canlearn = false;
-				}break;
-				case 5:{
-					if (pbUp != module->pbMainUp){
-						pbUp = module->pbMainUp;
-						if (pbUp > 0) sDisplay = "u+" + std::to_string(pbUp);
-						else if (pbUp > 0) sDisplay = "u" + std::to_string(pbUp);
-						else sDisplay = "u 0";
-					}
-					canlearn = false;
-				}break;
-				default:{
-					if (ccNumber != module->midiCCs[displayID - 6]) {
-						ccNumber = module->midiCCs[displayID - 6];
-						displayedCC();
+
+	static Vec fieldSize(int id){
+		const Vec sizes[FIRST_CC_FIELD] = {Vec(40.f, 13.f), Vec(40.f, 13.f), Vec(40.f, 13.f), Vec(25.f, 13.f), Vec(25.f, 13.f), Vec(25.f, 13.f)};
+		return (id < FIRST_CC_FIELD) ? sizes[id] : Vec(30.f, 13.f);
+	}
+	/** Panel area drawn by fields first ~ end - 1 */
+	static Rect fieldsBounds(const Vec *coords, int first, int end){
+		Vec boundsMin = coords[SuperMIDI64::Y_LCD + first];
+		Vec boundsMax = boundsMin;
+		for (int i = first; i < end; i++) {
+			boundsMin = boundsMin.min(coords[SuperMIDI64::Y_LCD + i]);
+			boundsMax = boundsMax.max(coords[SuperMIDI64::Y_LCD + i].plus(fieldSize(i)));
+		}
+		return Rect(boundsMin, boundsMax.minus(boundsMin));
+	}
+	/** Lays fields first ~ end - 1 out from coords[], origin is this widget's position on the panel */
+	void setFields(const Vec *coords, int first, int end, Vec origin){
+		firstField = first;
+		endField = end;
+		for (int i = first; i < end; i++) {
+			fields[i].box.pos = coords[SuperMIDI64::Y_LCD + i].minus(origin);
+			fields[i].box.size = fieldSize(i);
+		}
+	}
+	void displayedCC(Field &f){
+		ccLabel(f.ccNumber, f.sDisplay, sizeof(f.sDisplay));
+	}
+	/** "t+2", "t-2", "t 0" */
+	static void signedText(Field &f, char prefix, int value){
+		if (value == 0) snprintf(f.sDisplay, sizeof(f.sDisplay), "%c 0", prefix);
+		else snprintf(f.sDisplay, sizeof(f.sDisplay), "%c%+d", prefix, value);
+	}
+	/** Brings field id up to date with the snapshot. Returns true if its drawing changed */
+	bool stepField(int id){
+		Field &f = fields[id];
+		char lastDisplay[sizeof(f.sDisplay)];
+		memcpy(lastDisplay, f.sDisplay, sizeof(f.sDisplay));
+		int lastMode = f.mymode;
+		bool lastCanedit = f.canedit;
+		switch (id){
+			case 0:{
+				if (disp->polyModeIx < SuperMIDI64::ROTATE_MODE) {
+					if ((f.ccNumber != disp->displayYcc) || (f.polychanged != disp->polyModeIx)) {
+						f.ccNumber = disp->displayYcc;
+						f.polychanged = disp->polyModeIx;
+						displayedCC(f);
 					}
-					canlearn = true;
-					if ((mymode==2) && (module->learnCC == -1)) {
-						mymode = 0;
-						displayedCC();
+					f.canedit = (disp->polyModeIx == SuperMIDI64::MPE_MODE);
+				}else{
+					if ((f.driftcents != disp->driftcents) || (f.polychanged != disp->polyModeIx)) {
+						f.driftcents = disp->driftcents;
+						f.polychanged = disp->polyModeIx;
+						snprintf(f.sDisplay, sizeof(f.sDisplay), "+-%dcnt", disp->driftcents);
 					}
-				}break;
-			}
-			if (focusOn && (displayID != (module->cursorIx - SuperMIDI64::Y_LCD))){
-				focusOn = false;
-				if (mymode == 2) {
-					displayedCC();
+					f.canedit = true;
 				}
-				mymode = 0;
-			}
-			nvgFontSize(args.vg, mdfontSize);
-			nvgFontFaceId(args.vg, font->handle);
-			nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
-			switch(mymode){
-				case 0:{
-					unsigned char strgb = (canedit)? 0xdd : 0x99;
-					nvgFillColor(args.vg, nvgRGB(strgb, strgb, strgb));
-				}break;
-				case 1:{
-					nvgBeginPath(args.vg);
-					nvgRoundedRect(args.vg, 0.f, 0.f, box.size.x, box.size.y,3.f);
-					if (flashFocus > 0) flashFocus -= 2;
-					nvgFillColor(args.vg, nvgRGBA(0x64, 0x64, 0, 0xc0 + flashFocus)); //SELECTED
-					nvgFill(args.vg);
-					nvgGlobalCompositeBlendFunc(args.vg,  NVG_ONE , NVG_ONE);
-					nvgFillColor(args.vg, nvgRGB(0xdd, 0xdd, 0));
-				}break;
-				case 2:{
-					if ((lrncol += 16) > 255) lrncol = 0;
-					nvgBeginPath(args.vg);
-					nvgRoundedRect(args.vg, 0.f, 0.f, box.size.x, box.size.y,3.f);
-					nvgFillColor(args.vg, nvgRGBA(lrncol, 0, 0, 0xc0));
-					nvgFill(args.vg);
-					nvgGlobalCompositeBlendFunc(args.vg,  NVG_ONE , NVG_ONE);
-					nvgFillColor(args.vg, nvgRGB(0xdd , 0, 0));//LEARN
-				}break;
+				f.canlearn = false;
+			}break;
+			case 1:{
+				if (f.ccNumber != disp->displayZcc) {
+					f.ccNumber = disp->displayZcc;
+					displayedCC(f);
+				}
+				f.canedit = (disp->polyModeIx == SuperMIDI64::MPE_MODE);
+				f.canlearn = false;
+			}break;
+			case 2:{
+				switch (disp->polyModeIx) {
+					case SuperMIDI64::MPE_MODE: {
+						snprintf(f.sDisplay, sizeof(f.sDisplay), "%s", disp->mpePbOut ? "chnPB" : "relVel");
+						f.canedit = true;
+					}break;
+					case SuperMIDI64::MPEPLUS_MODE: {
+						snprintf(f.sDisplay, sizeof(f.sDisplay), "chnPB");
+						f.canedit = false;
+					}break;
+					default: {
+						snprintf(f.sDisplay, sizeof(f.sDisplay), "relVel");
+						f.canedit = false;
+					}break;
+				}
+				f.canlearn = false;
+			}break;
+			case 3:{
+				if (f.trnsps != disp->trnsps){
+					f.trnsps = disp->trnsps;
+					signedText(f, 't', f.trnsps);
+				}
+				f.canedit = true;
+				f.canlearn = false;
+			}break;
+			case 4:{
+				if (f.pbDwn != disp->pbMainDwn){
+					f.pbDwn = disp->pbMainDwn;
+					signedText(f, 'd', f.pbDwn);
+				}
+				f.canlearn = false;
+			}break;
+			case 5:{
+				if (f.pbUp != disp->pbMainUp){
+					f.pbUp = disp->pbMainUp;
+					signedText(f, 'u', f.pbUp);
+				}
+				f.canlearn = false;
+			}break;
+			default:{
+				if (f.ccNumber != disp->midiCCs[id - 6]) {
+					f.ccNumber = disp->midiCCs[id - 6];
+					displayedCC(f);
+				}
+				f.canlearn = true;
+				if ((f.mymode==2) && (disp->learnCC == -1) && !module->uiPending(disp)) {
+					f.mymode = 0;
+					displayedCC(f);
+				}
+			}break;
+		}
+		if (f.focusOn && (id != (disp->cursorIx - SuperMIDI64::Y_LCD)) && !module->uiPending(disp)){
+			f.focusOn = false;
+			if (f.mymode == 2) {
+				displayedCC(f);
 			}
-		nvgTextBox(args.vg, 0.f, 10.f,box.size.x, sDisplay.c_str(), NULL);
+			f.mymode = 0;
+		}
+		bool changed = (f.mymode != lastMode) || (f.canedit != lastCanedit) || strcmp(f.sDisplay, lastDisplay);
+		if ((f.mymode == 1) && (f.flashFocus > 0)) {// focus flash fading
+			f.flashFocus -= 2;
+			changed = true;
+		}
+		if (f.mymode == 2) {// learn blink
+			if ((f.lrncol += 16) > 255) f.lrncol = 0;
+			changed = true;
+		}
+		return changed;
+	}
+	void step() override {
+		bool changed = false;
+		for (int i = firstField; i < endField; i++)
+			changed |= stepField(i);
+		if (changed && fb) fb->dirty = true;
+		Widget::step();
+	}
+	void draw(const DrawArgs &args) override{
+		// focus / learn backgrounds first, then all text with one font setup
+		for (int i = firstField; i < endField; i++) {
+			const Field &f = fields[i];
+			if (f.mymode < 1) continue;
+			nvgBeginPath(args.vg);
+			nvgRoundedRect(args.vg, f.box.pos.x, f.box.pos.y, f.box.size.x, f.box.size.y, 3.f);
+			if (f.mymode == 1) nvgFillColor(args.vg, nvgRGBA(0x64, 0x64, 0, 0xc0 + f.flashFocus)); //SELECTED
+			else nvgFillColor(args.vg, nvgRGBA(f.lrncol, 0, 0, 0xc0));
+			nvgFill(args.vg);
+		}
+		nvgFontSize(args.vg, mdfontSize);
+		nvgFontFaceId(args.vg, font->handle);
+		nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
+		for (int i = firstField; i < endField; i++) {
+			const Field &f = fields[i];
+			if (f.mymode > 0) continue;
+			unsigned char strgb = (f.canedit)? 0xdd : 0x99;
+			nvgFillColor(args.vg, nvgRGB(strgb, strgb, strgb));
+			nvgTextBox(args.vg, f.box.pos.x, f.box.pos.y + 10.f, f.box.size.x, f.sDisplay, NULL);
+		}
+		nvgGlobalCompositeBlendFunc(args.vg,  NVG_ONE , NVG_ONE);// focused text adds over its background
+		for (int i = firstField; i < endField; i++) {
+			const Field &f = fields[i];
+			if (f.mymode < 1) continue;
+			if (f.mymode == 1) nvgFillColor(args.vg, nvgRGB(0xdd, 0xdd, 0));
+			else nvgFillColor(args.vg, nvgRGB(0xdd , 0, 0));//LEARN
+			nvgTextBox(args.vg, f.box.pos.x, f.box.pos.y + 10.f, f.box.size.x, f.sDisplay, NULL);
+		}
 	}
-	void mymodeAction(){
-		switch (mymode){
+	void mymodeAction(int id){
+		Field &f = fields[id];
+		switch (f.mymode){
 			case 0:{
-				focusOn = false;
-				module->cursorIx = -1;
-				module->learnCC = -1;
-				module->autoFocusOff = 0;
+				f.focusOn = false;
+				module->postFocus(-1, -1, -1, false);
 			}break;
 			case 1:{
-				if (canlearn) displayedCC();
-				flashFocus = 64;
-				focusOn = true;
-				module->learnCC = -1;
-				module->cursorIx = SuperMIDI64::Y_LCD + displayID;
-				module->autoFocusOff = 10 * APP->engine->getSampleRate();
+				if (f.canlearn) displayedCC(f);
+				f.flashFocus = 64;
+				f.focusOn = true;
+				module->postFocus(SuperMIDI64::Y_LCD + id, -1, -1, true);
 			}break;
 			case 2:{
-				sDisplay = "LRN";
-				focusOn = true;
-				module->cursorIx = SuperMIDI64::Y_LCD + displayID;
-				module->learnCC = displayID - 6;
-				module->autoFocusOff = 10 * APP->engine->getSampleRate();
+				snprintf(f.sDisplay, sizeof(f.sDisplay), "LRN");
+				f.focusOn = true;
+				module->postFocus(SuperMIDI64::Y_LCD + id, id - 6, -1, true);
 			}break;
 		}
 	}
-	void displayedCC(){
-		switch (ccNumber) {
+	/** Short name of a CC number */
+	static void ccLabel(int cc, char *s, size_t n){
+		switch (cc) {
 			case 1 :{
-				sDisplay = "Mod";
+				snprintf(s, n, "Mod");
 			}break;
 			case 2 :{
-				sDisplay = "BrC";
+				snprintf(s, n, "BrC");
 			}break;
 			case 4 :{
-				sDisplay = "Foot";
+				snprintf(s, n, "Foot");
 			}break;
 			case 7 :{
-				sDisplay = "Vol";
+				snprintf(s, n, "Vol");
 			}break;
 			case 8 :{
-				sDisplay = "Bal";
+				snprintf(s, n, "Bal");
 			}break;
 			case 10 :{
-				sDisplay = "Pan";
+				snprintf(s, n, "Pan");
 			}break;
 			case 11 :{
-				sDisplay = "Expr";
+				snprintf(s, n, "Expr");
 			}break;
 			case 12 :{
-				sDisplay = "FX 1";
+				snprintf(s, n, "FX 1");
 			}break;
 			case 13 :{
-				sDisplay = "FX 2";
+				snprintf(s, n, "FX 2");
 			}break;
 			case 16 :{
-				sDisplay = "Ctrl 1";
+				snprintf(s, n, "Ctrl 1");
 			}break;
 			case 17 :{
-				sDisplay = "Ctrl 2";
+				snprintf(s, n, "Ctrl 2");
 			}break;
 			case 18 :{
-				sDisplay = "Ctrl 3";
+				snprintf(s, n, "Ctrl 3");
 			}break;
 			case 19 :{
-				sDisplay = "Ctrl 4";
+				snprintf(s, n, "Ctrl 4");
 			}break;
 			case 64 :{
-				sDisplay = "Sust";
+				snprintf(s, n, "Sust");
 			}break;
 			case 66 :{
-				sDisplay = "Sost";
+				snprintf(s, n, "Sost");
 			}break;
 			case 67 :{
-				sDisplay = "Soft";
+				snprintf(s, n, "Soft");
 			}break;
 			case 68 :{
-				sDisplay = "Lgto";
+				snprintf(s, n, "Lgto");
 			}break;
 			case 69 :{
-				sDisplay = "Hold";
+				snprintf(s, n, "Hold");
 			}break;
 			case 70 :{
-				sDisplay = "Vari";
+				snprintf(s, n, "Vari");
 			}break;
 			case 71 :{
-				sDisplay = "Tmbr";
+				snprintf(s, n, "Tmbr");
 			}break;
 			case 72 :{
-				sDisplay = "Rel";
+				snprintf(s, n, "Rel");
 			}break;
 			case 73 :{
-				sDisplay = "Atk";
+				snprintf(s, n, "Atk");
 			}break;
 			case 74 :{
-				sDisplay = "Brite";
+				snprintf(s, n, "Brite");
 			}break;
 			case 80 :{
-				sDisplay = "Ctrl 5";
+				snprintf(s, n, "Ctrl 5");
 			}break;
 			case 81 :{
-				sDisplay = "Ctrl 6";
+				snprintf(s, n, "Ctrl 6");
 			}break;
 			case 82 :{
-				sDisplay = "Ctrl 7";
+				snprintf(s, n, "Ctrl 7");
 			}break;
 			case 83 :{
-				sDisplay = "Ctrl 8";
+				snprintf(s, n, "Ctrl 8");
 			}break;
 			case 128 :{
-				sDisplay = "chAT";
+				snprintf(s, n, "chAT");
 			}break;
 			case 129 :{
-				sDisplay = "noteAT";
+				snprintf(s, n, "noteAT");
 			}break;
 			case 130 :{
-				sDisplay = "Dtn";
+				snprintf(s, n, "Dtn");
 			}break;
 			case 131 :{//HiRes MPE Y
-				sDisplay = "cc74+";
+				snprintf(s, n, "cc74+");
 			}break;
 			case 132 :{//HiRes MPE Z
-				sDisplay = "chAT+";
+				snprintf(s, n, "chAT+");
 			}break;
 			default :{
-				sDisplay = "cc" + std::to_string(ccNumber);
+				snprintf(s, n, "cc%d", cc);
 			}
 		}
 	}
 	void onButton(const event::Button &e) override {
-		if ((e.button == GLFW_MOUSE_BUTTON_LEFT) && (canedit)){
-			//int dispLine = static_cast<int>((e.pos.y - 2.f)/ 13.f) ;
-			//bool valpress = (e.pos.x >  box.size.x / 2.f);
-			if (e.action == GLFW_PRESS){
-				if (mymode < 1) {
-					if (canlearn) mymode = 2;
-					else mymode = 1;
+		if ((e.button != GLFW_MOUSE_BUTTON_LEFT) || (e.action != GLFW_PRESS)) return;
+		for (int i = firstField; i < endField; i++) {
+			Field &f = fields[i];
+			if (!f.box.isContaining(e.pos)) continue;
+			if (f.canedit) {
+				if (f.mymode < 1) {
+					if (f.canlearn) f.mymode = 2;
+					else f.mymode = 1;
 				}
-				else mymode --;
-				mymodeAction();
-				module->learnNote = -1;
-			};
+				else f.mymode --;
+				mymodeAction(i);
+				if (fb) fb->dirty = true;
+			}
+			e.consume(this);
+			return;
 		}
+		// outside the fields, the click goes on to the widgets below
 	}
 };
 ///////////////////////////////////////////////////////////////////////////////////////
@@ -1750,7 +2131,7 @@ struct springDataKnobC : SvgKnob {
 	springDataKnobC() {
 		minAngle = -0.75*M_PI;
 		maxAngle = 0.75*M_PI;
-		setSvg(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXdataKnobB.svg")));
+		setSvg(pluginSvg("res/DLXdataKnobB.svg"));
 		shadow->opacity = 0.f;
 	}
 	void randomize() override{
@@ -1763,68 +2144,51 @@ struct springDataKnobC : SvgKnob {
 ///////////////////////////////////////////////////////////////////////////////////////
 /////// MODULE WIDGET ////////
 //////////////////////////////
+/** Puts an LCD inside its own framebuffer, the LCD marks it dirty when what it shows changes */
+template <class TLcd>
+TLcd *createCachedLcd(Widget *parent, Vec pos, Vec size) {
+	FramebufferWidget *fb = new FramebufferWidget;
+	fb->box.pos = pos;
+	fb->box.size = size;
+	TLcd *lcd = createWidget<TLcd>(Vec(0.f, 0.f));
+	lcd->box.size = size;
+	lcd->fb = fb;
+	fb->addChild(lcd);
+	parent->addChild(fb);
+	return lcd;
+}
+///////////////////////////////////////////////////////////////////////////////////////
 struct SuperMIDI64Widget : ModuleWidget {
+	SuperMIDI64::Display disp;// read once per frame, shared by the LCDs
+	char diagText[32] = "";// replaces the MIDI LCD channel line when diagnostics are shown
 	SuperMIDI64Widget(SuperMIDI64 *module) {
 		setModule(module);
-		setPanel(APP->window->loadSvg(asset::plugin(pluginInstance,"res/SuperMIDI64.svg")));
+		setPanel(pluginSvg("res/SuperMIDI64.svg"));
 		//Screws
 		addChild(createWidget<ScrewBlack>(Vec(RACK_GRID_WIDTH, 0)));
 		addChild(createWidget<ScrewBlack>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, 0)));
 		addChild(createWidget<ScrewBlack>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 		addChild(createWidget<ScrewBlack>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 
-		int dispID = 0;
+		// MIDI LCD, built now : its step reconnects the saved device and sets the port's channel
 		if (module) {
-			//MIDI
 			MIDIscreen *dDisplay = createWidget<MIDIscreen>(module->coords[SuperMIDI64::MIDI_LCD]);
 			dDisplay->box.size = {136.f, 40.f};
-			dDisplay->setMidiPort (&module->midiInput, &module->MPEmode, &module->MPEmasterCh, &module->midiActivity, &module->mdriverJx, &module->mdeviceJx, &module->mchannelJx, &module->resetMidi);
+			dDisplay->setMidiPort (&module->midiInput[0], &disp.MPEmode, &disp.MPEmasterCh, &disp.midiActivity, &module->mdriverJx, &module->mdeviceJx, &module->mchannelJx, [=](){ module->postResetMidi(); });
+			dDisplay->md->setMpeChn = [=](int channel){ module->postMpeMaster(channel); };
+			dDisplay->md->diagLine = diagText;
 			addChild(dDisplay);
-			//PolyModes LCD
-			PolyModeDisplayC *polyModeDisplay = createWidget<PolyModeDisplayC>(module->coords[SuperMIDI64::POLYMODE_LCD]);
-			polyModeDisplay->box.size = {136.f, 40.f};
-			polyModeDisplay->module = module;
-			addChild(polyModeDisplay);
-			//  Y Z LCDs
-			for ( int i = 0; i < 2; i++){
-				MidiccDisplayC *MccDisplay = createWidget<MidiccDisplayC>(module->coords[SuperMIDI64::Y_LCD + i]);
-				MccDisplay->box.size = {40.f, 13.f};
-				MccDisplay->displayID =  dispID ++;
-				MccDisplay->module = (module ? module : NULL);
-				addChild(MccDisplay);
-			}
-			// RelVel / chPbend LCD
-			MidiccDisplayC *rvelDisplay = createWidget<MidiccDisplayC>(module->coords[SuperMIDI64::RELVEL_LCD]);
-			rvelDisplay->box.size = {40.f, 13.f};
-			rvelDisplay->displayID =  dispID ++;
-			rvelDisplay->module = module;
-			addChild(rvelDisplay);
-			// trnsp LCD
-			MidiccDisplayC *MccDisplay = createWidget<MidiccDisplayC>(module->coords[SuperMIDI64::TRNSP_LCD]);
-			MccDisplay->box.size = {25.f, 13.f};
-			MccDisplay->displayID =  dispID ++;
-			MccDisplay->module = module;
-			addChild(MccDisplay);
-			// Pitch Bend LCD
-			for ( int i = 0; i < 2; i++){
-				MidiccDisplayC *MccDisplay = createWidget<MidiccDisplayC>(module->coords[SuperMIDI64::PBEND_LCD + i]);
-				MccDisplay->box.size = {25.f, 13.f};
-				MccDisplay->displayID =  dispID ++;
-				MccDisplay->module = module;
-				addChild(MccDisplay);
-			}
-		}
-		// ch Leds x 64
-		float xPos = 8.052f;
-		float yPos = 148.735f;
-		for (int i = 0; i < 2; i++) {
-			for (int j = 0; j < 32; j++) {
-				addChild(createLight<TinyLight<TPurpleLight>>(Vec(xPos + j * 4.349f, yPos + i * 3.862f), module, SuperMIDI64::CH_LIGHT + j + i*32));
-			}
 		}
+		// the other LCDs and the channel lights, built once the panel is first drawn
+		DeferredWidget *details = createWidget<DeferredWidget>(Vec(0.f, 0.f));
+		details->box.size = box.size;
+		details->build = [=](Widget *parent) {
+			addDetails(parent, module);
+		};
+		addChild(details);
 		////DATA KNOB + -
-		xPos = 59.195f;
-		yPos = 108.624f;
+		float xPos = 59.195f;
+		float yPos = 108.624f;
 		addParam(createParam<springDataKnobC>(Vec(xPos, yPos), module, SuperMIDI64::DATAKNOB_PARAM));
 		xPos = 40.104f;
 		yPos = 124.568f - 3.265f;
@@ -1877,17 +2241,89 @@ struct SuperMIDI64Widget : ModuleWidget {
 		yPos = 179.275f;
 		for ( int r = 0; r < 5; r++){
 			for ( int i = 0; i < 4; i++){
-				if (module){
-					MidiccDisplayC *MccDisplay = createWidget<MidiccDisplayC>(module->coords[SuperMIDI64::CC_LCD + i + 4*r]);
-					MccDisplay->box.size = {30.f, 13.f};
-					MccDisplay->displayID = dispID ++;
-					MccDisplay->module = module;
-					addChild(MccDisplay);
-				}
 				addOutput(createOutput<DLXPortG>(Vec(xPos + i*32.921f, yPos + r*39.98f),  module, SuperMIDI64::MM_OUTPUT + i + r * 4));
 			}
 		}
 	}
+
+	/** The LCDs other than the MIDI one and the 64 channel lights, into parent at the panel's origin */
+	void addDetails(Widget *parent, SuperMIDI64 *module) {
+		if (module) {
+			//PolyModes LCD
+			PolyModeDisplayC *polyModeDisplay = createCachedLcd<PolyModeDisplayC>(parent, module->coords[SuperMIDI64::POLYMODE_LCD], Vec(136.f, 40.f));
+			polyModeDisplay->module = module;
+			polyModeDisplay->disp = &disp;
+			// Y Z RelVel Trnsp PBend LCDs, then the CC LCDs, laid out from coords[]
+			// two widgets, one box around all of them would cover the PolyModes LCD
+			const int groups[3] = {0, MidiccLcdsC::FIRST_CC_FIELD, MidiccLcdsC::NUM_FIELDS};
+			for (int g = 0; g < 2; g++) {
+				Rect bounds = MidiccLcdsC::fieldsBounds(module->coords, groups[g], groups[g + 1]);
+				MidiccLcdsC *midiccLcds = createCachedLcd<MidiccLcdsC>(parent, bounds.pos, bounds.size);
+				midiccLcds->module = module;
+				midiccLcds->disp = &disp;
+				midiccLcds->setFields(module->coords, groups[g], groups[g + 1], bounds.pos);
+			}
+		}
+		// ch Leds x 64
+		float xPos = 8.052f;
+		float yPos = 148.735f;
+		for (int i = 0; i < 2; i++) {
+			for (int j = 0; j < 32; j++) {
+				parent->addChild(createLight<TinyLight<TPurpleLight>>(Vec(xPos + j * 4.349f, yPos + i * 3.862f), module, SuperMIDI64::CH_LIGHT + j + i*32));
+			}
+		}
+	}
+
+	void step() override {
+		if (module) {
+			SuperMIDI64 *m = static_cast<SuperMIDI64*>(module);
+			m->flushUiCommands();
+			disp = m->display.read();
+			if (m->showDiagnostics) {
+				const EngineStats &st = m->engineStats;
+				snprintf(diagText, sizeof(diagText), "%u/s %.0f%% %.0fns", st.totalMsgsPerSec(), 100.f * st.activeShare.load(std::memory_order_relaxed), st.avgSampleNs.load(std::memory_order_relaxed));
+			}
+			else diagText[0] = 0;
+		}
+		ModuleWidget::step();
+	}
+
+	void appendContextMenu(Menu *menu) override {
+		SuperMIDI64 *module = dynamic_cast<SuperMIDI64*>(this->module);
+
+		menu->addChild(new MenuSeparator());
+		menu->addChild(createMenuLabel("MIDI inputs (merged into one allocator)"));
+		std::shared_ptr<const MidiCatalog::Drivers> catalog = MidiCatalog::get()->current();
+		for (int p = 0; p < SuperMIDI64::NUM_PORTS; p++) {
+			MidiPortIn *port = &module->midiInput[p];
+			std::string portName = (p == 0) ? "LCD" : ((port->deviceId < 0) ? std::string("(no device)") : MidiCatalog::deviceName(*catalog, port->driverId, port->deviceId));
+			MidiPortInItem *portItem = createMenuItem<MidiPortInItem>(string::f("Input %d", p + 1), portName + " " + RIGHT_ARROW);
+			portItem->port = port;
+			portItem->showDevice = (p > 0);
+			portItem->setRemapChannel = [=](int channel) {module->postPortEdit(SuperMIDI64::UiCommand::PORT_CHANNEL, p, channel);};
+			portItem->setTranspose = [=](int transpose) {module->postPortEdit(SuperMIDI64::UiCommand::PORT_TRANSPOSE, p, transpose);};
+			menu->addChild(portItem);
+		}
+		MidiHubCapacityItem *capacityItem = createMenuItem<MidiHubCapacityItem>("Input buffer", string::f("%llu events", static_cast<unsigned long long>(MidiHub::get()->getCapacity())) + " " + RIGHT_ARROW);
+		menu->addChild(capacityItem);
+
+		menu->addChild(new MenuSeparator());
+		VoiceStatsItem *statsItem = createMenuItem<VoiceStatsItem>("Voice usage", RIGHT_ARROW);
+		statsItem->stats = &module->voiceStats;
+		menu->addChild(statsItem);
+		EngineStatsItem *engineItem = createMenuItem<EngineStatsItem>("Diagnostics", RIGHT_ARROW);
+		engineItem->stats = &module->engineStats;
+		engineItem->ports = module->midiInput;
+		engineItem->numPorts = SuperMIDI64::NUM_PORTS;
+		engineItem->showOnLcd = &module->showDiagnostics;
+		menu->addChild(engineItem);
+		MidiCaptureItem *captureItem = createMenuItem<MidiCaptureItem>("Record input...");
+		captureItem->capture = &module->capture;
+		menu->addChild(captureItem);
+		SmfPlayerItem *playerItem = createMenuItem<SmfPlayerItem>("File playback", RIGHT_ARROW);
+		playerItem->player = &module->player;
+		menu->addChild(playerItem);
+	}
 };
 
 Model *modelSuperMIDI64 = createModel<SuperMIDI64, SuperMIDI64Widget>("SuperMIDI64");
@@ -0,0 +1,210 @@
+/*
+Super MIDI 64 X : expander adding 4x16ch voice outputs and 20 CC outputs to Super MIDI 64
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "plugin.hpp"
+
+struct SuperMIDI64X : Module {
+	enum ParamIds {
+		NUM_PARAMS
+	};
+	enum InputIds {
+		NUM_INPUTS
+	};
+	enum OutputIds {
+		ENUMS(X_OUTPUT, 4),
+		ENUMS(Y_OUTPUT, 4),
+		ENUMS(Z_OUTPUT, 4),
+		ENUMS(VEL_OUTPUT, 4),
+		ENUMS(RVEL_OUTPUT, 4),
+		ENUMS(GATE_OUTPUT, 4),
+		ENUMS(MM_OUTPUT, 20),
+		NUM_OUTPUTS
+	};
+	enum LightIds {
+		LINK_LIGHT,
+		NUM_LIGHTS
+	};
+
+	SuperMIDI64XBus xBus[2];// leftExpander producer/consumer
+	int midiCCs[20] = {20,21,22,23,24,25,26,27,28,29,30,31,85,86,89,90,102,103,104,105};
+
+	SuperMIDI64X() {
+		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+		leftExpander.producerMessage = &xBus[0];
+		leftExpander.consumerMessage = &xBus[1];
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		json_t *midiCCsJ = json_array();
+		for (int i = 0; i < 20; i++)
+			json_array_append_new(midiCCsJ, json_integer(midiCCs[i]));
+		json_object_set_new(rootJ, "midiCCs", midiCCsJ);
+		return rootJ;
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	void dataFromJson(json_t *rootJ) override {
+		json_t *midiCCsJ = json_object_get(rootJ, "midiCCs");
+		if (midiCCsJ) {
+			for (int i = 0; i < 20; i++) {
+				json_t *ccJ = json_array_get(midiCCsJ, i);
+				if (ccJ) midiCCs[i] = json_integer_value(ccJ);
+			}
+		}
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	void process(const ProcessArgs &args) override {
+		bool linked = (leftExpander.module && (leftExpander.module->model == modelSuperMIDI64));
+		lights[LINK_LIGHT].value = linked ? 1.f : 0.f;
+		if (!linked) {
+			for (int o = 0; o < 4; o++) {
+				outputs[X_OUTPUT + o].setChannels(0);
+				outputs[Y_OUTPUT + o].setChannels(0);
+				outputs[Z_OUTPUT + o].setChannels(0);
+				outputs[VEL_OUTPUT + o].setChannels(0);
+				outputs[RVEL_OUTPUT + o].setChannels(0);
+				outputs[GATE_OUTPUT + o].setChannels(0);
+			}
+			for (int i = 0; i < 20; i++)
+				outputs[MM_OUTPUT + i].setVoltage(0.f);
+			return;
+		}
+		// CC assignments back to the main module
+		SuperMIDI64XConfig *xcfg = static_cast<SuperMIDI64XConfig*>(leftExpander.module->rightExpander.producerMessage);
+		std::copy(midiCCs, midiCCs + 20, xcfg->midiCCs);
+		leftExpander.module->rightExpander.messageFlipRequested = true;
+
+		const SuperMIDI64XBus *bus = static_cast<SuperMIDI64XBus*>(leftExpander.consumerMessage);
+		for (int o = 0; o < 4; o++) {
+			int channels = (o < bus->numVOout) ? bus->numVOper : 0;
+			outputs[X_OUTPUT + o].setChannels(channels);
+			outputs[Y_OUTPUT + o].setChannels(channels);
+			outputs[Z_OUTPUT + o].setChannels(channels);
+			outputs[VEL_OUTPUT + o].setChannels(channels);
+			outputs[RVEL_OUTPUT + o].setChannels(channels);
+			outputs[GATE_OUTPUT + o].setChannels(channels);
+			if (channels < 1) continue;
+			std::copy(bus->x[o], bus->x[o] + channels, outputs[X_OUTPUT + o].voltages);
+			std::copy(bus->y[o], bus->y[o] + channels, outputs[Y_OUTPUT + o].voltages);
+			std::copy(bus->z[o], bus->z[o] + channels, outputs[Z_OUTPUT + o].voltages);
+			std::copy(bus->vel[o], bus->vel[o] + channels, outputs[VEL_OUTPUT + o].voltages);
+			std::copy(bus->rvel[o], bus->rvel[o] + channels, outputs[RVEL_OUTPUT + o].voltages);
+			std::copy(bus->gate[o], bus->gate[o] + channels, outputs[GATE_OUTPUT + o].voltages);
+		}
+		for (int i = 0; i < 20; i++)
+			outputs[MM_OUTPUT + i].setVoltage(bus->cc[i]);
+	}
+};
+///////////////////////////////////////////////////////////////////////////////////////
+struct XccValueItem : MenuItem {
+	SuperMIDI64X *module;
+	int slot;
+	int cc;
+	void onAction(const event::Action &e) override {
+		module->midiCCs[slot] = cc;
+	}
+};
+
+struct XccRangeItem : MenuItem {
+	SuperMIDI64X *module;
+	int slot;
+	int firstCC;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu;
+		for (int cc = firstCC; cc < firstCC + 32; cc++) {
+			XccValueItem *item = createMenuItem<XccValueItem>(string::f("cc%d", cc), CHECKMARK(module->midiCCs[slot] == cc));
+			item->module = module;
+			item->slot = slot;
+			item->cc = cc;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+
+struct XccSlotItem : MenuItem {
+	SuperMIDI64X *module;
+	int slot;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu;
+		XccValueItem *chATItem = createMenuItem<XccValueItem>("chAT", CHECKMARK(module->midiCCs[slot] == 128));
+		chATItem->module = module;
+		chATItem->slot = slot;
+		chATItem->cc = 128;
+		menu->addChild(chATItem);
+		XccValueItem *offItem = createMenuItem<XccValueItem>("Off", CHECKMARK(module->midiCCs[slot] < 0));
+		offItem->module = module;
+		offItem->slot = slot;
+		offItem->cc = -1;
+		menu->addChild(offItem);
+		for (int r = 0; r < 4; r++) {
+			XccRangeItem *rangeItem = createMenuItem<XccRangeItem>(string::f("cc%d ~ cc%d", r * 32, r * 32 + 31), RIGHT_ARROW);
+			rangeItem->module = module;
+			rangeItem->slot = slot;
+			rangeItem->firstCC = r * 32;
+			menu->addChild(rangeItem);
+		}
+		return menu;
+	}
+};
+///////////////////////////////////////////////////////////////////////////////////////
+/////// MODULE WIDGET ////////
+//////////////////////////////
+struct SuperMIDI64XWidget : ModuleWidget {
+	SuperMIDI64XWidget(SuperMIDI64X *module) {
+		setModule(module);
+		setPanel(pluginSvg("res/SuperMIDI64X.svg"));
+		//Screws
+		addChild(createWidget<ScrewBlack>(Vec(RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<ScrewBlack>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<ScrewBlack>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+		addChild(createWidget<ScrewBlack>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+
+		addChild(createLight<TinyLight<TPurpleLight>>(Vec(8.f, 22.f), module, SuperMIDI64X::LINK_LIGHT));
+		// Voice outputs 5 ~ 8 : X Y Z RVel Vel Gate rows
+		float xPos = 14.f;
+		float yPos = 34.f;
+		const int rowIds[6] = {SuperMIDI64X::X_OUTPUT, SuperMIDI64X::Y_OUTPUT, SuperMIDI64X::Z_OUTPUT, SuperMIDI64X::RVEL_OUTPUT, SuperMIDI64X::VEL_OUTPUT, SuperMIDI64X::GATE_OUTPUT};
+		for (int r = 0; r < 6; r++) {
+			for (int i = 0; i < 4; i++)
+				addOutput(createOutput<DLXPortPoly>(Vec(xPos + i * 29.192f, yPos + r * 30.f),  module, rowIds[r] + i));
+		}
+		// CC's 21 ~ 40
+		xPos = 16.f;
+		yPos = 222.f;
+		for (int r = 0; r < 5; r++) {
+			for (int i = 0; i < 4; i++)
+				addOutput(createOutput<DLXPortG>(Vec(xPos + i * 29.192f, yPos + r * 28.f),  module, SuperMIDI64X::MM_OUTPUT + i + r * 4));
+		}
+	}
+
+	void appendContextMenu(Menu *menu) override {
+		SuperMIDI64X *module = dynamic_cast<SuperMIDI64X*>(this->module);
+
+		menu->addChild(new MenuSeparator());
+		menu->addChild(createMenuLabel("CC outputs (left to right, top to bottom)"));
+		for (int i = 0; i < 20; i++) {
+			std::string ccName = (module->midiCCs[i] == 128) ? "chAT" : ((module->midiCCs[i] < 0) ? "Off" : string::f("cc%d", module->midiCCs[i]));
+			XccSlotItem *slotItem = createMenuItem<XccSlotItem>(string::f("CC %d", i + 21), ccName + " " + RIGHT_ARROW);
+			slotItem->module = module;
+			slotItem->slot = i;
+			menu->addChild(slotItem);
+		}
+	}
+};
+
+Model *modelSuperMIDI64X = createModel<SuperMIDI64X, SuperMIDI64XWidget>("SuperMIDI64X");
@@ -0,0 +1,41 @@
+/*
+SuperMIDI64X.hpp : expander bus between Super MIDI 64 and Super MIDI 64 X
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+using namespace rack;
+
+/** Voice and CC state for outputs 5 ~ 8 and CCs 21 ~ 40.
+SuperMIDI64 writes it in place into the expander's leftExpander.producerMessage,
+Rack swaps producer and consumer at the end of the sample.
+*/
+struct SuperMIDI64XBus {
+	int numVOout = 0;	// active outputs on the expander 0 ~ 4
+	int numVOper = 0;	// voices per output
+	float x[4][16] = {};
+	float y[4][16] = {};
+	float z[4][16] = {};
+	float vel[4][16] = {};
+	float rvel[4][16] = {};
+	float gate[4][16] = {};
+	float cc[20] = {};
+};
+
+/** Sent back by the expander into SuperMIDI64's rightExpander.producerMessage */
+struct SuperMIDI64XConfig {
+	int midiCCs[20] = {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1};// -1 unassigned, 128 chAT
+};
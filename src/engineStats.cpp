@@ -0,0 +1,52 @@
+/*
+engineStats.cpp : per-module MIDI load and process() cost counters
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "plugin.hpp"
+
+struct ShowOnLcdItem : MenuItem {
+	bool *showOnLcd;
+	void onAction(const event::Action &e) override {
+		*showOnLcd ^= true;
+	}
+};
+///////////////////////////////////////////////////////////////////////////////////////
+Menu *EngineStatsItem::createChildMenu() {
+	Menu *menu = new Menu;
+	const char *typeNames[EngineStats::NUM_MSG_TYPES] = {"Notes", "CC", "Pitch bend", "Aftertouch", "Program", "System"};
+	menu->addChild(createMenuLabel(string::f("MIDI in: %u msg/s", stats->totalMsgsPerSec())));
+	for (int t = 0; t < EngineStats::NUM_MSG_TYPES; t++)
+		menu->addChild(createMenuLabel(string::f("   %s: %u/s", typeNames[t], stats->msgsPerSec[t].load(std::memory_order_relaxed))));
+	uint32_t dropped = 0;
+	for (int p = 0; p < numPorts; p++)
+		dropped += ports[p].droppedCount.load(std::memory_order_relaxed);
+	menu->addChild(createMenuLabel(string::f("Dropped: %u   Coalesced: %u", dropped, stats->coalesced.load(std::memory_order_relaxed))));
+	menu->addChild(createMenuLabel(string::f("Most msgs in one sample: %u (ever %u)", stats->worstMsgsPerSample.load(std::memory_order_relaxed), stats->worstMsgsEver.load(std::memory_order_relaxed))));
+	menu->addChild(createMenuLabel(string::f("Samples handling MIDI: %.2f%%", 100.f * stats->activeShare.load(std::memory_order_relaxed))));
+	menu->addChild(createMenuLabel(string::f("process(): %.0f ns avg, %.0f ns worst", stats->avgSampleNs.load(std::memory_order_relaxed), stats->worstSampleNs.load(std::memory_order_relaxed))));
+	if (showOnLcd) {
+		menu->addChild(new MenuSeparator());
+		ShowOnLcdItem *lcdItem = createMenuItem<ShowOnLcdItem>("Show on MIDI LCD", CHECKMARK(*showOnLcd));
+		lcdItem->showOnLcd = showOnLcd;
+		menu->addChild(lcdItem);
+	}
+#ifdef MIDI_TRACE
+	menu->addChild(new MenuSeparator());
+	menu->addChild(createMenuItem<TraceSaveItem>("Save trace..."));
+#endif
+	return menu;
+}
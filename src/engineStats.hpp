@@ -0,0 +1,145 @@
+/*
+engineStats.hpp : per-module MIDI load and process() cost counters
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <atomic>
+#include <chrono>
+using namespace rack;
+
+/** Counts on the engine thread in plain fields, publishes to relaxed atomics once a
+second for the context menu and the LCD. process() cost is timed on one sample out
+of TIMING_EVERY, so the whole thing stays at a few adds per sample.
+*/
+struct EngineStats {
+	enum MsgType {
+		NOTE_MSG,
+		CC_MSG,
+		BEND_MSG,
+		AFTERTOUCH_MSG,
+		PROGRAM_MSG,
+		SYSTEM_MSG,
+		NUM_MSG_TYPES
+	};
+	static const uint32_t TIMING_EVERY = 256;
+
+	// engine thread only
+	uint32_t counts[NUM_MSG_TYPES] = {};
+	uint32_t sampleMsgs = 0;
+	uint32_t windowSamples = 0;
+	uint32_t activeSamples = 0;
+	uint32_t worstSample = 0;
+	uint32_t timedSamples = 0;
+	int64_t timedNs = 0;
+	int64_t worstNs = 0;
+	int64_t timerStart = -1;// -1 : this sample is not timed
+
+	// published once a second
+	std::atomic<uint32_t> msgsPerSec[NUM_MSG_TYPES];
+	std::atomic<uint32_t> coalesced{0};// total since the module was added
+	std::atomic<uint32_t> worstMsgsPerSample{0};// in the last second
+	std::atomic<uint32_t> worstMsgsEver{0};
+	std::atomic<float> activeShare{0.f};// samples that handled MIDI, 0 ~ 1
+	std::atomic<float> avgSampleNs{0.f};
+	std::atomic<float> worstSampleNs{0.f};
+
+	EngineStats() {
+		for (int t = 0; t < NUM_MSG_TYPES; t++)
+			msgsPerSec[t].store(0, std::memory_order_relaxed);
+	}
+	static int64_t nowNs() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	static MsgType typeOf(const midi::Message &msg) {
+		switch (msg.getStatus()) {
+			case 0x8: case 0x9: return NOTE_MSG;
+			case 0xb: return CC_MSG;
+			case 0xe: return BEND_MSG;
+			case 0xa: case 0xd: return AFTERTOUCH_MSG;
+			case 0xc: return PROGRAM_MSG;
+			default: return SYSTEM_MSG;
+		}
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	/** Engine thread : call first thing in process() */
+	void beginSample() {
+		timerStart = ((windowSamples % TIMING_EVERY) == 0) ? nowNs() : -1;
+	}
+	void countMessage(const midi::Message &msg) {
+		counts[typeOf(msg)] ++;
+		sampleMsgs ++;
+	}
+	void countCoalesced(int n) {
+		if (n > 0) coalesced.store(coalesced.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+	/** Engine thread : call on every way out of process() */
+	void endSample(float sampleRate) {
+		if (timerStart >= 0) {
+			int64_t ns = nowNs() - timerStart;
+			timedNs += ns;
+			timedSamples ++;
+			if (ns > worstNs) worstNs = ns;
+		}
+		if (sampleMsgs > 0) {
+			activeSamples ++;
+			if (sampleMsgs > worstSample) worstSample = sampleMsgs;
+			sampleMsgs = 0;
+		}
+		if (++windowSamples >= sampleRate) publish();
+	}
+	void publish() {// the window is one second long, counts are already per second
+		for (int t = 0; t < NUM_MSG_TYPES; t++) {
+			msgsPerSec[t].store(counts[t], std::memory_order_relaxed);
+			counts[t] = 0;
+		}
+		worstMsgsPerSample.store(worstSample, std::memory_order_relaxed);
+		if (worstSample > worstMsgsEver.load(std::memory_order_relaxed)) worstMsgsEver.store(worstSample, std::memory_order_relaxed);
+		activeShare.store(static_cast<float>(activeSamples) / windowSamples, std::memory_order_relaxed);
+		avgSampleNs.store(timedSamples ? static_cast<float>(timedNs) / timedSamples : 0.f, std::memory_order_relaxed);
+		worstSampleNs.store(static_cast<float>(worstNs), std::memory_order_relaxed);
+		windowSamples = activeSamples = worstSample = timedSamples = 0;
+		timedNs = worstNs = 0;
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	/** UI thread */
+	uint32_t totalMsgsPerSec() const {
+		uint32_t total = 0;
+		for (int t = 0; t < NUM_MSG_TYPES; t++)
+			total += msgsPerSec[t].load(std::memory_order_relaxed);
+		return total;
+	}
+	/** Times process() from construction to every return, at the sampling rate above */
+	struct Scope {
+		EngineStats &stats;
+		float sampleRate;
+		Scope(EngineStats &stats, float sampleRate) : stats(stats), sampleRate(sampleRate) {
+			stats.beginSample();
+		}
+		~Scope() {
+			stats.endSample(sampleRate);
+		}
+	};
+};
+
+/// Diagnostics submenu : MIDI load by type, drops, bursts and process() cost
+struct EngineStatsItem : MenuItem {
+	EngineStats *stats = NULL;
+	const MidiPortIn *ports = NULL;// their dropped counts are listed too
+	int numPorts = 0;
+	bool *showOnLcd = NULL;// NULL when the module has no LCD
+	Menu *createChildMenu() override;
+};
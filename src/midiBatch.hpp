@@ -0,0 +1,120 @@
+/*
+midiBatch.hpp : per-process MIDI batch with coalescing of superseded controller messages
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+using namespace rack;
+
+/** Holds the messages drained from the input queue during one process() call.
+coalesce() drops pitch bend, CC, channel and poly aftertouch messages that are
+overwritten by a later message of the same kind (channel, controller) before any
+note, pedal or system message, so only the last value of each run is handled.
+*/
+struct MidiBatch {
+	static const int MAX_MSGS = 512;
+	enum KeyOffsets {
+		PBEND_KEY = 0,				// 16 channels
+		CHAT_KEY = 16,				// 16 channels
+		CC_KEY = 32,				// 16 channels x 128 controllers
+		POLYAT_KEY = 32 + 2048,		// 16 channels x 128 notes
+		NUM_KEYS = 32 + 4096
+	};
+	enum KeyTypes {
+		BARRIER = -1,
+		LSB_PREFIX = -2
+	};
+	midi::Message msgs[MAX_MSGS];
+	int size = 0;
+	uint32_t coalescedCount = 0; //total messages dropped since reset
+
+	bool keep[MAX_MSGS];
+	uint32_t seen[NUM_KEYS] = {0};
+	uint32_t stamp = 0;
+
+	void clear() {
+		size = 0;
+	}
+	bool full() const {
+		return size >= MAX_MSGS;
+	}
+	void push(const midi::Message &msg) {
+		msgs[size++] = msg;
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	static int coalesceKey(const midi::Message &msg) {
+		uint8_t channel = msg.getChannel();
+		switch (msg.getStatus()) {
+			case 0xe: return PBEND_KEY + channel;
+			case 0xd: return CHAT_KEY + channel;
+			case 0xa: return POLYAT_KEY + channel * 128 + msg.getNote();
+			case 0xb: {
+				uint8_t cc = msg.getNote();
+				if (cc == 87) return LSB_PREFIX; // MPE+ low byte for the next cc74 / chAT on its channel
+				if ((cc >= 64 && cc <= 69) || (cc >= 120)) return BARRIER; // pedals and channel mode messages
+				return CC_KEY + channel * 128 + cc;
+			}
+			// notes, program change and system messages keep their order
+			default: return BARRIER;
+		}
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	static bool consumesLsb(const midi::Message &msg) {
+		return (msg.getStatus() == 0xd) || ((msg.getStatus() == 0xb) && (msg.getNote() == 74));
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	void nextStamp() {
+		if (++stamp == 0) {
+			std::fill(seen, seen + NUM_KEYS, 0);
+			stamp = 1;
+		}
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	/** Drops superseded messages in place, keeping the order of the remaining ones.
+	Returns the number of messages dropped.
+	*/
+	int coalesce() {
+		if (size < 2) return 0;
+		// walking backwards, the first message seen for a key is the last one sent
+		// lsbWanted: 1 = keep the next cc87 found, 0 = its consumer was dropped, 2 = already kept
+		uint8_t lsbWanted[16];
+		std::fill(lsbWanted, lsbWanted + 16, 1);
+		nextStamp();
+		for (int i = size - 1; i >= 0; i--) {
+			int key = coalesceKey(msgs[i]);
+			uint8_t channel = msgs[i].getChannel();
+			if (key == BARRIER) {
+				keep[i] = true;
+				nextStamp();
+			}else if (key == LSB_PREFIX) {
+				keep[i] = (lsbWanted[channel] == 1);
+				if (keep[i]) lsbWanted[channel] = 2;
+			}else {
+				keep[i] = (seen[key] != stamp);
+				seen[key] = stamp;
+				if (consumesLsb(msgs[i])) lsbWanted[channel] = keep[i] ? 1 : 0;
+			}
+		}
+		int kept = 0;
+		for (int i = 0; i < size; i++) {
+			if (keep[i]) msgs[kept++] = msgs[i];
+		}
+		int dropped = size - kept;
+		size = kept;
+		coalescedCount += dropped;
+		return dropped;
+	}
+};
@@ -0,0 +1,137 @@
+/*
+midiCapture.cpp : records a module's MIDI input to a Standard MIDI File
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "plugin.hpp"
+#include <osdialog.h>
+
+static const uint32_t CAPTURE_TEMPO = 10000;// us per quarter, ticks per quarter = sampleRate / 100
+
+MidiCapture::~MidiCapture() {
+	stop();
+}
+///////////////////////////////////////////////////////////////////////////////////////
+bool MidiCapture::start(const std::string &path, float sampleRate) {
+	stop();
+	FILE *file = std::fopen(path.c_str(), "wb");
+	if (!file) return false;
+	uint32_t division = static_cast<uint32_t>(sampleRate / 100.f + 0.5f);
+	if (division > 0x7fff) division = 0x7fff;
+	const uint8_t header[] = {'M', 'T', 'h', 'd', 0, 0, 0, 6,
+		0, 0,// format 0
+		0, 1,// one track
+		static_cast<uint8_t>(division >> 8), static_cast<uint8_t>(division & 0xff),
+		'M', 'T', 'r', 'k', 0, 0, 0, 0,// length patched on stop
+		0, 0xff, 0x51, 3,// tempo at tick 0
+		static_cast<uint8_t>(CAPTURE_TEMPO >> 16), static_cast<uint8_t>((CAPTURE_TEMPO >> 8) & 0xff), static_cast<uint8_t>(CAPTURE_TEMPO & 0xff)};
+	std::fwrite(header, 1, sizeof(header), file);
+	this->path = path;
+	stopRequested = false;
+	writtenCount.store(0, std::memory_order_relaxed);
+	ring.clear();// left over from the last stop, no writer is running
+	ring.droppedCount.store(0, std::memory_order_relaxed);
+	recording.store(true, std::memory_order_release);
+	writer = std::thread(&MidiCapture::run, this, file);
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiCapture::stop() {
+	if (!writer.joinable()) return;
+	recording.store(false, std::memory_order_release);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopRequested = true;
+	}
+	wake.notify_one();
+	writer.join();
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiCapture::writeVarLen(FILE *file, uint32_t value, uint32_t *trackLen) {
+	uint8_t bytes[5];
+	int n = 0;
+	bytes[n++] = value & 0x7f;
+	while (value >>= 7)
+		bytes[n++] = (value & 0x7f) | 0x80;
+	while (n > 0) {
+		std::fputc(bytes[--n], file);
+		(*trackLen) ++;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiCapture::run(FILE *file) {
+	uint32_t trackLen = 7;// the tempo event
+	int64_t lastFrame = -1;// the first event starts the file
+	bool done = false;
+	while (!done) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait_for(lock, std::chrono::milliseconds(20), [this]{return stopRequested;});
+			done = stopRequested;// drain once more after the engine stopped pushing
+		}
+		while (const Event *ev = ring.front()) {
+			if (lastFrame < 0) lastFrame = ev->frame;
+			int64_t delta = ev->frame - lastFrame;
+			lastFrame = ev->frame;
+			writeVarLen(file, static_cast<uint32_t>(std::min(delta, int64_t(0x0fffffff))), &trackLen);
+			const midi::Message &msg = ev->msg;
+			int size = std::min(static_cast<int>(msg.size), 3);
+			if (msg.getStatus() == 0xf) {// system messages go in as escapes, F7 <length> <bytes>
+				std::fputc(0xf7, file);
+				writeVarLen(file, size, &trackLen);
+				trackLen ++;
+			}
+			std::fwrite(msg.bytes, 1, size, file);
+			trackLen += size;
+			ring.pop();
+			writtenCount.store(writtenCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+	}
+	const uint8_t endOfTrack[] = {0, 0xff, 0x2f, 0};
+	std::fwrite(endOfTrack, 1, sizeof(endOfTrack), file);
+	trackLen += sizeof(endOfTrack);
+	const uint8_t len[] = {static_cast<uint8_t>(trackLen >> 24), static_cast<uint8_t>((trackLen >> 16) & 0xff), static_cast<uint8_t>((trackLen >> 8) & 0xff), static_cast<uint8_t>(trackLen & 0xff)};
+	std::fseek(file, 18, SEEK_SET);// MThd chunk (14) + "MTrk"
+	std::fwrite(len, 1, sizeof(len), file);
+	std::fclose(file);
+	uint32_t dropped = ring.droppedCount.load(std::memory_order_relaxed);
+	if (dropped > 0) WARN("MIDI capture %s: %u messages dropped", path.c_str(), dropped);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiCaptureItem::onAction(const event::Action &e) {
+	if (capture->writer.joinable()) {
+		capture->stop();
+		return;
+	}
+	osdialog_filters *filters = osdialog_filters_parse("Standard MIDI File:mid,midi");
+	char *path = osdialog_file(OSDIALOG_SAVE, NULL, "capture.mid", filters);
+	osdialog_filters_free(filters);
+	if (!path) return;
+	if (!capture->start(path, APP->engine->getSampleRate())) WARN("Could not create %s", path);
+	std::free(path);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiCaptureItem::step() {
+	if (capture->writer.joinable()) {
+		uint32_t dropped = capture->ring.droppedCount.load(std::memory_order_relaxed);
+		text = "Stop recording input";
+		rightText = dropped ? string::f("%u msgs, %u dropped", capture->writtenCount.load(std::memory_order_relaxed), dropped) : string::f("%u msgs", capture->writtenCount.load(std::memory_order_relaxed));
+	}else {
+		text = "Record input...";
+		rightText = "";
+	}
+	MenuItem::step();
+}
@@ -0,0 +1,77 @@
+/*
+midiCapture.hpp : records a module's MIDI input to a Standard MIDI File
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+using namespace rack;
+
+/** Engine thread copies each received message with its sample frame into a ring,
+a writer thread streams the ring to a format 0 .mid file. Nothing on the engine
+side waits, allocates or touches the disk; when the writer falls behind the ring
+drops messages and counts them.
+
+One tick is one sample: division is sampleRate / 100 ticks per quarter at a tempo
+of 10000 us per quarter, exact for every rate Rack offers. DAWs show it as 6000 BPM.
+*/
+struct MidiCapture {
+	struct Event {
+		int64_t frame;
+		midi::Message msg;
+	};
+	SpscRing<Event, 8192> ring;
+	std::atomic<bool> recording{false};
+	std::atomic<uint32_t> writtenCount{0};// events in the file so far
+	int64_t frame = 0;// engine thread, samples since the module was added
+
+	// UI thread
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopRequested = false;// guarded by mutex
+	std::string path;
+
+	~MidiCapture();
+	/** Engine thread : once per process() */
+	void step() {
+		frame ++;
+	}
+	/** Engine thread : every message the module acts on, before coalescing */
+	void capture(const midi::Message &msg) {
+		if (!recording.load(std::memory_order_relaxed)) return;
+		Event ev;
+		ev.frame = frame;
+		ev.msg = msg;
+		ring.push(ev);
+	}
+	/** UI thread. Returns false when the file can't be created */
+	bool start(const std::string &path, float sampleRate);
+	void stop();
+
+	void run(FILE *file);
+	static void writeVarLen(FILE *file, uint32_t value, uint32_t *trackLen);
+};
+
+/// "Record input..." / "Stop recording" for the context menu
+struct MidiCaptureItem : MenuItem {
+	MidiCapture *capture = NULL;
+	void onAction(const event::Action &e) override;
+	void step() override;
+};
@@ -0,0 +1,127 @@
+/*
+midiCatalog.cpp : plugin-wide MIDI driver/device catalog kept up to date by a watcher thread
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "plugin.hpp"
+#include <chrono>
+
+const MidiCatalog::Device *MidiCatalog::Driver::findDevice(int deviceId) const {
+	for (const Device &d : devices) {
+		if (d.id == deviceId) return &d;
+	}
+	return NULL;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+const MidiCatalog::Device *MidiCatalog::Driver::findDevice(const std::string &deviceName) const {
+	for (const Device &d : devices) {
+		if (d.name == deviceName) return &d;
+	}
+	return NULL;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+MidiCatalog::~MidiCatalog() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	wake.notify_all();
+	if (thread.joinable()) thread.join();
+}
+///////////////////////////////////////////////////////////////////////////////////////
+MidiCatalog *MidiCatalog::get() {
+	static MidiCatalog catalog;
+	return &catalog;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiCatalog::subscribe() {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (subscribers++ > 0) return;
+	std::thread stopped = std::move(thread);// a stopped watcher still finishing, it needs the mutex to exit
+	lock.unlock();
+	if (stopped.joinable()) stopped.join();
+	lock.lock();
+	if ((subscribers == 0) || running) return;// unsubscribed or restarted meanwhile
+	running = true;
+	thread = std::thread(&MidiCatalog::run, this);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiCatalog::unsubscribe() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--subscribers > 0) return;
+		running = false;
+	}
+	wake.notify_all();
+}
+///////////////////////////////////////////////////////////////////////////////////////
+std::shared_ptr<const MidiCatalog::Drivers> MidiCatalog::current() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!drivers) drivers = std::make_shared<const Drivers>();
+	return drivers;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+const MidiCatalog::Driver *MidiCatalog::findDriver(const Drivers &drivers, int driverId) {
+	for (const Driver &d : drivers) {
+		if (d.id == driverId) return &d;
+	}
+	return NULL;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+std::string MidiCatalog::driverName(const Drivers &drivers, int driverId) {
+	const Driver *driver = findDriver(drivers, driverId);
+	return driver ? driver->name : "";
+}
+///////////////////////////////////////////////////////////////////////////////////////
+std::string MidiCatalog::deviceName(const Drivers &drivers, int driverId, int deviceId) {
+	const Driver *driver = findDriver(drivers, driverId);
+	const Device *device = driver ? driver->findDevice(deviceId) : NULL;
+	return device ? device->name : "";
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiCatalog::run() {
+	midi::Input probe;// enumerates only, never opens a device
+	std::unique_lock<std::mutex> lock(mutex);
+	while (running) {
+		lock.unlock();
+		scan(&probe);
+		lock.lock();
+		wake.wait_for(lock, std::chrono::seconds(1), [this]{ return !running; });
+	}
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiCatalog::scan(midi::Input *probe) {
+	std::shared_ptr<Drivers> found = std::make_shared<Drivers>();
+	std::unique_lock<std::mutex> driverLock(driverMutex);
+	for (int driverId : probe->getDriverIds()) {
+		probe->setDriverId(driverId);
+		Driver driver;
+		driver.id = driverId;
+		driver.name = probe->getDriverName(driverId);
+		for (int deviceId : probe->getDeviceIds()) {
+			Device device;
+			device.id = deviceId;
+			device.name = probe->getDeviceName(deviceId);
+			driver.devices.push_back(device);
+		}
+		found->push_back(driver);
+	}
+	driverLock.unlock();
+	std::lock_guard<std::mutex> lock(mutex);
+	if (drivers && (*drivers == *found)) return;// nothing plugged or unplugged
+	drivers = found;
+	version ++;
+}
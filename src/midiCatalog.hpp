@@ -0,0 +1,73 @@
+/*
+midiCatalog.hpp : plugin-wide MIDI driver/device catalog kept up to date by a watcher thread
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+using namespace rack;
+
+/** Drivers and input devices as last seen by the watcher thread.
+Displays subscribe while they exist. The watcher enumerates about once a second
+and bumps version when anything was plugged or unplugged, so displays only look
+up names in the published copy and never enumerate on a UI frame.
+Drivers are not safe to call from two threads at once : the scan and every device
+open or close (MidiHub, on behalf of any MidiPortIn) hold driverMutex.
+*/
+struct MidiCatalog {
+	struct Device {
+		int id;
+		std::string name;
+		bool operator==(const Device &d) const {return (id == d.id) && (name == d.name);}
+	};
+	struct Driver {
+		int id;
+		std::string name;
+		std::vector<Device> devices;
+		bool operator==(const Driver &d) const {return (id == d.id) && (name == d.name) && (devices == d.devices);}
+		const Device *findDevice(int deviceId) const;
+		const Device *findDevice(const std::string &deviceName) const;
+	};
+	typedef std::vector<Driver> Drivers;
+
+	std::atomic<uint32_t> version{0};// 0 until the first scan is published
+	std::mutex mutex;
+	std::mutex driverMutex;// around every driver call, taken after MidiHub::mutex
+	std::condition_variable wake;
+	std::shared_ptr<const Drivers> drivers;// replaced whole on each change, guarded by mutex
+	std::thread thread;
+	int subscribers = 0;// guarded by mutex
+	bool running = false;
+
+	~MidiCatalog();
+	static MidiCatalog *get();
+	/** Starts the watcher with the first subscriber, stops it after the last one */
+	void subscribe();
+	void unsubscribe();
+	/** Latest published catalog (never NULL), cheap to call when version changed */
+	std::shared_ptr<const Drivers> current();
+	static const Driver *findDriver(const Drivers &drivers, int driverId);
+	/** Names for menus, "" when the driver or device isn't in the catalog */
+	static std::string driverName(const Drivers &drivers, int driverId);
+	static std::string deviceName(const Drivers &drivers, int driverId, int deviceId);
+
+	void run();
+	void scan(midi::Input *probe);
+};
@@ -19,17 +19,22 @@ along with this program.  If not, see <https:www.gnu.org/licenses/>.
 
 #include "plugin.hpp"
 MIDIdisplay::MIDIdisplay(){
-	font = APP->window->loadFont(mFONT_FILE);
+	font = pluginFont();
+	MidiCatalog::get()->subscribe();
+}
+///////////////////////////////////////////////////////////////////////////////////////
+MIDIdisplay::~MIDIdisplay(){
+	MidiCatalog::get()->unsubscribe();
 }
 ///////////////////////////////////////////////////////////////////////////////////////
 DispBttnL::DispBttnL(){
 	momentary = true;
-	addFrame(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXDispBttnL.svg")));
+	addFrame(pluginSvg("res/DLXDispBttnL.svg"));
 }
 ///////////////////////////////////////////////////////////////////////////////////////
 DispBttnR::DispBttnR(){
 	momentary = true;
-	addFrame(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXDispBttnR.svg")));
+	addFrame(pluginSvg("res/DLXDispBttnR.svg"));
 }
 ///////////////////////////////////////////////////////////////////////////////////////
 void DispBttnL::onButton(const event::Button &e) {
@@ -51,55 +56,41 @@ void DispBttnR::onButton(const event::Button &e) {
 }
 ///////////////////////////////////////////////////////////////////////////////////////
 void MIDIdisplay::updateMidiSettings (int dRow, bool valup){
+	if (!catalog || catalog->empty()) return;// first scan not in yet
 	switch (dRow) {
 		case 0: {
-			bool resetdr = true;
-			int drIx = 0;
-			int midiDrivers = static_cast<int>(midiInput->getDriverIds().size());
-			for (int driverId : midiInput->getDriverIds()) {
-				if (driverId == midiInput->driverId){
-					if (valup){
-						if (drIx < midiDrivers - 1) midiInput->setDriverId(midiInput->getDriverIds().at(drIx + 1));
-						else midiInput->setDriverId(midiInput->getDriverIds().front());
-					}else {//val down
-						if (drIx > 0) midiInput->setDriverId(midiInput->getDriverIds().at(drIx - 1));
-						else midiInput->setDriverId(midiInput->getDriverIds().back());
-					}
-					resetdr = false;
-					break;
-				}
-				drIx ++;
+			const MidiCatalog::Drivers &drivers = *catalog;
+			int midiDrivers = static_cast<int>(drivers.size());
+			int drIx = -1;
+			for (int i = 0; i < midiDrivers; i++) {
+				if (drivers[i].id == midiInput->driverId) drIx = i;
 			}
-			if (resetdr) midiInput->setDriverId(midiInput->getDriverIds().front());
-			if (midiInput->getDeviceIds().size() > 0){
-				midiInput->setDeviceId(0);
+			if (drIx < 0) drIx = 0;//resetdr
+			else if (valup) drIx = (drIx < midiDrivers - 1) ? drIx + 1 : 0;
+			else drIx = (drIx > 0) ? drIx - 1 : midiDrivers - 1;//val down
+			const MidiCatalog::Driver &driver = drivers[drIx];
+			midiInput->setDriverId(driver.id);
+			if (driver.devices.size() > 0){
+				midiInput->setDeviceId(driver.devices.front().id);
 				*mdriverJ = midiInput->driverId;//valid for saving
-				*mdeviceJ = midiInput->getDeviceName(0);
+				*mdeviceJ = driver.devices.front().name;
 			}else midiInput->setDeviceId(-1);
 			mchannelMem = -1;
 			*mchannelJ = -1;
 		} break;
 		case 1: {
-			int deIx = 0;
-			bool devhere = false;
-			int midiDevs = static_cast<int>(midiInput->getDeviceIds().size());
+			const MidiCatalog::Driver *driver = MidiCatalog::findDriver(*catalog, midiInput->driverId);
+			int midiDevs = driver ? static_cast<int>(driver->devices.size()) : 0;
 			if (midiDevs > 0){
-				for (int deviceId : midiInput->getDeviceIds()) {
-					if (deviceId == midiInput->deviceId){
-						if (valup){
-							if (deIx < midiDevs - 1) midiInput->setDeviceId(midiInput->getDeviceIds().at(deIx + 1));
-							else midiInput->setDeviceId(midiInput->getDeviceIds().front());
-						}else {//val down
-							if (deIx > 0) midiInput->setDeviceId(midiInput->getDeviceIds().at(deIx - 1));
-							else midiInput->setDeviceId(midiInput->getDeviceIds().back());
-						}
-						devhere = true;
-						break;
-					}
-					deIx ++;
+				int deIx = -1;
+				for (int i = 0; i < midiDevs; i++) {
+					if (driver->devices[i].id == midiInput->deviceId) deIx = i;
 				}
-				if (!devhere) midiInput->setDeviceId(midiInput->getDeviceIds().front());
-				*mdeviceJ = midiInput->getDeviceName(midiInput->deviceId);//valid for saving
+				if (deIx < 0) deIx = 0;//device gone
+				else if (valup) deIx = (deIx < midiDevs - 1) ? deIx + 1 : 0;
+				else deIx = (deIx > 0) ? deIx - 1 : midiDevs - 1;//val down
+				midiInput->setDeviceId(driver->devices[deIx].id);
+				*mdeviceJ = driver->devices[deIx].name;//valid for saving
 				mchannelMem = -1;
 				*mchannelJ = -1;
 			}
@@ -107,11 +98,15 @@ void MIDIdisplay::updateMidiSettings (int dRow, bool valup){
 		case 2:{
 			if (i_mpeMode){
 				if (valup){
-					if (*mpeChn < 15 ) *mpeChn = *mpeChn + 1;
-					else *mpeChn = 0;
+					if (i_mpeChn < 15 ) i_mpeChn ++;
+					else i_mpeChn = 0;
 				}else{
-					if (*mpeChn > 0 ) *mpeChn = *mpeChn - 1;
-					else *mpeChn = 15;
+					if (i_mpeChn > 0 ) i_mpeChn --;
+					else i_mpeChn = 15;
+				}
+				if (setMpeChn) {
+					setMpeChn(i_mpeChn);
+					mpeChnPosted = i_mpeChn;
 				}
 			}else{
 				if (!showchannel) return;
@@ -128,16 +123,18 @@ void MIDIdisplay::updateMidiSettings (int dRow, bool valup){
 		} break;
 	}
 	searchdev = false;
-	*midiActiv = 64;
+	flashActiv = 64;
 	reDisplay();
 	return;
 }
 ///////////////////////////////////////////////////////////////////////////////////////
 void MIDIdisplay::reDisplay(){
-	mdriver = midiInput->getDriverName(midiInput->driverId);// driver name
+	const MidiCatalog::Driver *driver = catalog ? MidiCatalog::findDriver(*catalog, midiInput->driverId) : NULL;
+	const MidiCatalog::Device *device = driver ? driver->findDevice(midiInput->deviceId) : NULL;
+	mdriver = driver ? driver->name : "";// driver name
 	if (midiInput->deviceId > -1){
 		textColor = nvgRGB(0xbb,0xbb,0xbb);
-		mdevice = midiInput->getDeviceName(midiInput->deviceId);// device
+		mdevice = device ? device->name : "";// device
 		showchannel = (mdriver != "Computer keyboard");
 		if (i_mpeMode) { //channel MPE
 			mchannel = "mpe master " + std::to_string(i_mpeChn + 1);
@@ -158,7 +155,51 @@ void MIDIdisplay::reDisplay(){
 		mdevice = "(no device)";
 		mchannel = "";
 	}
-	drawframe = 0;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MIDIdisplay::step(){
+	uint32_t version = MidiCatalog::get()->version.load(std::memory_order_acquire);
+	if (midiInput && (version != catalogVersion)){// hot-plug : devices came or went
+		catalogVersion = version;
+		catalog = MidiCatalog::get()->current();
+		watchDevice();
+	}
+	OpaqueWidget::step();
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MIDIdisplay::watchDevice(){
+	const MidiCatalog::Driver *driver = MidiCatalog::findDriver(*catalog, midiInput->driverId);
+	const MidiCatalog::Device *device = driver ? driver->findDevice(midiInput->deviceId) : NULL;
+	if (isdevice && (!device || (device->name != *mdeviceJ))) searchdev = true;
+	if (!searchdev) return;
+	showchannel = false;
+	if (*mdeviceJ != ""){/// if previously saved, reconnect when it is back
+		textColor = nvgRGB(0xFF,0x64,0x64);
+		midiInput->setDriverId(*mdriverJ);
+		mdevice = *mdeviceJ;
+		mchannel = "...disconnected...";
+		driver = MidiCatalog::findDriver(*catalog, *mdriverJ);
+		device = driver ? driver->findDevice(*mdeviceJ) : NULL;
+		if (device) {
+			midiInput->setDeviceId(device->id);
+			mchannelMem = *mchannelJ;
+			searchdev = false;
+			isdevice = true;
+			showchannel = true;
+			reDisplay();
+		}
+	}else if (catalog->size() > 0){ //initial searchdev / (no saved devices)
+		driver = &catalog->front();
+		midiInput->setDriverId(driver->id);
+		if (driver->devices.size() > 0){
+			midiInput->setDeviceId(driver->devices.front().id);
+			*mdriverJ = midiInput->driverId;//valid for saving
+			*mdeviceJ = driver->devices.front().name;
+		}else midiInput->setDeviceId(-1);
+		*mchannelJ = -1;
+		mchannelMem = -1;
+		reDisplay();
+	}
 }
 ///////////////////////////////////////////////////////////////////////////////////////
 void MIDIdisplay::draw(const DrawArgs &args){
@@ -167,50 +208,18 @@ void MIDIdisplay::draw(const DrawArgs &args){
 			i_mpeMode = *mpeMode;
 			reDisplay();
 		}
-		if ((i_mpeChn != *mpeChn) && (i_mpeMode)){
+		if (mpeChnPosted == *mpeChn) mpeChnPosted = -1;//the engine has it
+		if ((mpeChnPosted < 0) && (i_mpeChn != *mpeChn) && (i_mpeMode)){
 			i_mpeChn = *mpeChn;
 			mchannel = "mpe master " + std::to_string(i_mpeChn + 1);
 		}
-		if (drawframe++ > 50){
-			drawframe = 0;
-			if (isdevice && (midiInput->getDeviceName(midiInput->deviceId) != *mdeviceJ)) searchdev = true;
-			if (searchdev) {
-				showchannel = false;
-				if (*mdeviceJ != ""){/// if previously saved
-					textColor = nvgRGB(0xFF,0x64,0x64);
-					midiInput->setDriverId(*mdriverJ);
-					mdevice = *mdeviceJ;
-					mchannel = "...disconnected...";
-					for (int deviceId : midiInput->getDeviceIds()) {
-						if (midiInput->getDeviceName(deviceId) == *mdeviceJ) {
-							midiInput->setDeviceId(deviceId);
-							mchannelMem = *mchannelJ;
-							searchdev = false;
-							isdevice = true;
-							showchannel = true;
-							reDisplay();
-							break;
-						}
-					}
-				}else{ //initial searchdev / (no saved devices)
-					midiInput->setDriverId(midiInput->getDriverIds().front());
-					if (midiInput->getDeviceIds().size() > 0){
-						midiInput->setDeviceId(midiInput->getDeviceIds().front());
-						*mdriverJ = midiInput->driverId;//valid for saving
-						*mdeviceJ = midiInput->getDeviceName(midiInput->deviceId);
-					}else midiInput->setDeviceId(-1);
-					*mchannelJ = -1;
-					mchannelMem = -1;
-					reDisplay();
-				}
-			}
-		}
-		if (*midiActiv > 3) *midiActiv -= 4;
-		else *midiActiv = 0;//clip to 0
+		if (flashActiv > 3) flashActiv -= 4;
+		else flashActiv = 0;//clip to 0
+		int activ = std::max(*midiActiv, flashActiv);
 		//nvgGlobalCompositeBlendFunc(args.vg,  NVG_ONE , NVG_ONE);
 		nvgBeginPath(args.vg);
 		nvgRoundedRect(args.vg, 0.f, 0.f, box.size.x, box.size.y, 4.f);
-		nvgFillColor(args.vg, nvgRGB(static_cast<unsigned char>(*midiActiv * .5),static_cast<unsigned char>(*midiActiv * .5) ,0));
+		nvgFillColor(args.vg, nvgRGB(static_cast<unsigned char>(activ * .5),static_cast<unsigned char>(activ * .5) ,0));
 		nvgFill(args.vg);
 		nvgFontSize(args.vg, mdfontSize);
 		nvgFontFaceId(args.vg, font->handle);
@@ -219,22 +228,22 @@ void MIDIdisplay::draw(const DrawArgs &args){
 		nvgFillColor(args.vg, textColor);
 		nvgText(args.vg, xcenter, 10.25f, mdriver.c_str(), NULL);
 		nvgText(args.vg, xcenter, 23.25f, mdevice.c_str(), NULL);
-		nvgText(args.vg, xcenter, 36.25f, mchannel.c_str(), NULL);
+		nvgText(args.vg, xcenter, 36.25f, (diagLine && diagLine[0]) ? diagLine : mchannel.c_str(), NULL);
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////////////
 void MIDIdisplay::onButton(const event::Button &e) {
 	e.stopPropagating();
 	if ((e.button == GLFW_MOUSE_BUTTON_LEFT) && (e.action == GLFW_PRESS)){
-		*resetMidi = true;
+		if (resetMidi) resetMidi();
 		if (!e.isConsumed()) e.consume(this);
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////////////
-void MIDIscreen::setMidiPort(midi::Port *port,bool *mpeMode,int *mpeChn,int *midiActiv, int *mdriver, std::string *mdevice, int *mchannel, bool *resetMidi){
+void MIDIscreen::setMidiPort(midi::Port *port,const bool *mpeMode,const int *mpeChn,const int *midiActiv, int *mdriver, std::string *mdevice, int *mchannel, std::function<void()> resetMidi){
 	clearChildren();
 
-	MIDIdisplay *md = createWidget<MIDIdisplay>(Vec(0.f,0.f));
+	md = createWidget<MIDIdisplay>(Vec(0.f,0.f));
 	md->midiInput = port;
 	md->mpeMode = mpeMode;
 	md->mpeChn = mpeChn;
@@ -279,3 +288,161 @@ void MIDIscreen::setMidiPort(midi::Port *port,bool *mpeMode,int *mpeChn,int *mid
 ///////////////////////////////////////////////////////////////////////////////////////
 MIDIscreen::MIDIscreen(){
 }
+///////////////////////////////////////////////////////////////////////////////////////
+struct MidiDriverValueItem : MenuItem {
+	midi::Port *port;
+	int driverId;
+	void onAction(const event::Action &e) override {
+		port->setDriverId(driverId);
+	}
+};
+struct MidiDeviceValueItem : MenuItem {
+	midi::Port *port;
+	int deviceId;
+	void onAction(const event::Action &e) override {
+		port->setDeviceId(deviceId);
+	}
+};
+struct MidiChannelValueItem : MenuItem {
+	midi::Port *port;
+	int channel;
+	void onAction(const event::Action &e) override {
+		port->channel = channel;
+	}
+};
+struct MidiRemapValueItem : MenuItem {
+	std::function<void(int)> setRemapChannel;
+	int remapChannel;
+	void onAction(const event::Action &e) override {
+		setRemapChannel(remapChannel);
+	}
+};
+struct MidiTrnspValueItem : MenuItem {
+	std::function<void(int)> setTranspose;
+	int transpose;
+	void onAction(const event::Action &e) override {
+		setTranspose(transpose);
+	}
+};
+///////////////////////////////////////////////////////////////////////////////////////
+// driver and device lists come from the catalog, the menus never enumerate a driver
+struct MidiDriverItem : MenuItem {
+	midi::Port *port;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu;
+		std::shared_ptr<const MidiCatalog::Drivers> catalog = MidiCatalog::get()->current();
+		for (const MidiCatalog::Driver &driver : *catalog) {
+			MidiDriverValueItem *item = createMenuItem<MidiDriverValueItem>(driver.name, CHECKMARK(port->driverId == driver.id));
+			item->port = port;
+			item->driverId = driver.id;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+struct MidiDeviceItem : MenuItem {
+	midi::Port *port;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu;
+		MidiDeviceValueItem *noItem = createMenuItem<MidiDeviceValueItem>("(no device)", CHECKMARK(port->deviceId < 0));
+		noItem->port = port;
+		noItem->deviceId = -1;
+		menu->addChild(noItem);
+		std::shared_ptr<const MidiCatalog::Drivers> catalog = MidiCatalog::get()->current();
+		const MidiCatalog::Driver *driver = MidiCatalog::findDriver(*catalog, port->driverId);
+		if (!driver) return menu;
+		for (const MidiCatalog::Device &device : driver->devices) {
+			MidiDeviceValueItem *item = createMenuItem<MidiDeviceValueItem>(device.name, CHECKMARK(port->deviceId == device.id));
+			item->port = port;
+			item->deviceId = device.id;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+struct MidiChannelItem : MenuItem {
+	midi::Port *port;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu;
+		for (int channel = -1; channel < 16; channel++) {
+			MidiChannelValueItem *item = createMenuItem<MidiChannelValueItem>((channel < 0) ? "ALLch" : string::f("ch %d", channel + 1), CHECKMARK(port->channel == channel));
+			item->port = port;
+			item->channel = channel;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+struct MidiRemapItem : MenuItem {
+	MidiPortIn *port;
+	std::function<void(int)> setRemapChannel;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu;
+		for (int channel = -1; channel < 16; channel++) {
+			MidiRemapValueItem *item = createMenuItem<MidiRemapValueItem>((channel < 0) ? "Keep" : string::f("ch %d", channel + 1), CHECKMARK(port->remapChannel == channel));
+			item->setRemapChannel = setRemapChannel;
+			item->remapChannel = channel;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+struct MidiTrnspItem : MenuItem {
+	MidiPortIn *port;
+	std::function<void(int)> setTranspose;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu;
+		for (int t = -24; t <= 24; t++) {
+			MidiTrnspValueItem *item = createMenuItem<MidiTrnspValueItem>(string::f("%+d", t), CHECKMARK(port->transpose == t));
+			item->setTranspose = setTranspose;
+			item->transpose = t;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+///////////////////////////////////////////////////////////////////////////////////////
+Menu *MidiPortInItem::createChildMenu() {
+	Menu *menu = new Menu;
+	if (showDevice) {
+		std::shared_ptr<const MidiCatalog::Drivers> catalog = MidiCatalog::get()->current();
+		MidiDriverItem *driverItem = createMenuItem<MidiDriverItem>("Driver", MidiCatalog::driverName(*catalog, port->driverId) + " " + RIGHT_ARROW);
+		driverItem->port = port;
+		menu->addChild(driverItem);
+		MidiDeviceItem *deviceItem = createMenuItem<MidiDeviceItem>("Device", ((port->deviceId < 0) ? std::string("(no device)") : MidiCatalog::deviceName(*catalog, port->driverId, port->deviceId)) + " " + RIGHT_ARROW);
+		deviceItem->port = port;
+		menu->addChild(deviceItem);
+		MidiChannelItem *channelItem = createMenuItem<MidiChannelItem>("Channel", ((port->channel < 0) ? std::string("ALLch") : string::f("ch %d", port->channel + 1)) + " " + RIGHT_ARROW);
+		channelItem->port = port;
+		menu->addChild(channelItem);
+	}
+	MidiRemapItem *remapItem = createMenuItem<MidiRemapItem>("Remap to channel", ((port->remapChannel < 0) ? std::string("Keep") : string::f("ch %d", port->remapChannel + 1)) + " " + RIGHT_ARROW);
+	remapItem->port = port;
+	remapItem->setRemapChannel = setRemapChannel;
+	menu->addChild(remapItem);
+	MidiTrnspItem *trnspItem = createMenuItem<MidiTrnspItem>("Transpose", string::f("%+d", port->transpose.load()) + " " + RIGHT_ARROW);
+	trnspItem->port = port;
+	trnspItem->setTranspose = setTranspose;
+	menu->addChild(trnspItem);
+	menu->addChild(new MenuSeparator());
+	menu->addChild(createMenuLabel(string::f("Dropped messages: %u", port->droppedCount.load(std::memory_order_relaxed))));
+	return menu;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+struct MidiHubCapacityValueItem : MenuItem {
+	uint64_t capacity;
+	void onAction(const event::Action &e) override {
+		MidiHub::get()->setCapacity(capacity);
+	}
+};
+Menu *MidiHubCapacityItem::createChildMenu() {
+	Menu *menu = new Menu;
+	menu->addChild(createMenuLabel("Applies when a device is next opened"));
+	uint64_t current = MidiHub::get()->getCapacity();
+	for (uint64_t c = MidiHubDevice::MIN_CAPACITY; c <= MidiHubDevice::MAX_CAPACITY; c *= 4) {
+		MidiHubCapacityValueItem *item = createMenuItem<MidiHubCapacityValueItem>(string::f("%llu events", static_cast<unsigned long long>(c)), CHECKMARK(current == c));
+		item->capacity = c;
+		menu->addChild(item);
+	}
+	return menu;
+}
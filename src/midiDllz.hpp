@@ -20,20 +20,24 @@ using namespace rack;
 
 struct MIDIdisplay : OpaqueWidget {
 	MIDIdisplay();
+	~MIDIdisplay();
 	midi::Port *midiInput = NULL;
 	int i_mpeChn = 0;
-	int *mpeChn = &i_mpeChn;
-	bool *mpeMode = NULL;
+	const int *mpeChn = &i_mpeChn;// published by the engine
+	int mpeChnPosted = -1;// last edit given to setMpeChn, shown until the engine publishes it
+	std::function<void(int)> setMpeChn;// posted to the engine, otherwise the edit stays local
+	const bool *mpeMode = NULL;
 	bool i_mpeMode = false;
 	int initpointer0 = 0;
-	int *midiActiv = &initpointer0;
+	const int *midiActiv = &initpointer0;// decayed by the engine
+	int flashActiv = 0;// local flash on settings change
 
 	int initpointer_1 = -1;
 	int *mdriverJ = &initpointer_1;
 	int *mchannelJ = &initpointer_1;
 	int mchannelMem = -1;
 
-	bool *resetMidi = NULL;
+	std::function<void()> resetMidi;// posted to the engine, clicking the display resets its voices
 	bool showchannel = true;
 	bool isdevice = false;
 	bool searchdev = false;
@@ -41,16 +45,21 @@ struct MIDIdisplay : OpaqueWidget {
 	std::string mdriver = "initalizing";
 	std::string mdevice = "";
 	std::string mchannel = "";
+	const char *diagLine = NULL;// shown instead of the channel when not empty
 
 	int cursorId = 0;
 	float mdfontSize = 11.f;	
 	float xcenter = 0.f;
-	int drawframe = 0;
+	std::shared_ptr<const MidiCatalog::Drivers> catalog;// shared copy from the watcher thread
+	uint32_t catalogVersion = 0;
 	std::shared_ptr<Font> font;
 	NVGcolor textColor = nvgRGB(0x88,0x88,0x64);
 
 	void updateMidiSettings(int dRow, bool valup);
 	void reDisplay();
+	/** Checks the port's device against a new catalog, reconnects the saved one when it comes back */
+	void watchDevice();
+	void step() override;
 	void draw(const DrawArgs &args) override;
 	void onButton(const event::Button &e) override;
 };
@@ -81,5 +90,20 @@ struct MIDIscreen : OpaqueWidget{
 	DispBttnR *devR;
 	DispBttnR *chnR;
 	MIDIdisplay *md;
-	void setMidiPort(midi::Port *port,bool *mpeMode,int *mpeChn,int *midiActiv, int *mdriver, std::string *mdevice, int *mchannel, bool *resetMidi);
+	void setMidiPort(midi::Port *port,const bool *mpeMode,const int *mpeChn,const int *midiActiv, int *mdriver, std::string *mdevice, int *mchannel, std::function<void()> resetMidi);
+};
+
+/// Context menu for a MidiPortIn : driver, device, channel filter, channel remap and transpose
+struct MidiPortInItem : MenuItem {
+	MidiPortIn *port = NULL;
+	bool showDevice = true;// false for the port already selected on the MIDI LCD
+	// remap and transpose go to the engine through the module, which owns the port
+	std::function<void(int)> setRemapChannel;
+	std::function<void(int)> setTranspose;
+	Menu *createChildMenu() override;
+};
+
+/// Hub ring size, for devices opened afterwards
+struct MidiHubCapacityItem : MenuItem {
+	Menu *createChildMenu() override;
 };
@@ -0,0 +1,122 @@
+/*
+midiHub.cpp : plugin-wide MIDI hub, each device stream is received once for all modules
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "plugin.hpp"
+#include <chrono>
+
+MidiHubDevice::MidiHubDevice(uint64_t capacity) : capacity(roundCapacity(capacity)) {
+	slots = new Slot[this->capacity];
+}
+///////////////////////////////////////////////////////////////////////////////////////
+uint64_t MidiHubDevice::roundCapacity(uint64_t capacity) {
+	return (capacity < 2) ? 2 : (uint64_t(1) << (64 - __builtin_clzll(capacity - 1)));
+}
+///////////////////////////////////////////////////////////////////////////////////////
+MidiHubDevice::~MidiHubDevice() {
+	delete[] slots;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiHubDevice::onMessage(midi::Message message) {
+	int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	uint32_t packed = message.bytes[0] | (message.bytes[1] << 8) | (message.bytes[2] << 16) | (static_cast<uint32_t>(message.size) << 24);
+	uint64_t pos = writePos.load(std::memory_order_relaxed);
+	Slot &slot = slots[pos & (capacity - 1)];
+	slot.seq.store(2 * pos + 1, std::memory_order_relaxed);// odd = being written
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.stamp.store(now, std::memory_order_relaxed);
+	slot.bytes.store(packed, std::memory_order_relaxed);
+	slot.seq.store(2 * pos + 2, std::memory_order_release);
+	writePos.store(pos + 1, std::memory_order_release);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+bool MidiHubDevice::read(uint64_t pos, MidiEvent *ev) const {
+	const Slot &slot = slots[pos & (capacity - 1)];
+	uint64_t seq = slot.seq.load(std::memory_order_acquire);
+	if (seq != 2 * pos + 2) return false;
+	int64_t stamp = slot.stamp.load(std::memory_order_relaxed);
+	uint32_t packed = slot.bytes.load(std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot.seq.load(std::memory_order_relaxed) != seq) return false;
+	ev->stamp = stamp;
+	ev->msg.bytes[0] = packed & 0xff;
+	ev->msg.bytes[1] = (packed >> 8) & 0xff;
+	ev->msg.bytes[2] = (packed >> 16) & 0xff;
+	ev->msg.size = packed >> 24;
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+MidiHub::~MidiHub() {
+	// every port has released its device by now, so none is subscribed to a driver
+	for (auto &d : devices)
+		delete d.second;
+	for (MidiHubDevice *device : retired)
+		delete device;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+MidiHub *MidiHub::get() {
+	static MidiHub hub;
+	return &hub;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+MidiHubDevice *MidiHub::acquire(int driverId, int deviceId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	MidiHubDevice *&device = devices[std::make_pair(driverId, deviceId)];
+	if (device && (device->refs == 0) && (device->capacity != MidiHubDevice::roundCapacity(capacity))) {
+		retired.push_back(device);// an engine thread may still be reading its last events
+		device = NULL;
+	}
+	if (!device) device = new MidiHubDevice(capacity);
+	if (device->refs++ == 0) {// first subscriber opens the device
+		std::lock_guard<std::mutex> driverLock(MidiCatalog::get()->driverMutex);// not while the watcher scans
+		device->setDriverId(driverId);
+		device->setDeviceId(deviceId);
+	}
+	return device;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiHub::setCapacity(uint64_t capacity) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (capacity < MidiHubDevice::MIN_CAPACITY) capacity = MidiHubDevice::MIN_CAPACITY;
+	else if (capacity > MidiHubDevice::MAX_CAPACITY) capacity = MidiHubDevice::MAX_CAPACITY;
+	this->capacity = capacity;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+uint64_t MidiHub::getCapacity() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return capacity;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiHub::release(MidiHubDevice *device) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (--device->refs == 0) {// last subscriber closes it
+		std::lock_guard<std::mutex> driverLock(MidiCatalog::get()->driverMutex);
+		device->setDeviceId(-1);
+	}
+}
+///////////////////////////////////////////////////////////////////////////////////////
+MidiPortIn::~MidiPortIn() {
+	setDeviceId(-1);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void MidiPortIn::setDeviceId(int deviceId) {
+	MidiHubDevice *old = hubDevice.load(std::memory_order_relaxed);
+	MidiHubDevice *device = ((driverId > -1) && (deviceId > -1)) ? MidiHub::get()->acquire(driverId, deviceId) : NULL;
+	hubDevice.store(device, std::memory_order_release);
+	if (old) MidiHub::get()->release(old);
+	this->deviceId = device ? deviceId : -1;
+}
@@ -0,0 +1,214 @@
+/*
+midiHub.hpp : plugin-wide MIDI hub, each device stream is received once for all modules
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+using namespace rack;
+
+/** One received message, stamped on arrival */
+struct MidiEvent {
+	int64_t stamp = 0;// steady clock ns
+	midi::Message msg;
+};
+
+/** One open driver device shared by every port listening to it.
+The driver callback stamps each message once and writes it to a broadcast ring,
+subscribers read it with their own cursor (see MidiPortIn). Slots are seqlocked,
+so a reader lapped by the writer detects it instead of reading a torn event.
+*/
+struct MidiHubDevice : midi::Input {
+	static const uint64_t DEFAULT_CAPACITY = 1024;
+	static const uint64_t MIN_CAPACITY = 256;
+	static const uint64_t MAX_CAPACITY = 1 << 16;
+	struct Slot {
+		std::atomic<uint64_t> seq{0};// 2 * pos + 2 once event pos is complete
+		std::atomic<int64_t> stamp{0};
+		std::atomic<uint32_t> bytes{0};
+	};
+	const uint64_t capacity;// power of two, fixed for the device's lifetime
+	Slot *slots;
+	std::atomic<uint64_t> writePos{0};
+	int refs = 0;// guarded by MidiHub::mutex
+
+	/** capacity is rounded up to a power of two */
+	MidiHubDevice(uint64_t capacity = DEFAULT_CAPACITY);
+	static uint64_t roundCapacity(uint64_t capacity);
+	~MidiHubDevice();
+	void onMessage(midi::Message message) override;
+	/** Reads event pos. Returns false if it was overwritten (or not yet written) */
+	bool read(uint64_t pos, MidiEvent *ev) const;
+};
+
+/** Keeps one MidiHubDevice per driver/device. Devices stay allocated for reuse
+once they have no subscribers (only unsubscribed from the driver), so readers on
+the engine thread never see one freed under them.
+*/
+struct MidiHub {
+	std::mutex mutex;
+	std::map<std::pair<int, int>, MidiHubDevice*> devices;
+	uint64_t capacity = MidiHubDevice::DEFAULT_CAPACITY;// ring size for devices opened from now on, guarded by mutex
+	std::vector<MidiHubDevice*> retired;// closed devices replaced for a new capacity, freed with the hub
+
+	~MidiHub();
+	static MidiHub *get();
+	/** Ring size in events, saved with SuperMIDI64. A device gets it when it is next opened
+	by its first subscriber, devices already open keep theirs */
+	void setCapacity(uint64_t capacity);
+	uint64_t getCapacity();
+	MidiHubDevice *acquire(int driverId, int deviceId);
+	void release(MidiHubDevice *device);
+};
+
+/** midi::Input that subscribes to the hub instead of the driver.
+Driver/device/channel selection works as with any midi::Port, the engine thread
+reads the shared stream through front()/pop() without locking. Carries its own
+channel / transpose remapping so several ports can feed one voice allocator.
+*/
+struct MidiPortIn : midi::Input {
+	std::atomic<MidiHubDevice*> hubDevice{NULL};// written by the UI, read by the engine
+	std::atomic<int> remapChannel{-1};// -1 keep, 0 ~ 15 force. Written by the engine (module UI commands), menus read it
+	std::atomic<int> transpose{0};// semitones
+
+	// engine thread only
+	MidiHubDevice *readDevice = NULL;
+	uint64_t readPos = 0;
+	MidiEvent pending;
+	bool hasPending = false;
+	/** Where a sounding note went at its note on, by source channel and note : its note off
+	and poly aftertouch follow it even if the remap or transpose changed meanwhile */
+	struct HeldMap {
+		int8_t channel = -1;// -1 : not sounding
+		int8_t note = 0;
+	};
+	HeldMap held[16][128];
+	std::atomic<uint32_t> droppedCount{0};// events overwritten before this port read them, written by the engine
+
+	~MidiPortIn();
+	void setDeviceId(int deviceId) override;
+///////////////////////////////////////////////////////////////////////////////////////
+	/** Next event for this port's channel, NULL when none is pending */
+	const MidiEvent *front() {
+		if (hasPending) return &pending;
+		MidiHubDevice *dev = hubDevice.load(std::memory_order_acquire);
+		if (dev != readDevice) {// device changed, start from its current position
+			readDevice = dev;
+			readPos = dev ? dev->writePos.load(std::memory_order_acquire) : 0;
+		}
+		if (!dev) return NULL;
+		while (true) {
+			uint64_t w = dev->writePos.load(std::memory_order_acquire);
+			if (readPos == w) return NULL;
+			if (w - readPos > dev->capacity) {// lapped, skip to the oldest event still in the ring
+				drop(w - dev->capacity - readPos);
+				readPos = w - dev->capacity;
+			}
+			bool valid = dev->read(readPos++, &pending);
+			if (!valid) {// overwritten while reading
+				drop(1);
+				continue;
+			}
+			uint8_t status = pending.msg.getStatus();
+			if ((channel > -1) && (status != 0xf) && (pending.msg.getChannel() != channel)) continue;
+			hasPending = true;
+			return &pending;
+		}
+	}
+	void pop() {
+		hasPending = false;
+	}
+	/** Cheap check for the engine thread: nothing received since the last read.
+	Ignores the channel filter, so front() may still return NULL when false.
+	*/
+	bool empty() const {
+		if (hasPending) return false;
+		MidiHubDevice *dev = hubDevice.load(std::memory_order_relaxed);
+		if (dev != readDevice) return (dev == NULL);
+		return (!dev) || (readPos == dev->writePos.load(std::memory_order_relaxed));
+	}
+	void drop(uint64_t n) {
+		droppedCount.store(droppedCount.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+	bool shift(midi::Message *msg) {
+		while (const MidiEvent *ev = front()) {
+			*msg = ev->msg;
+			pop();
+			if (remap(msg)) return true;
+		}
+		return false;
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	/** Applies the port remapping. Returns false if the message falls out of range */
+	bool remap(midi::Message *msg) {
+		uint8_t status = msg->getStatus();
+		if ((status < 0x8) || (status > 0xe)) return true;// system messages pass as they are
+		int toChannel = remapChannel.load(std::memory_order_relaxed);
+		if (status >= 0xb) {// CC, program, channel aftertouch, bend : the current remap
+			if (toChannel > -1) msg->setChannel(toChannel);
+			return true;
+		}
+		HeldMap &h = held[msg->getChannel()][msg->getNote()];
+		bool noteOn = (status == 0x9) && (msg->getValue() > 0);
+		int channel = h.channel;
+		int note = h.note;
+		if (noteOn || (h.channel < 0)) {
+			channel = (toChannel > -1) ? toChannel : msg->getChannel();
+			note = msg->getNote() + transpose.load(std::memory_order_relaxed);
+		}
+		bool inRange = (note >= 0) && (note <= 127);
+		if (noteOn) {
+			h.channel = inRange ? channel : -1;
+			h.note = note;
+		}
+		else if (status != 0xa) h.channel = -1;// note off
+		if (!inRange) return false;
+		msg->setChannel(channel);
+		msg->setNote(note);
+		return true;
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	/** True when none of several ports has anything pending, see empty() */
+	static bool allEmpty(const MidiPortIn *ports, int numPorts) {
+		for (int p = 0; p < numPorts; p++) {
+			if (!ports[p].empty()) return false;
+		}
+		return true;
+	}
+	/** Shifts the oldest pending message across several ports, remapped by its port.
+	Returns false when all ports are empty.
+	*/
+	static bool shiftOldest(MidiPortIn *ports, int numPorts, midi::Message *msg) {
+		while (true) {
+			int oldest = -1;
+			int64_t oldestStamp = 0;
+			for (int p = 0; p < numPorts; p++) {
+				const MidiEvent *ev = ports[p].front();
+				if (ev && ((oldest < 0) || (ev->stamp < oldestStamp))) {
+					oldest = p;
+					oldestStamp = ev->stamp;
+				}
+			}
+			if (oldest < 0) return false;
+			*msg = ports[oldest].pending.msg;
+			ports[oldest].pop();
+			if (ports[oldest].remap(msg)) return true;
+		}
+	}
+};
@@ -0,0 +1,64 @@
+/*
+midiRing.hpp : lock-free ring between one producer thread and one consumer thread
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <atomic>
+using namespace rack;
+
+/** Fixed-capacity ring for exactly one producer thread and one consumer thread.
+No locks, no allocation. S must be a power of two.
+*/
+template <typename T, size_t S>
+struct SpscRing {
+	static_assert((S & (S - 1)) == 0, "SpscRing size must be a power of two");
+	T data[S];
+	std::atomic<size_t> writeIx{0};
+	std::atomic<size_t> readIx{0};
+	std::atomic<uint32_t> droppedCount{0};// pushes refused because the ring was full
+
+	/** Producer side. Returns false (message not stored, counted as dropped) when full */
+	bool push(const T &t) {
+		size_t w = writeIx.load(std::memory_order_relaxed);
+		if (w - readIx.load(std::memory_order_acquire) >= S) {
+			droppedCount.store(droppedCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return false;
+		}
+		data[w & (S - 1)] = t;
+		writeIx.store(w + 1, std::memory_order_release);
+		return true;
+	}
+	/** Consumer side. NULL when empty */
+	const T *front() const {
+		size_t r = readIx.load(std::memory_order_relaxed);
+		if (r == writeIx.load(std::memory_order_acquire)) return NULL;
+		return &data[r & (S - 1)];
+	}
+	void pop() {
+		readIx.store(readIx.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	size_t size() const {
+		return writeIx.load(std::memory_order_acquire) - readIx.load(std::memory_order_relaxed);
+	}
+	bool empty() const {
+		return readIx.load(std::memory_order_relaxed) == writeIx.load(std::memory_order_acquire);
+	}
+	/** Consumer side, drops everything pending */
+	void clear() {
+		readIx.store(writeIx.load(std::memory_order_acquire), std::memory_order_release);
+	}
+};
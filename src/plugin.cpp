@@ -9,7 +9,58 @@ void init(Plugin* p) {
 
 	// Add modules here
 	p->addModel(modelSuperMIDI64);
+	p->addModel(modelSuperMIDI64X);
 	p->addModel(modelDuoMIDI_CV);
+#ifdef MIDI_TRACE
+	Tracer::init();
+#endif
 	// Any other plugin initialization may go here.
 	// As an alternative, consider lazy-loading assets and lookup tables when your module is created to reduce startup times of Rack.
 }
+
+///////////////////////////////////////////////////////////////////////////////////////
+// Shared panel assets. Rack's window cache only keeps weak references, so once the last
+// instance is gone (a new patch, a patch load) every SVG and the font are parsed again.
+// Holding them here keeps one copy for the whole session. There is no window yet in
+// init(), so the first widget built loads the components every panel uses
+
+static const char *COMPONENT_SVGS[] = {
+	"res/DLXPort16.svg",
+	"res/DLXPort16b.svg",
+	"res/DLXPortG.svg",
+	"res/DLXSwitchLed_0.svg",
+	"res/DLXSwitchLed_1.svg",
+	"res/DLXSqrMinus_0.svg",
+	"res/DLXSqrMinus_1.svg",
+	"res/DLXSqrPlus_0.svg",
+	"res/DLXSqrPlus_1.svg",
+	"res/DLXdataKnobB.svg",
+	"res/DLXDispBttnL.svg",
+	"res/DLXDispBttnR.svg",
+};
+
+struct SharedAssets {
+	std::map<std::string, std::shared_ptr<Svg>> svgs;// panels join on first use
+	std::shared_ptr<Font> font;
+	SharedAssets() {
+		for (const char *filename : COMPONENT_SVGS)
+			svgs[filename] = APP->window->loadSvg(asset::plugin(pluginInstance, filename));
+		font = APP->window->loadFont(mFONT_FILE);
+	}
+};
+
+/** UI thread only, like the window's own cache */
+static SharedAssets &sharedAssets() {
+	static SharedAssets assets;
+	return assets;
+}
+
+std::shared_ptr<Svg> pluginSvg(const std::string &filename) {
+	std::shared_ptr<Svg> &svg = sharedAssets().svgs[filename];
+	if (!svg) svg = APP->window->loadSvg(asset::plugin(pluginInstance, filename));
+	return svg;
+}
+
+std::shared_ptr<Font> pluginFont() {
+	return sharedAssets().font;
+}
@@ -1,10 +1,22 @@
+#pragma once
 #include <rack.hpp>
 
 #include <algorithm> // std::find
 #include <vector> // std::vector
 #include <sstream> // stringstream
 #include <utility> // std::pair
+#include "midiBatch.hpp"
+#include "midiRing.hpp"
+#include "snapshot.hpp"
+#include "midiHub.hpp"
+#include "midiCatalog.hpp"
+#include "voiceStats.hpp"
+#include "engineStats.hpp"
+#include "midiCapture.hpp"
+#include "smfPlayer.hpp"
+#include "trace.hpp"
 #include "midiDllz.hpp"
+#include "SuperMIDI64X.hpp"
 
 #define mFONT_FILE asset::plugin(pluginInstance, "res/terminal-grotesque.ttf")
 
@@ -13,8 +25,13 @@ using namespace rack;
 // Declare the Plugin, defined in plugin.cpp
 extern Plugin* pluginInstance;
 
+/** Panel SVGs and the font held for the plugin's lifetime, filename relative to the plugin */
+std::shared_ptr<Svg> pluginSvg(const std::string &filename);
+std::shared_ptr<Font> pluginFont();
+
 // Declare each Model, defined in each module source file
 extern Model* modelSuperMIDI64;
+extern Model* modelSuperMIDI64X;
 extern Model* modelDuoMIDI_CV;
 
 ///////////////////////
@@ -31,8 +48,8 @@ struct TPurpleLight : GrayModuleLightWidget {
 struct DLXSwitchLed : SvgSwitch {
 	DLXSwitchLed() {
 		// box.size = Vec(10, 18);
-		addFrame(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXSwitchLed_0.svg")));
-		addFrame(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXSwitchLed_1.svg")));
+		addFrame(pluginSvg("res/DLXSwitchLed_0.svg"));
+		addFrame(pluginSvg("res/DLXSwitchLed_1.svg"));
 		shadow->opacity = 0.f;
 	}
 	void randomize() override{
@@ -50,8 +67,8 @@ struct TranspOffRedLight : ModuleLightWidget {
 struct minusButtonB : SvgSwitch {
 	minusButtonB() {
 		momentary = true;
-		addFrame(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXSqrMinus_0.svg")));
-		addFrame(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXSqrMinus_1.svg")));
+		addFrame(pluginSvg("res/DLXSqrMinus_0.svg"));
+		addFrame(pluginSvg("res/DLXSqrMinus_1.svg"));
 		shadow->opacity = 0.f;
 	}
 	void randomize() override{
@@ -60,8 +77,8 @@ struct minusButtonB : SvgSwitch {
 struct plusButtonB : SvgSwitch {
 	plusButtonB() {
 		momentary = true;
-		addFrame(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXSqrPlus_0.svg")));
-		addFrame(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXSqrPlus_1.svg")));
+		addFrame(pluginSvg("res/DLXSqrPlus_0.svg"));
+		addFrame(pluginSvg("res/DLXSqrPlus_1.svg"));
 		shadow->opacity = 0.f;
 	}
 	void randomize() override{
@@ -71,21 +88,37 @@ struct plusButtonB : SvgSwitch {
 ///Jacks
 struct DLXPortPoly : SvgPort {
 	DLXPortPoly() {
-		setSvg(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXPort16.svg")));
+		setSvg(pluginSvg("res/DLXPort16.svg"));
 		shadow->opacity = 0.f;
 	}
 };
 
 struct DLXPortPolyOut : SvgPort {
 	DLXPortPolyOut() {
-		setSvg(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXPort16b.svg")));
+		setSvg(pluginSvg("res/DLXPort16b.svg"));
 		shadow->opacity = 0.f;
 	}
 };
 
 struct DLXPortG : SvgPort {
 	DLXPortG() {
-		setSvg(APP->window->loadSvg(asset::plugin(pluginInstance, "res/DLXPortG.svg")));
+		setSvg(pluginSvg("res/DLXPortG.svg"));
 		shadow->opacity = 0.f;
 	}
 };
+
+/// Panel details built on first draw
+/** Builds its children the first time it is drawn. Rack only draws panels in view, so a
+patch loading many instances only pays for the ones on screen. Keep ports and params out
+of it, cables attach to them while the patch loads */
+struct DeferredWidget : Widget {
+	std::function<void(Widget*)> build;
+	void draw(const DrawArgs &args) override {
+		if (build) {
+			build(this);
+			build = nullptr;
+			Widget::step();// the new children catch up before their first draw
+		}
+		Widget::draw(args);
+	}
+};
@@ -0,0 +1,330 @@
+/*
+smfPlayer.cpp : Standard MIDI File playback into a module's message path
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "plugin.hpp"
+#include <osdialog.h>
+
+static uint32_t readBE(const uint8_t *p, int n) {
+	uint32_t v = 0;
+	for (int i = 0; i < n; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+SmfSong *SmfSong::load(const std::string &path, std::string *error) {
+	FILE *file = std::fopen(path.c_str(), "rb");
+	if (!file) {
+		*error = "can't open the file";
+		return NULL;
+	}
+	SmfSong *song = new SmfSong;
+	song->path = path;
+	std::fseek(file, 0, SEEK_END);
+	long size = std::ftell(file);
+	std::fseek(file, 0, SEEK_SET);
+	if (size > 0) {
+		song->bytes.resize(size);
+		size = std::fread(song->bytes.data(), 1, size, file);
+	}
+	std::fclose(file);
+	const uint8_t *b = song->bytes.data();
+	if ((size < 14) || (std::memcmp(b, "MThd", 4) != 0) || (readBE(b + 4, 4) < 6)) {
+		*error = "not a Standard MIDI File";
+		delete song;
+		return NULL;
+	}
+	uint32_t format = readBE(b + 8, 2);
+	uint32_t numTracks = readBE(b + 10, 2);
+	uint32_t division = readBE(b + 12, 2);
+	if (format > 1) {// format 2 tracks are independent sequences, not played together
+		*error = "format 2 files are not supported";
+		delete song;
+		return NULL;
+	}
+	if (division & 0x8000) {// SMPTE : -frames per second, ticks per frame
+		int fps = 256 - (division >> 8);
+		song->smpteTicksPerSec = ((fps == 29) ? 29.97 : fps) * (division & 0xff);
+	}
+	else song->division = division ? division : 480;
+	uint32_t pos = 8 + readBE(b + 4, 4);
+	while ((pos + 8 <= static_cast<uint32_t>(size)) && (song->tracks.size() < numTracks)) {
+		uint32_t len = readBE(b + pos + 4, 4);
+		uint32_t begin = pos + 8;
+		uint32_t end = (len > size - begin) ? size : begin + len;// truncated files play up to their end
+		if (std::memcmp(b + pos, "MTrk", 4) == 0) {
+			Track t;
+			t.begin = begin;
+			t.end = end;
+			song->tracks.push_back(t);
+		}
+		pos = end;
+	}
+	if (song->tracks.empty()) {
+		*error = "no tracks";
+		delete song;
+		return NULL;
+	}
+	song->rewind();
+	return song;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+bool SmfSong::readVarLen(uint32_t *pos, uint32_t end, uint32_t *value) const {
+	*value = 0;
+	for (int i = 0; i < 4; i++) {
+		if (*pos >= end) return false;
+		uint8_t c = bytes[(*pos)++];
+		*value = (*value << 7) | (c & 0x7f);
+		if (!(c & 0x80)) return true;
+	}
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void SmfSong::readDelta(Track &t) {
+	uint32_t delta;
+	if (!readVarLen(&t.pos, t.end, &delta)) t.done = true;
+	else t.tick += delta;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void SmfSong::rewind() {
+	for (Track &t : tracks) {
+		t.pos = t.begin;
+		t.tick = 0;
+		t.status = 0;
+		t.done = false;
+		readDelta(t);
+	}
+}
+///////////////////////////////////////////////////////////////////////////////////////
+SmfPlayer::~SmfPlayer() {
+	delete song;
+	delete incoming.load();
+	freeOutgoing();
+}
+///////////////////////////////////////////////////////////////////////////////////////
+bool SmfPlayer::load(const std::string &path) {
+	std::string error;
+	SmfSong *newSong = SmfSong::load(path, &error);
+	if (!newSong) {
+		WARN("Could not play %s: %s", path.c_str(), error.c_str());
+		return false;
+	}
+	this->path = path;
+	freeOutgoing();
+	delete incoming.exchange(newSong, std::memory_order_acq_rel);// one the engine never took
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void SmfPlayer::unload() {
+	playing.store(false, std::memory_order_relaxed);
+	path = "";
+	freeOutgoing();
+	delete incoming.exchange(new SmfSong, std::memory_order_acq_rel);// an empty song, no tracks
+}
+///////////////////////////////////////////////////////////////////////////////////////
+/** UI thread : deletes the songs the engine replaced */
+void SmfPlayer::freeOutgoing() {
+	SmfSong *old = outgoing.exchange(NULL, std::memory_order_acquire);
+	while (old) {
+		SmfSong *next = old->nextOld;
+		delete old;
+		old = next;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void SmfPlayer::takeSong() {
+	SmfSong *newSong = incoming.exchange(NULL, std::memory_order_acquire);
+	if (!newSong) return;
+	if (song) {// chained, the UI may not have collected the previous one yet
+		song->nextOld = outgoing.load(std::memory_order_relaxed);
+		while (!outgoing.compare_exchange_weak(song->nextOld, song, std::memory_order_release, std::memory_order_relaxed)) {}
+	}
+	song = newSong;
+	restart();
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void SmfPlayer::trackNote(const midi::Message &msg) {
+	int kind = msg.bytes[0] >> 4;
+	if ((kind != 0x8) && (kind != 0x9)) return;
+	uint32_t &word = heldNotes[msg.bytes[0] & 0xf][(msg.bytes[1] >> 5) & 3];
+	uint32_t bit = 1u << (msg.bytes[1] & 31);
+	bool on = (kind == 0x9) && (msg.bytes[2] > 0);
+	if (on && !(word & bit)) {
+		word |= bit;
+		heldCount ++;
+	}
+	else if (!on && (word & bit)) {
+		word &= ~bit;
+		heldCount --;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void SmfPlayer::restart() {
+	releasePending = true;
+	song->rewind();
+	tickPos = 0.0;
+	ticksPerSec = song->division * 2.0;// 500000 us per quarter
+}
+///////////////////////////////////////////////////////////////////////////////////////
+bool SmfPlayer::readEvent(SmfSong::Track &t, midi::Message *msg) {
+	const std::vector<uint8_t> &b = song->bytes;
+	bool isMsg = false;
+	if (t.pos >= t.end) {
+		t.done = true;
+		return false;
+	}
+	uint8_t status = b[t.pos];
+	if (status & 0x80) t.pos++;
+	else status = t.status;// running status
+	if ((status >= 0x80) && (status < 0xf0)) {
+		t.status = status;
+		int dataLen = ((status >> 4) == 0xc || (status >> 4) == 0xd) ? 1 : 2;
+		if (t.pos + dataLen > t.end) {
+			t.done = true;
+			return false;
+		}
+		msg->size = 1 + dataLen;
+		msg->bytes[0] = status;
+		msg->bytes[1] = b[t.pos];
+		msg->bytes[2] = (dataLen > 1) ? b[t.pos + 1] : 0;
+		t.pos += dataLen;
+		isMsg = true;
+	}
+	else if (status == 0xff) {// meta
+		if (t.pos >= t.end) {
+			t.done = true;
+			return false;
+		}
+		uint8_t type = b[t.pos++];
+		uint32_t len;
+		if (!song->readVarLen(&t.pos, t.end, &len) || (len > t.end - t.pos)) {
+			t.done = true;
+			return false;
+		}
+		if ((type == 0x51) && (len == 3)) {
+			uint32_t tempo = readBE(&b[t.pos], 3);
+			if (tempo > 0) ticksPerSec = song->division * 1000000.0 / tempo;
+		}
+		else if (type == 0x2f) {
+			t.done = true;
+			return false;
+		}
+		t.pos += len;
+	}
+	else if ((status == 0xf0) || (status == 0xf7)) {// sysex, or an escape holding one short message
+		uint32_t len;
+		if (!song->readVarLen(&t.pos, t.end, &len) || (len > t.end - t.pos)) {
+			t.done = true;
+			return false;
+		}
+		if ((status == 0xf7) && (len > 0) && (len <= 3) && (b[t.pos] >= 0xf0)) {
+			msg->size = len;
+			for (uint32_t i = 0; i < 3; i++)
+				msg->bytes[i] = (i < len) ? b[t.pos + i] : 0;
+			isMsg = true;
+		}
+		t.pos += len;
+	}
+	else {// data byte with no running status
+		t.done = true;
+		return false;
+	}
+	song->readDelta(t);
+	return isMsg;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+json_t *SmfPlayer::toJson() {
+	json_t *rootJ = json_object();
+	json_object_set_new(rootJ, "path", json_string(path.c_str()));
+	json_object_set_new(rootJ, "loop", json_boolean(loop.load()));
+	json_object_set_new(rootJ, "followClock", json_boolean(followClock.load()));
+	return rootJ;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void SmfPlayer::fromJson(json_t *rootJ) {
+	json_t *loopJ = json_object_get(rootJ, "loop");
+	if (loopJ) loop.store(json_boolean_value(loopJ));
+	json_t *followClockJ = json_object_get(rootJ, "followClock");
+	if (followClockJ) followClock.store(json_boolean_value(followClockJ));
+	const char *songPath = json_string_value(json_object_get(rootJ, "path"));
+	if (songPath && songPath[0]) load(songPath);// loaded stopped
+}
+///////////////////////////////////////////////////////////////////////////////////////
+struct SmfLoadItem : MenuItem {
+	SmfPlayer *player;
+	void onAction(const event::Action &e) override {
+		osdialog_filters *filters = osdialog_filters_parse("Standard MIDI File:mid,midi");
+		std::string dir = player->path.empty() ? "" : string::directory(player->path);
+		char *path = osdialog_file(OSDIALOG_OPEN, dir.empty() ? NULL : dir.c_str(), NULL, filters);
+		osdialog_filters_free(filters);
+		if (!path) return;
+		if (player->load(path)) player->playing.store(!player->followClock.load(), std::memory_order_relaxed);
+		std::free(path);
+	}
+};
+struct SmfPlayItem : MenuItem {
+	SmfPlayer *player;
+	void onAction(const event::Action &e) override {
+		player->playing.store(!player->playing.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+};
+struct SmfRewindItem : MenuItem {
+	SmfPlayer *player;
+	void onAction(const event::Action &e) override {
+		player->rewindRequested.store(true, std::memory_order_relaxed);
+	}
+};
+struct SmfFlagItem : MenuItem {
+	std::atomic<bool> *flag;
+	void onAction(const event::Action &e) override {
+		flag->store(!flag->load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+};
+struct SmfUnloadItem : MenuItem {
+	SmfPlayer *player;
+	void onAction(const event::Action &e) override {
+		player->unload();
+	}
+};
+///////////////////////////////////////////////////////////////////////////////////////
+Menu *SmfPlayerItem::createChildMenu() {
+	Menu *menu = new Menu;
+	menu->addChild(createMenuLabel(player->path.empty() ? std::string("No file") : string::filename(player->path)));
+	SmfLoadItem *loadItem = createMenuItem<SmfLoadItem>("Load...");
+	loadItem->player = player;
+	menu->addChild(loadItem);
+	if (!player->path.empty()) {
+		bool playing = player->playing.load(std::memory_order_relaxed);
+		SmfPlayItem *playItem = createMenuItem<SmfPlayItem>(playing ? "Stop" : "Play", string::f("tick %llu", static_cast<unsigned long long>(player->position.load(std::memory_order_relaxed))));
+		playItem->player = player;
+		menu->addChild(playItem);
+		SmfRewindItem *rewindItem = createMenuItem<SmfRewindItem>("Rewind");
+		rewindItem->player = player;
+		menu->addChild(rewindItem);
+		SmfUnloadItem *unloadItem = createMenuItem<SmfUnloadItem>("Unload");
+		unloadItem->player = player;
+		menu->addChild(unloadItem);
+	}
+	menu->addChild(new MenuSeparator());
+	SmfFlagItem *loopItem = createMenuItem<SmfFlagItem>("Loop", CHECKMARK(player->loop.load(std::memory_order_relaxed)));
+	loopItem->flag = &player->loop;
+	menu->addChild(loopItem);
+	SmfFlagItem *clockItem = createMenuItem<SmfFlagItem>("Follow MIDI clock, start and stop", CHECKMARK(player->followClock.load(std::memory_order_relaxed)));
+	clockItem->flag = &player->followClock;
+	menu->addChild(clockItem);
+	return menu;
+}
@@ -0,0 +1,172 @@
+/*
+smfPlayer.hpp : Standard MIDI File playback into a module's message path
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <atomic>
+using namespace rack;
+
+/** A .mid file held as its raw bytes plus one read cursor per track.
+Tracks are parsed while playing, straight from the file image, so a song costs
+its file size and playback never allocates.
+*/
+struct SmfSong {
+	struct Track {
+		uint32_t begin, end;// MTrk data in bytes[]
+		// play state, engine thread only
+		uint32_t pos;
+		uint64_t tick;// absolute tick of the event at pos
+		uint8_t status;// running status
+		bool done;
+	};
+	std::vector<uint8_t> bytes;
+	std::vector<Track> tracks;
+	std::string path;
+	int division = 480;// ticks per quarter
+	double smpteTicksPerSec = 0.0;// > 0 : SMPTE timing, tempo events ignored
+	SmfSong *nextOld = NULL;// replaced songs waiting in SmfPlayer::outgoing
+
+	/** UI thread. NULL with *error set when the file can't be read or isn't a MIDI file */
+	static SmfSong *load(const std::string &path, std::string *error);
+	bool readVarLen(uint32_t *pos, uint32_t end, uint32_t *value) const;
+	/** Reads the delta time of the next event, marks the track done at its end */
+	void readDelta(Track &t);
+	void rewind();
+};
+
+/** Plays an SmfSong at the engine sample rate, or follows MIDI clock / start /
+stop / continue from the live input. Events come out on the first sample whose
+song position reaches them, in file order within a sample, through the same
+callback the live input uses.
+The UI hands songs over through incoming and collects replaced ones from
+outgoing, so the engine thread never frees one.
+Notes the file left sounding get a note-off when playback stops, rewinds,
+loops or changes song.
+*/
+struct SmfPlayer {
+	std::atomic<SmfSong*> incoming{NULL};// UI -> engine
+	std::atomic<SmfSong*> outgoing{NULL};// engine -> UI, to delete, chained by nextOld
+	std::atomic<bool> playing{false};// set by the UI, the clock and the end of the song
+	std::atomic<bool> rewindRequested{false};
+	std::atomic<bool> loop{false};
+	std::atomic<bool> followClock{false};// MIDI clock drives the song position
+	std::atomic<uint64_t> position{0};// ticks, for the menu
+	std::string path;// UI thread, last file loaded
+
+	// engine thread only
+	SmfSong *song = NULL;
+	double tickPos = 0.0;
+	double ticksPerSec = 960.0;// 120 BPM at 480 ticks per quarter until a tempo event
+	uint32_t heldNotes[16][4] = {};// bit per note the file has sounding, by channel
+	int heldCount = 0;
+	bool releasePending = false;// set by restart(), the held notes go before the next event
+
+	~SmfPlayer();
+	/** UI thread */
+	bool load(const std::string &path);
+	void unload();
+	void freeOutgoing();
+	json_t *toJson();
+	void fromJson(json_t *rootJ);
+
+	/** Engine thread : system realtime messages from the live input, for followClock */
+	void onRealtime(uint8_t status) {
+		if (!followClock.load(std::memory_order_relaxed) || !song) return;
+		switch (status) {
+			case 0xf8: {// 24 clocks per quarter
+				if (playing.load(std::memory_order_relaxed) && (song->smpteTicksPerSec <= 0.0))
+					tickPos += song->division / 24.0;
+			}break;
+			case 0xfa: {// start
+				restart();
+				playing.store(true, std::memory_order_relaxed);
+			}break;
+			case 0xfb: {// continue
+				playing.store(true, std::memory_order_relaxed);
+			}break;
+			case 0xfc: {// stop
+				playing.store(false, std::memory_order_relaxed);
+			}break;
+			default: break;
+		}
+	}
+	/** Engine thread : once per sample, emit(const midi::Message &) for every event due */
+	template <class F>
+	void process(float sampleRate, F emit) {
+		if (incoming.load(std::memory_order_relaxed)) takeSong();
+		if (!song) return;
+		if (rewindRequested.exchange(false, std::memory_order_relaxed)) restart();
+		bool isPlaying = playing.load(std::memory_order_relaxed);
+		if (releasePending || !isPlaying) releaseNotes(emit);
+		if (!isPlaying) return;
+		midi::Message msg;
+		while (true) {
+			SmfSong::Track *next = NULL;
+			for (size_t i = 0; i < song->tracks.size(); i++) {
+				SmfSong::Track &t = song->tracks[i];
+				if (!t.done && (!next || (t.tick < next->tick))) next = &t;
+			}
+			if (!next) {// end of the song
+				restart();
+				releaseNotes(emit);
+				if (!loop.load(std::memory_order_relaxed)) playing.store(false, std::memory_order_relaxed);
+				return;
+			}
+			if (next->tick > tickPos) break;
+			if (readEvent(*next, &msg)) {
+				trackNote(msg);
+				emit(msg);
+			}
+		}
+		if (!followClock.load(std::memory_order_relaxed))
+			tickPos += ((song->smpteTicksPerSec > 0.0) ? song->smpteTicksPerSec : ticksPerSec) / sampleRate;
+		position.store(static_cast<uint64_t>(tickPos), std::memory_order_relaxed);
+	}
+
+	/** Engine thread : note-off for every note the file left sounding */
+	template <class F>
+	void releaseNotes(F emit) {
+		releasePending = false;
+		if (heldCount == 0) return;
+		midi::Message msg;
+		msg.size = 3;
+		for (int ch = 0; ch < 16; ch++) {
+			for (int note = 0; note < 128; note++) {
+				if (!(heldNotes[ch][note >> 5] & (1u << (note & 31)))) continue;
+				msg.bytes[0] = 0x80 | ch;
+				msg.bytes[1] = note;
+				msg.bytes[2] = 0;
+				emit(msg);
+			}
+			for (int w = 0; w < 4; w++)
+				heldNotes[ch][w] = 0;
+		}
+		heldCount = 0;
+	}
+	void trackNote(const midi::Message &msg);
+	void takeSong();
+	void restart();
+	/** Consumes the event at t.pos. Returns true with *msg set for a channel message
+	(or a short F7 escape, as written by MidiCapture); tempo is applied here */
+	bool readEvent(SmfSong::Track &t, midi::Message *msg);
+};
+
+/// File playback submenu : load, play / stop, rewind, loop, follow MIDI clock
+struct SmfPlayerItem : MenuItem {
+	SmfPlayer *player = NULL;
+	Menu *createChildMenu() override;
+};
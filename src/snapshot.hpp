@@ -0,0 +1,48 @@
+/*
+snapshot.hpp : lock-free triple buffer, the engine publishes a state copy the UI reads
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <atomic>
+using namespace rack;
+
+/** Triple buffer for exactly one writer thread and one reader thread.
+The writer fills writeBuffer() and publishes it whole, the reader always gets the
+latest complete copy. Neither side waits or allocates.
+*/
+template <typename T>
+struct SnapshotBuffer {
+	static const int FRESH = 4;// set in middle when it holds a copy the reader has not taken
+	T bufs[3];
+	std::atomic<int> middle{1};
+	int back = 0;// writer only
+	int front = 2;// reader only
+
+	/** Writer side */
+	T &writeBuffer() {
+		return bufs[back];
+	}
+	void publish() {
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 3;
+	}
+	/** Reader side, the latest published copy (stays valid until the next read) */
+	const T &read() {
+		if (middle.load(std::memory_order_relaxed) & FRESH)
+			front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+		return bufs[front];
+	}
+};
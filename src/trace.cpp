@@ -0,0 +1,95 @@
+/*
+trace.cpp : optional hot-path trace ring, saved as Chrome / Perfetto trace JSON
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "plugin.hpp"
+#ifdef MIDI_TRACE
+#include <osdialog.h>
+
+Tracer::Tracer() {
+	slots = new Slot[CAPACITY];
+}
+///////////////////////////////////////////////////////////////////////////////////////
+Tracer::~Tracer() {
+	if (writer.joinable()) writer.join();
+	delete[] slots;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+Tracer *Tracer::instance = NULL;
+
+void Tracer::init() {
+	static Tracer tracer;
+	instance = &tracer;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+bool Tracer::save(const std::string &path) {
+	if (saving.exchange(true, std::memory_order_acquire)) return false;
+	if (writer.joinable()) writer.join();// the previous save is done, saving was clear
+	uint64_t to = writePos.load(std::memory_order_acquire);
+	uint64_t from = (to > CAPACITY) ? to - CAPACITY : 0;
+	writer = std::thread(&Tracer::writeFile, this, path, from, to);
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void Tracer::writeFile(std::string path, uint64_t from, uint64_t to) {
+	FILE *file = std::fopen(path.c_str(), "w");
+	if (!file) {
+		WARN("Could not write trace to %s", path.c_str());
+		saving.store(false, std::memory_order_release);
+		return;
+	}
+	std::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	bool first = true;
+	uint32_t skipped = 0;
+	for (uint64_t pos = from; pos < to; pos++) {
+		const Slot &slot = slots[pos & (CAPACITY - 1)];
+		uint64_t seq = slot.seq.load(std::memory_order_acquire);
+		if (seq != 2 * pos + 2) {// still being written or already overwritten by newer spans
+			skipped ++;
+			continue;
+		}
+		const char *name = slot.name.load(std::memory_order_relaxed);
+		int64_t start = slot.start.load(std::memory_order_relaxed);
+		int64_t end = slot.end.load(std::memory_order_relaxed);
+		uint32_t tid = slot.tid.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.seq.load(std::memory_order_relaxed) != seq) {
+			skipped ++;
+			continue;
+		}
+		// Chrome trace timestamps are microseconds
+		if (end > start)
+			std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n", name, tid, start / 1000.0, (end - start) / 1000.0);
+		else
+			std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}", first ? "" : ",\n", name, tid, start / 1000.0);
+		first = false;
+	}
+	std::fprintf(file, "\n]}\n");
+	std::fclose(file);
+	INFO("Trace saved to %s (%u spans skipped)", path.c_str(), skipped);
+	saving.store(false, std::memory_order_release);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void TraceSaveItem::onAction(const event::Action &e) {
+	osdialog_filters *filters = osdialog_filters_parse("Chrome trace:json");
+	char *path = osdialog_file(OSDIALOG_SAVE, NULL, "trace.json", filters);
+	osdialog_filters_free(filters);
+	if (!path) return;
+	if (!Tracer::get()->save(path)) WARN("A trace is still being saved");
+	std::free(path);
+}
+#endif
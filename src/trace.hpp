@@ -0,0 +1,121 @@
+/*
+trace.hpp : optional hot-path trace ring, saved as Chrome / Perfetto trace JSON
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+
+/** Built with `make TRACE=1` (defines MIDI_TRACE) the macros below record spans into
+one plugin-wide ring: a fetch_add and a few relaxed stores per span, no locks and no
+allocation on the engine threads. Saving copies the ring on a background thread and
+writes it as Chrome trace JSON (chrome://tracing or ui.perfetto.dev).
+Without MIDI_TRACE every macro expands to nothing.
+
+	TRACE_SCOPE("drain");               span until the end of the enclosing block
+	TRACE_BEGIN(t); ... TRACE_END(t, "outputs");    span between two points
+	TRACE_INSTANT("resetVoices");       zero length marker
+
+Names must be string literals, only their pointers are stored.
+*/
+#ifdef MIDI_TRACE
+#include <atomic>
+#include <chrono>
+#include <thread>
+using namespace rack;
+
+#ifndef MIDI_TRACE_CAPACITY
+#define MIDI_TRACE_CAPACITY (1 << 19)// spans kept, 40 bytes each, ~20MB
+#endif
+
+struct Tracer {
+	struct Slot {
+		std::atomic<uint64_t> seq{0};// 2 * pos + 2 once written, odd while being written
+		std::atomic<const char*> name{NULL};
+		std::atomic<int64_t> start{0};
+		std::atomic<int64_t> end{0};
+		std::atomic<uint32_t> tid{0};
+	};
+	static const uint64_t CAPACITY = MIDI_TRACE_CAPACITY;
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "MIDI_TRACE_CAPACITY must be a power of two");
+
+	Slot *slots;
+	std::atomic<uint64_t> writePos{0};
+	std::atomic<uint32_t> nextTid{1};
+	std::thread writer;
+	std::atomic<bool> saving{false};
+
+	static Tracer *instance;
+
+	Tracer();
+	~Tracer();
+	/** Allocates the ring, called from the plugin's init() before any engine thread records */
+	static void init();
+	static Tracer *get() {
+		return instance;
+	}
+	static int64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	/** Small stable id for the calling thread, the "tid" of its spans */
+	uint32_t threadId() {
+		static thread_local uint32_t tid = 0;
+		if (tid == 0) tid = nextTid.fetch_add(1, std::memory_order_relaxed);
+		return tid;
+	}
+	/** Any thread, wait-free */
+	void record(const char *name, int64_t start, int64_t end) {
+		uint64_t pos = writePos.fetch_add(1, std::memory_order_relaxed);
+		Slot &slot = slots[pos & (CAPACITY - 1)];
+		slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.name.store(name, std::memory_order_relaxed);
+		slot.start.store(start, std::memory_order_relaxed);
+		slot.end.store(end, std::memory_order_relaxed);
+		slot.tid.store(threadId(), std::memory_order_relaxed);
+		slot.seq.store(2 * pos + 2, std::memory_order_release);
+	}
+	/** UI thread : writes what the ring holds now to path on the writer thread.
+	Returns false when a previous save is still running. */
+	bool save(const std::string &path);
+	void writeFile(std::string path, uint64_t from, uint64_t to);
+
+	struct Scope {
+		const char *name;
+		int64_t start;
+		Scope(const char *name) : name(name), start(Tracer::now()) {}
+		~Scope() {
+			Tracer::get()->record(name, start, Tracer::now());
+		}
+	};
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) Tracer::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_BEGIN(var) int64_t var = Tracer::now()
+#define TRACE_END(var, name) Tracer::get()->record(name, var, Tracer::now())
+#define TRACE_INSTANT(name) do {int64_t traceNow = Tracer::now(); Tracer::get()->record(name, traceNow, traceNow);} while (0)
+
+/// "Save trace..." for the context menu
+struct TraceSaveItem : MenuItem {
+	void onAction(const event::Action &e) override;
+};
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_BEGIN(var)
+#define TRACE_END(var, name)
+#define TRACE_INSTANT(name)
+#endif
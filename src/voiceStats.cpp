@@ -0,0 +1,120 @@
+/*
+voiceStats.cpp : polyphony usage counters, to size voice counts from real performances
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "plugin.hpp"
+#include <osdialog.h>
+
+int VoiceStats::voicesCovering(float share) const {
+	uint32_t total = ticks.load(std::memory_order_relaxed);
+	if (total == 0) return 0;
+	uint64_t covered = 0;
+	for (int n = 0; n <= MAX_VOICES; n++) {
+		covered += histogram[n].load(std::memory_order_relaxed);
+		if (covered >= share * total) return n;
+	}
+	return MAX_VOICES;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+json_t *VoiceStats::toJson() const {
+	json_t *rootJ = json_object();
+	json_object_set_new(rootJ, "tickSeconds", json_real(tickTime));
+	json_object_set_new(rootJ, "ticks", json_integer(ticks.load(std::memory_order_relaxed)));
+	json_object_set_new(rootJ, "peakVoices", json_integer(peakVoices.load(std::memory_order_relaxed)));
+	json_object_set_new(rootJ, "voices99", json_integer(voicesCovering(0.99f)));
+	json_object_set_new(rootJ, "steals", json_integer(steals.load(std::memory_order_relaxed)));
+	json_object_set_new(rootJ, "peakCachedNotes", json_integer(peakCached.load(std::memory_order_relaxed)));
+	json_object_set_new(rootJ, "peakPedalHeld", json_integer(peakPedal.load(std::memory_order_relaxed)));
+	json_t *histJ = json_array();
+	int last = std::min(peakVoices.load(std::memory_order_relaxed), int(MAX_VOICES));
+	for (int n = 0; n <= last; n++)
+		json_array_append_new(histJ, json_integer(histogram[n].load(std::memory_order_relaxed)));
+	json_object_set_new(rootJ, "histogram", histJ);// ticks spent with [index] voices sounding
+	return rootJ;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+std::string VoiceStats::toCsv() const {
+	std::stringstream csv;
+	uint32_t total = ticks.load(std::memory_order_relaxed);
+	csv << "voices,ticks,seconds,share\n";
+	int last = std::min(peakVoices.load(std::memory_order_relaxed), int(MAX_VOICES));
+	for (int n = 0; n <= last; n++) {
+		uint32_t t = histogram[n].load(std::memory_order_relaxed);
+		csv << n << "," << t << "," << (t * tickTime) << "," << (total ? static_cast<double>(t) / total : 0.0) << "\n";
+	}
+	csv << "\nsteals," << steals.load(std::memory_order_relaxed) << "\n";
+	csv << "peakCachedNotes," << peakCached.load(std::memory_order_relaxed) << "\n";
+	csv << "peakPedalHeld," << peakPedal.load(std::memory_order_relaxed) << "\n";
+	return csv.str();
+}
+///////////////////////////////////////////////////////////////////////////////////////
+bool VoiceStats::save(const std::string &path) const {
+	bool csv = (string::filenameExtension(string::filename(path)) == "csv");
+	if (csv) {
+		FILE *file = std::fopen(path.c_str(), "w");
+		if (!file) return false;
+		std::string text = toCsv();
+		std::fwrite(text.data(), 1, text.size(), file);
+		std::fclose(file);
+		return true;
+	}
+	json_t *rootJ = toJson();
+	int err = json_dump_file(rootJ, path.c_str(), JSON_INDENT(2));
+	json_decref(rootJ);
+	return (err == 0);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+struct VoiceStatsExportItem : MenuItem {
+	VoiceStats *stats;
+	std::string ext;
+	void onAction(const event::Action &e) override {
+		osdialog_filters *filters = osdialog_filters_parse((ext == "csv") ? "CSV:csv" : "JSON:json");
+		char *path = osdialog_file(OSDIALOG_SAVE, NULL, ("voice-usage." + ext).c_str(), filters);
+		osdialog_filters_free(filters);
+		if (!path) return;
+		if (!stats->save(path)) WARN("Could not write voice usage to %s", path);
+		std::free(path);
+	}
+};
+struct VoiceStatsResetItem : MenuItem {
+	VoiceStats *stats;
+	void onAction(const event::Action &e) override {
+		stats->resetRequested.store(true, std::memory_order_relaxed);
+	}
+};
+///////////////////////////////////////////////////////////////////////////////////////
+Menu *VoiceStatsItem::createChildMenu() {
+	Menu *menu = new Menu;
+	menu->addChild(createMenuLabel(string::f("Peak voices: %d", stats->peakVoices.load(std::memory_order_relaxed))));
+	menu->addChild(createMenuLabel(string::f("99%% of the time within: %d voices", stats->voicesCovering(0.99f))));
+	menu->addChild(createMenuLabel(string::f("Voice steals: %u", stats->steals.load(std::memory_order_relaxed))));
+	menu->addChild(createMenuLabel(string::f("Peak cached notes: %d", stats->peakCached.load(std::memory_order_relaxed))));
+	menu->addChild(createMenuLabel(string::f("Peak pedal-held voices: %d", stats->peakPedal.load(std::memory_order_relaxed))));
+	menu->addChild(new MenuSeparator());
+	VoiceStatsExportItem *jsonItem = createMenuItem<VoiceStatsExportItem>("Export JSON...");
+	jsonItem->stats = stats;
+	jsonItem->ext = "json";
+	menu->addChild(jsonItem);
+	VoiceStatsExportItem *csvItem = createMenuItem<VoiceStatsExportItem>("Export CSV...");
+	csvItem->stats = stats;
+	csvItem->ext = "csv";
+	menu->addChild(csvItem);
+	VoiceStatsResetItem *resetItem = createMenuItem<VoiceStatsResetItem>("Reset");
+	resetItem->stats = stats;
+	menu->addChild(resetItem);
+	return menu;
+}
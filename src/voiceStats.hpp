@@ -0,0 +1,86 @@
+/*
+voiceStats.hpp : polyphony usage counters, to size voice counts from real performances
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <atomic>
+using namespace rack;
+
+/** Voice usage written by the engine at a low tick rate and read by the context menu.
+Only the engine writes (relaxed load + store, no read-modify-write on the audio path),
+the UI asks for a reset through a flag.
+*/
+struct VoiceStats {
+	static const int MAX_VOICES = 128;
+	std::atomic<uint32_t> histogram[MAX_VOICES + 1];// ticks spent with n voices sounding
+	std::atomic<uint32_t> ticks{0};
+	std::atomic<uint32_t> steals{0};// notes that took a sounding voice
+	std::atomic<int> peakVoices{0};
+	std::atomic<int> peakCached{0};// deepest stack of stolen / held-back notes
+	std::atomic<int> peakPedal{0};// most voices held only by the sustain pedal
+	std::atomic<bool> resetRequested{false};
+	float tickTime = 0.f;// seconds per tick, for the export
+
+	VoiceStats() {
+		clear();
+	}
+	static void bump(std::atomic<uint32_t> &c) {
+		c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+	static void raise(std::atomic<int> &peak, int v) {
+		if (v > peak.load(std::memory_order_relaxed)) peak.store(v, std::memory_order_relaxed);
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	/** Engine thread, once per tick */
+	void tick(int voices, int cached, int pedalHeld) {
+		if (resetRequested.load(std::memory_order_relaxed)) {
+			clear();
+			resetRequested.store(false, std::memory_order_relaxed);
+		}
+		bump(histogram[(voices < MAX_VOICES) ? std::max(voices, 0) : int(MAX_VOICES)]);
+		bump(ticks);
+		raise(peakVoices, voices);
+		raise(peakCached, cached);
+		raise(peakPedal, pedalHeld);
+	}
+	/** Engine thread */
+	void steal() {
+		bump(steals);
+	}
+	void clear() {
+		for (int i = 0; i <= MAX_VOICES; i++)
+			histogram[i].store(0, std::memory_order_relaxed);
+		ticks.store(0, std::memory_order_relaxed);
+		steals.store(0, std::memory_order_relaxed);
+		peakVoices.store(0, std::memory_order_relaxed);
+		peakCached.store(0, std::memory_order_relaxed);
+		peakPedal.store(0, std::memory_order_relaxed);
+	}
+///////////////////////////////////////////////////////////////////////////////////////
+	/** Fewest voices that covered the given share of the time (0 ~ 1) */
+	int voicesCovering(float share) const;
+	json_t *toJson() const;
+	std::string toCsv() const;
+	/** .csv gets CSV, anything else JSON. Returns false if the file could not be written */
+	bool save(const std::string &path) const;
+};
+
+/// Context menu with the usage summary, export and reset
+struct VoiceStatsItem : MenuItem {
+	VoiceStats *stats = NULL;
+	Menu *createChildMenu() override;
+};
@@ -0,0 +1,306 @@
+/*
+allocbench.cpp : voice allocator microbenchmarks, per-event cost of getPolyIndex,
+getAltPolyIndex, pressNote, releaseNote, pressPedal and releasePedal in every poly mode
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+// the module struct lives in its translation unit, this one is built in place of SuperMIDI64.o
+#include "SuperMIDI64.cpp"
+#include "harness.hpp"
+
+static const std::vector<std::string> &MODES = harness::polyModes("SuperMIDI64");
+
+static const char *USAGE =
+"usage: allocbench [options]\n"
+"  -f, --filter TEXT     only benchmarks whose name contains TEXT, repeatable\n"
+"  -p, --mode LIST       poly modes, default all\n"
+"  -l, --layout OxV      outputs x voices per output, default 4x16\n"
+"  -e, --events N        timed events per benchmark, default 100000\n"
+"      --seed N          srand() seed (note drift), default 1\n"
+"      --list            print the benchmark names and exit\n"
+"Each event is timed on its own, less the stopwatch's own cost, so best / p99 /\n"
+"worst are per event. Mean is the total over the event count.\n";
+
+/** Per-event timings for one benchmark */
+struct Series {
+	std::vector<double> ns;
+	int peakCached = 0;
+};
+
+/** A module in one poly mode, driven directly */
+struct Fixture {
+	SuperMIDI64 *m;
+	bool mpe;
+
+	Fixture(int mode, int outs, int per) {
+		m = new SuperMIDI64;
+		m->polyModeIx = mode;
+		m->MPEmode = (mode < SuperMIDI64::ROTATE_MODE);
+		mpe = m->MPEmode;
+		m->numVOout = outs;
+		m->numVOper = per;
+		m->numVo = outs * per;
+		m->onAdd();
+	}
+	~Fixture() {
+		delete m;
+	}
+	/** MPE voices live on member channels 2 ~ 16 */
+	uint8_t channel(int i) const {
+		return mpe ? static_cast<uint8_t>(1 + (i % 15)) : 0;
+	}
+	void holdAll() {
+		for (int i = 0; i < m->numVo; i++) {
+			m->notes[i] = static_cast<uint8_t>(i);
+			m->gates[i] = true;
+		}
+	}
+	int cached() const {
+		int n = static_cast<int>(m->cachedNotes.size());
+		for (int c = 0; c < 16; c++)
+			n += static_cast<int>(m->cachedMPE[c].size());
+		return n;
+	}
+};
+
+static double timerCost = 0.0;
+
+/** Times f() alone, into s */
+template <class F>
+inline void timed(Series &s, F f) {
+	int64_t start = harness::nowNs();
+	f();
+	int64_t end = harness::nowNs();
+	s.ns.push_back(static_cast<double>(end - start) - timerCost);
+}
+
+static void calibrate() {
+	std::vector<double> empty;
+	for (int i = 0; i < 100000; i++) {
+		int64_t start = harness::nowNs();
+		int64_t end = harness::nowNs();
+		empty.push_back(static_cast<double>(end - start));
+	}
+	std::sort(empty.begin(), empty.end());
+	timerCost = harness::percentile(empty, 0.5);
+}
+
+struct Setup {
+	int mode;
+	int outs;
+	int per;
+	int events;
+};
+
+/** A benchmark fills one or more named series, "<function>/<pattern>" */
+struct Benchmark {
+	const char *pattern;
+	const char *help;
+	bool (*applies)(int mode);
+	void (*run)(const Setup &ctx, std::map<std::string, Series> &out);
+};
+///////////////////////////////////////////////////////////////////////////////////////
+static bool anyMode(int mode) {return true;}
+static bool rotating(int mode) {return (mode >= SuperMIDI64::ROTATE_MODE) && (mode <= SuperMIDI64::REASSIGN_MODE);}
+static bool rotateOut(int mode) {return mode == SuperMIDI64::ROTATE_OUT_MODE;}
+
+/** Every voice gated, so each call scans them all and steals; the stolen note goes to
+cachedNotes, trimmed (untimed) so the vector doesn't dominate */
+static void fullScan(const Setup &ctx, std::map<std::string, Series> &out) {
+	Fixture f(ctx.mode, ctx.outs, ctx.per);
+	f.holdAll();
+	bool alt = rotateOut(ctx.mode);
+	Series &s = out[alt ? "getAltPolyIndex/full" : "getPolyIndex/full"];
+	for (int e = 0; e < ctx.events; e++) {
+		timed(s, [&]() {f.m->rotateIndex = alt ? f.m->getAltPolyIndex(f.m->rotateIndex) : f.m->getPolyIndex(f.m->rotateIndex);});
+		s.peakCached = std::max(s.peakCached, f.cached());
+		if (f.m->cachedNotes.size() > 4096) f.m->cachedNotes.clear();
+	}
+}
+
+/** One free voice, moved each call to just behind the rotation : the longest scan
+that still finds a voice */
+static void lastFree(const Setup &ctx, std::map<std::string, Series> &out) {
+	Fixture f(ctx.mode, ctx.outs, ctx.per);
+	f.holdAll();
+	bool alt = rotateOut(ctx.mode);
+	Series &s = out[alt ? "getAltPolyIndex/lastfree" : "getPolyIndex/lastfree"];
+	for (int e = 0; e < ctx.events; e++) {
+		int before = f.m->rotateIndex;
+		if (before < 0) before = 0;
+		f.m->gates[before] = false;
+		timed(s, [&]() {f.m->rotateIndex = alt ? f.m->getAltPolyIndex(f.m->rotateIndex) : f.m->getPolyIndex(f.m->rotateIndex);});
+		f.m->gates[before] = true;
+	}
+}
+
+/** Steal storm : all voices held, then a stream of new notes that each steal one,
+released in bursts of 512 */
+static void stealStorm(const Setup &ctx, std::map<std::string, Series> &out) {
+	Fixture f(ctx.mode, ctx.outs, ctx.per);
+	Series &press = out["pressNote/steal"];
+	Series &release = out["releaseNote/steal"];
+	for (int i = 0; i < f.m->numVo; i++)
+		f.m->pressNote(f.channel(i), static_cast<uint8_t>(i % 128), 100);
+	std::vector<std::pair<uint8_t, uint8_t>> held;
+	int note = 0;
+	for (int e = 0; e < ctx.events; e++) {
+		uint8_t ch = f.channel(e);
+		uint8_t n = static_cast<uint8_t>(note++ % 128);
+		timed(press, [&]() {f.m->pressNote(ch, n, 100);});
+		held.push_back(std::make_pair(ch, n));
+		press.peakCached = std::max(press.peakCached, f.cached());
+		if (held.size() == 512) {
+			for (const std::pair<uint8_t, uint8_t> &h : held)
+				timed(release, [&]() {f.m->releaseNote(h.first, h.second, 64);});
+			release.peakCached = press.peakCached;
+			held.clear();
+		}
+	}
+}
+
+/** Long sustain hold : pedal down, 1024 notes under it with 96 keys down at a time
+(voices stay pedal-held, so every press steals and cachedNotes grows), pedal up */
+static void pedalHold(const Setup &ctx, std::map<std::string, Series> &out) {
+	Fixture f(ctx.mode, ctx.outs, ctx.per);
+	Series &down = out["pressPedal/hold"];
+	Series &up = out["releasePedal/hold"];
+	Series &press = out["pressNote/pedal"];
+	Series &release = out["releaseNote/pedal"];
+	int e = 0;
+	while (e < ctx.events) {
+		for (int i = 0; i < f.m->numVo / 2; i++)
+			f.m->pressNote(f.channel(i), static_cast<uint8_t>(i), 100);
+		timed(down, [&]() {f.m->pressPedal();});
+		int i = 0;
+		for (; (i < 1024) && (e < ctx.events); i++, e++) {
+			uint8_t ch = f.channel(i);
+			uint8_t n = static_cast<uint8_t>(32 + (i * 7) % 96);
+			timed(press, [&]() {f.m->pressNote(ch, n, 100);});
+			if (i >= 96) {
+				uint8_t offCh = f.channel(i - 96);
+				uint8_t offNote = static_cast<uint8_t>(32 + ((i - 96) * 7) % 96);
+				timed(release, [&]() {f.m->releaseNote(offCh, offNote, 64);});
+			}
+			press.peakCached = std::max(press.peakCached, f.cached());
+		}
+		timed(up, [&]() {f.m->releasePedal();});
+		down.peakCached = up.peakCached = release.peakCached = press.peakCached;
+		for (int k = std::max(0, i - 96); k < i; k++)
+			f.m->releaseNote(f.channel(k), static_cast<uint8_t>(32 + (k * 7) % 96), 64);
+		for (int k = 0; k < f.m->numVo / 2; k++)
+			f.m->releaseNote(f.channel(k), static_cast<uint8_t>(k), 64);
+		f.m->cachedNotes.clear();
+		for (int c = 0; c < 16; c++)
+			f.m->cachedMPE[c].clear();
+	}
+}
+
+/** Rapid repeated notes : the same key struck 8 times before its note-offs arrive */
+static void repeated(const Setup &ctx, std::map<std::string, Series> &out) {
+	Fixture f(ctx.mode, ctx.outs, ctx.per);
+	Series &press = out["pressNote/repeat"];
+	Series &release = out["releaseNote/repeat"];
+	uint8_t ch = f.channel(0);
+	for (int e = 0; e < ctx.events; e += 8) {
+		for (int i = 0; i < 8; i++)
+			timed(press, [&]() {f.m->pressNote(ch, 60, 100);});
+		press.peakCached = std::max(press.peakCached, f.cached());
+		for (int i = 0; i < 8; i++)
+			timed(release, [&]() {f.m->releaseNote(ch, 60, 64);});
+		release.peakCached = press.peakCached;
+	}
+}
+
+static const Benchmark BENCHMARKS[] = {
+	{"full", "get(Alt)PolyIndex with every voice gated (steal)", rotating, fullScan},
+	{"lastfree", "get(Alt)PolyIndex with one free voice behind the rotation", rotating, lastFree},
+	{"steal", "press/releaseNote, every note steals a voice", anyMode, stealStorm},
+	{"pedal", "press/releasePedal around 1024 notes, 96 keys down, under the pedal", anyMode, pedalHold},
+	{"repeat", "press/releaseNote, the same key 8 times", anyMode, repeated},
+};
+///////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+	std::vector<std::string> filters;
+	std::vector<int> modes;
+	int outs = 4, per = 16;
+	int events = 100000;
+	unsigned seed = 1;
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if ((a == "-f" || a == "--filter") && hasValue) filters.push_back(argv[++i]);
+		else if ((a == "-p" || a == "--mode") && hasValue) {
+			for (const std::string &m : harness::split(argv[++i])) {
+				int mode = std::find(MODES.begin(), MODES.end(), m) - MODES.begin();
+				if (mode == static_cast<int>(MODES.size())) {
+					std::fprintf(stderr, "unknown poly mode %s\n", m.c_str());
+					return 1;
+				}
+				modes.push_back(mode);
+			}
+		}
+		else if ((a == "-l" || a == "--layout") && hasValue) {
+			if ((std::sscanf(argv[++i], "%dx%d", &outs, &per) != 2) || (outs < 1) || (outs > 4) || (per < 1) || (per > 16)) {
+				std::fprintf(stderr, "bad layout, 1~4 outputs x 1~16 voices\n");
+				return 1;
+			}
+		}
+		else if ((a == "-e" || a == "--events") && hasValue) events = std::max(8, std::atoi(argv[++i]));
+		else if (a == "--seed" && hasValue) seed = std::strtoul(argv[++i], NULL, 10);
+		else if (a == "--list") {
+			for (const Benchmark &b : BENCHMARKS)
+				std::printf("%-10s %s\n", b.pattern, b.help);
+			return 0;
+		}
+		else {
+			std::fputs(USAGE, stderr);
+			return 1;
+		}
+	}
+	if (modes.empty())
+		for (int m = 0; m < static_cast<int>(MODES.size()); m++) modes.push_back(m);
+	harness::init(48000.f);
+	calibrate();
+	std::printf("stopwatch cost %.1f ns (subtracted), layout %dx%d, %d events\n\n", timerCost, outs, per, events);
+	std::printf("%-36s %9s %9s %9s %9s %9s %7s\n", "benchmark", "events", "best", "mean", "p99", "worst", "cached");
+
+	for (int mode : modes) {
+		for (const Benchmark &b : BENCHMARKS) {
+			if (!b.applies(mode)) continue;
+			if (rotateOut(mode) && (outs < 2)) continue;// the module falls back to rotate
+			std::srand(seed);
+			Setup ctx = {mode, outs, per, events};
+			std::map<std::string, Series> out;
+			b.run(ctx, out);
+			for (std::pair<const std::string, Series> &kv : out) {
+				std::string name = kv.first + "/" + MODES[mode];
+				bool wanted = filters.empty();
+				for (const std::string &f : filters)
+					wanted |= (name.find(f) != std::string::npos);
+				if (!wanted || kv.second.ns.empty()) continue;
+				std::vector<double> &ns = kv.second.ns;
+				double total = 0.0;
+				for (double t : ns) total += t;
+				std::sort(ns.begin(), ns.end());
+				std::printf("%-36s %9d %9.1f %9.1f %9.1f %9.1f %7d\n", name.c_str(), static_cast<int>(ns.size()),
+					std::max(0.0, ns.front()), std::max(0.0, total / ns.size()), std::max(0.0, harness::percentile(ns, 0.99)), ns.back(), kv.second.peakCached);
+			}
+			std::fflush(stdout);
+		}
+	}
+	return 0;
+}
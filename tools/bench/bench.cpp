@@ -0,0 +1,203 @@
+/*
+bench.cpp : SuperMIDI64::process throughput, per workload, sample rate, poly mode
+and output layout
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "workload.hpp"
+#include <pthread.h>
+#include <sched.h>
+
+static const std::vector<std::string> &MODES = harness::polyModes("SuperMIDI64");
+static const int ROTATE_OUT_MODE = 3;
+
+static const char *USAGE =
+"usage: bench [options]\n"
+"  -w, --workload LIST   comma separated, default all:\n"
+"%s"
+"  -r, --rate LIST       sample rates, default 44100,48000,96000,192000\n"
+"  -p, --mode LIST       poly modes, default all:\n"
+"                        mpe mpe+ rotate rotateout reuse reset reassign unison unisonlwr unisonupr\n"
+"  -l, --layout LIST     outputs x voices per output, default 1x16,2x8,4x4,4x16\n"
+"  -d, --seconds SEC     audio per timed pass, default 0.5\n"
+"  -n, --repeats N       timed passes, the median is reported, default 5\n"
+"      --seed N          workload and rand() seed, default 1\n"
+"      --cpu N           pin to this core\n"
+"      --csv FILE        also write the results as CSV\n"
+"Every pass replays the same script from srand(seed), after one untimed warm-up pass.\n"
+"Built with `make AUDIT=1`, also counts allocations and locks in process() per run\n"
+"(timings are then meaningless) and prints each one's backtrace at the end.\n";
+
+struct Options {
+	std::vector<std::string> workloads;
+	std::vector<float> rates;
+	std::vector<int> modes;
+	std::vector<std::pair<int, int>> layouts;
+	float seconds = 0.5f;
+	int repeats = 5;
+	uint32_t seed = 1;
+	int cpu = -1;
+	std::string csv;
+};
+
+struct Result {
+	std::string workload;
+	float rate;
+	int mode;
+	std::pair<int, int> layout;
+	double medianNs;
+	double bestNs;
+	double worstNs;
+	int64_t violations;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////
+/** ns per sample for one pass of the script, MIDI sends included (a ring push each) */
+static double runPass(harness::Rig &rig, const harness::Script &script, uint32_t seed) {
+	std::srand(seed);// note drift draws from rand()
+	size_t cursor = 0;
+	int64_t start = harness::nowNs();
+	for (int64_t frame = 0; frame < script.frames; frame++) {
+		script.sendFrame(rig, frame, cursor);
+		rig.process();
+	}
+	return static_cast<double>(harness::nowNs() - start) / script.frames;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static Result bench(const Options &opt, const std::string &workload, float rate, int mode, std::pair<int, int> layout) {
+	harness::init(rate);
+	harness::Script script;
+	harness::makeWorkload(script, workload, rate, opt.seconds, opt.seed);
+	json_t *configJ = json_object();
+	harness::setPolyMode(configJ, "SuperMIDI64", mode);
+	json_object_set_new(configJ, "numVOout", json_integer(layout.first));
+	json_object_set_new(configJ, "numVOper", json_integer(layout.second));
+	json_object_set_new(configJ, "numVo", json_integer(layout.first * layout.second));
+	harness::Rig rig("SuperMIDI64", 0, configJ);
+	json_decref(configJ);
+	rtaudit::session(string::f("%s %.0f %s %dx%d", workload.c_str(), rate, MODES[mode].c_str(), layout.first, layout.second));
+
+	runPass(rig, script, opt.seed);// warm-up : caches, branch history, first allocations
+	std::vector<double> passes;
+	for (int i = 0; i < opt.repeats; i++)
+		passes.push_back(runPass(rig, script, opt.seed));
+	std::sort(passes.begin(), passes.end());
+	Result r;
+	r.workload = workload;
+	r.rate = rate;
+	r.mode = mode;
+	r.layout = layout;
+	r.medianNs = harness::percentile(passes, 0.5);
+	r.bestNs = passes.front();
+	r.worstNs = passes.back();
+	r.violations = rtaudit::count();
+	return r;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if ((a == "-w" || a == "--workload") && hasValue) opt.workloads = harness::split(argv[++i]);
+		else if ((a == "-r" || a == "--rate") && hasValue) {
+			for (const std::string &r : harness::split(argv[++i]))
+				opt.rates.push_back(std::atof(r.c_str()));
+		}
+		else if ((a == "-p" || a == "--mode") && hasValue) {
+			for (const std::string &m : harness::split(argv[++i])) {
+				int mode = std::find(MODES.begin(), MODES.end(), m) - MODES.begin();
+				if (mode == static_cast<int>(MODES.size())) {
+					std::fprintf(stderr, "unknown poly mode %s\n", m.c_str());
+					return 1;
+				}
+				opt.modes.push_back(mode);
+			}
+		}
+		else if ((a == "-l" || a == "--layout") && hasValue) {
+			for (const std::string &l : harness::split(argv[++i])) {
+				int outs = 0, per = 0;
+				if ((std::sscanf(l.c_str(), "%dx%d", &outs, &per) != 2) || (outs < 1) || (outs > 4) || (per < 1) || (per > 16)) {
+					std::fprintf(stderr, "bad layout %s, 1~4 outputs x 1~16 voices\n", l.c_str());
+					return 1;
+				}
+				opt.layouts.push_back(std::make_pair(outs, per));
+			}
+		}
+		else if ((a == "-d" || a == "--seconds") && hasValue) opt.seconds = std::atof(argv[++i]);
+		else if ((a == "-n" || a == "--repeats") && hasValue) opt.repeats = std::max(1, std::atoi(argv[++i]));
+		else if (a == "--seed" && hasValue) opt.seed = std::strtoul(argv[++i], NULL, 10);
+		else if (a == "--cpu" && hasValue) opt.cpu = std::atoi(argv[++i]);
+		else if (a == "--csv" && hasValue) opt.csv = argv[++i];
+		else {
+			std::fprintf(stderr, USAGE, harness::workloadHelp().c_str());
+			return 1;
+		}
+	}
+	if (opt.workloads.empty()) opt.workloads = harness::workloadNames();
+	if (opt.rates.empty()) opt.rates = {44100.f, 48000.f, 96000.f, 192000.f};
+	if (opt.modes.empty())
+		for (int m = 0; m < static_cast<int>(MODES.size()); m++) opt.modes.push_back(m);
+	if (opt.layouts.empty()) opt.layouts = {{1, 16}, {2, 8}, {4, 4}, {4, 16}};
+	for (const std::string &w : opt.workloads) {
+		if (std::find(harness::workloadNames().begin(), harness::workloadNames().end(), w) == harness::workloadNames().end()) {
+			std::fprintf(stderr, "unknown workload %s\n", w.c_str());
+			return 1;
+		}
+	}
+	if (opt.cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(opt.cpu, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) std::fprintf(stderr, "can't pin to cpu %d\n", opt.cpu);
+	}
+
+	std::printf("%-9s %7s %-10s %-6s %10s %10s %10s %14s %9s%s\n", "workload", "rate", "mode", "layout", "ns/sample", "best", "worst", "samples/s", "realtime",
+		rtaudit::enabled ? "  rt-unsafe" : "");
+	std::vector<Result> results;
+	for (const std::string &workload : opt.workloads) {
+		for (float rate : opt.rates) {
+			for (int mode : opt.modes) {
+				for (std::pair<int, int> layout : opt.layouts) {
+					if ((mode == ROTATE_OUT_MODE) && (layout.first < 2)) continue;// the module falls back to rotate
+					Result r = bench(opt, workload, rate, mode, layout);
+					double perSecond = 1e9 / r.medianNs;
+					std::printf("%-9s %7.0f %-10s %dx%-4d %10.1f %10.1f %10.1f %14.0f %8.0fx", workload.c_str(), rate, MODES[mode].c_str(), layout.first, layout.second,
+						r.medianNs, r.bestNs, r.worstNs, perSecond, perSecond / rate);
+					if (rtaudit::enabled) std::printf("  %9lld", static_cast<long long>(r.violations));
+					std::printf("\n");
+					std::fflush(stdout);
+					results.push_back(r);
+				}
+			}
+		}
+	}
+
+	if (!opt.csv.empty()) {
+		FILE *file = std::fopen(opt.csv.c_str(), "w");
+		if (!file) {
+			std::fprintf(stderr, "can't write %s\n", opt.csv.c_str());
+			return 1;
+		}
+		std::fprintf(file, "workload,rate,mode,outputs,voicesPerOutput,nsPerSample,bestNs,worstNs,samplesPerSecond\n");
+		for (const Result &r : results)
+			std::fprintf(file, "%s,%.0f,%s,%d,%d,%.2f,%.2f,%.2f,%.0f\n", r.workload.c_str(), r.rate, MODES[r.mode].c_str(), r.layout.first, r.layout.second,
+				r.medianNs, r.bestNs, r.worstNs, 1e9 / r.medianNs);
+		std::fclose(file);
+	}
+	rtaudit::report(stdout);
+	return 0;
+}
@@ -0,0 +1,305 @@
+/*
+fuzz.cpp : fuzzes SuperMIDI64::processMessage and DuoMIDI_CV::processMessage, with
+invariants and fixed bounds on per-message cost and cached notes
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "fuzz.hpp"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <random>
+
+/** Input layout :
+  byte 0     module (bit 0) and poly mode (the rest, modulo the module's modes)
+  byte 1     Super MIDI 64 : outputs (bits 0-1) x voices per output (bits 2-5)
+             Duo MIDI-CV : channels 1 (bits 0-3), channels 2 (bits 4-7, 0 ~ 15)
+  byte 2     Super MIDI 64 buttons : SUSTAIN HOLD, RETRIG, BEND PITCH (bits 0-2)
+  then       0x80 ~ 0xff : a status byte and the data bytes it takes, masked to 7 bits
+             0x00 ~ 0x7f : run process() for (byte + 1) samples
+*/
+namespace {
+
+const int HEADER = 3;
+const int SUSTHOLD_PARAM = 2;
+const int RETRIG_PARAM = 3;
+const int BENDPITCH_PARAM = 5;
+
+int64_t maxMessageNs = 1000000;// FUZZ_MAX_MESSAGE_US
+
+int dataBytes(uint8_t status) {
+	switch (status >> 4) {
+		case 0xc:
+		case 0xd: return 1;
+		case 0xf: return (status == 0xf2) ? 2 : (((status == 0xf1) || (status == 0xf3)) ? 1 : 0);
+		default: return 2;
+	}
+}
+
+std::string hex(const midi::Message &msg) {
+	std::string text;
+	for (int b = 0; b < msg.size; b++)
+		text += string::f("%s%02x", b ? " " : "", msg.bytes[b]);
+	return text;
+}
+
+/** The rig a header asks for */
+harness::Rig *makeRig(const uint8_t *data) {
+	std::string slug = (data[0] & 1) ? "DuoMIDI_CV" : "SuperMIDI64";
+	const std::vector<std::string> &modes = harness::polyModes(slug);
+	json_t *configJ = json_object();
+	harness::setPolyMode(configJ, slug, (data[0] >> 1) % modes.size());
+	if (slug == "SuperMIDI64") {
+		int outs = 1 + (data[1] & 3);
+		int per = 1 + ((data[1] >> 2) & 15);
+		json_object_set_new(configJ, "numVOout", json_integer(outs));
+		json_object_set_new(configJ, "numVOper", json_integer(per));
+		json_object_set_new(configJ, "numVo", json_integer(outs * per));
+	}
+	else {
+		json_object_set_new(configJ, "channels 1", json_integer(1 + (data[1] & 15)));
+		json_object_set_new(configJ, "channels 2", json_integer(data[1] >> 4));
+		json_object_set_new(configJ, "mpeMode", json_integer((data[0] >> 5) & 3));
+	}
+	harness::Rig *rig = new harness::Rig(slug, 0, configJ);
+	json_decref(configJ);
+	if (slug == "SuperMIDI64") {
+		rig->module->params[SUSTHOLD_PARAM].setValue(data[2] & 1);
+		rig->module->params[RETRIG_PARAM].setValue((data[2] >> 1) & 1);
+		rig->module->params[BENDPITCH_PARAM].setValue((data[2] >> 2) & 1);
+	}
+	return rig;
+}
+
+std::string outputInvariants(harness::Rig &rig) {
+	for (int o = 0; o < rig.numOutputs(); o++) {
+		const engine::Output &out = rig.module->outputs[o];
+		if ((out.channels < 0) || (out.channels > 16)) return string::f("%s has %d channels", rig.outputName(o).c_str(), out.channels);
+		for (int c = 0; c < out.channels; c++)
+			if (!std::isfinite(out.voltages[c])) return string::f("%s[%d] is %f", rig.outputName(o).c_str(), c + 1, out.voltages[c]);
+	}
+	return "";
+}
+
+}
+///////////////////////////////////////////////////////////////////////////////////////
+/** Plays one input, "" when every invariant held, else what broke and where. slow
+is set when the failure is the time bound */
+static std::string play(const uint8_t *data, size_t size, bool &slow) {
+	slow = false;
+	if (size < HEADER) return "";
+	harness::init(48000.f);
+	harness::Rig *rig = makeRig(data);
+	bool super = (rig->model->slug == "SuperMIDI64");
+	std::srand(1);// note drift
+	std::string error;
+	int messages = 0;
+	for (size_t i = HEADER; (i < size) && error.empty(); ) {
+		if (data[i] < 0x80) {
+			for (int s = 0; (s <= data[i]) && error.empty(); s++) {
+				rig->process();
+				error = outputInvariants(*rig);
+			}
+			if (!error.empty()) error = string::f("after message %d, processing: %s", messages, error.c_str());
+			i++;
+			continue;
+		}
+		midi::Message msg;
+		msg.bytes[0] = data[i];
+		int n = dataBytes(data[i]);
+		if (i + n >= size) break;
+		for (int b = 1; b <= n; b++)
+			msg.bytes[b] = data[i + b] & 0x7f;
+		msg.size = n + 1;
+		i += n + 1;
+		int64_t start = harness::nowNs();
+		if (super) fuzz::superMessage(rig->module, msg);
+		else fuzz::duoMessage(rig->module, msg);
+		int64_t ns = harness::nowNs() - start;
+		messages++;
+		slow = (ns > maxMessageNs);
+		if (slow) error = string::f("took %.0f us", ns / 1000.0);
+		else error = super ? fuzz::superInvariants(rig->module) : fuzz::duoInvariants(rig->module);
+		if (!error.empty()) error = string::f("message %d [%s]: %s", messages, hex(msg).c_str(), error.c_str());
+	}
+	if (!error.empty()) {
+		const std::vector<std::string> &modes = harness::polyModes(rig->model->slug);
+		error = string::f("%s %s : %s", rig->model->slug.c_str(), modes[(data[0] >> 1) % modes.size()].c_str(), error.c_str());
+	}
+	delete rig;
+	return error;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+/** A message over the time bound counts only if it is slow on two more replays, a
+preemption or page fault doesn't repeat */
+static std::string run(const uint8_t *data, size_t size) {
+	bool slow;
+	std::string error = play(data, size, slow);
+	for (int replay = 0; slow && (replay < 2); replay++) {
+		std::string again = play(data, size, slow);
+		if (!slow) return again;
+	}
+	return error;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv) {
+	if (const char *us = std::getenv("FUZZ_MAX_MESSAGE_US")) maxMessageNs = std::atoll(us) * 1000;
+	return 0;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	std::string error = run(data, size);
+	if (!error.empty()) {
+		std::fprintf(stderr, "invariant failed: %s\n", error.c_str());
+		std::abort();// libFuzzer saves the input
+	}
+	return 0;
+}
+
+#ifndef LIBFUZZER
+///////////////////////////////////////////////////////////////////////////////////////
+// Stand-in driver for builds without libFuzzer (gcc) : replays files and directories
+// given on the command line, then runs -runs=N generated inputs. Failing inputs are
+// written to crash-<n> files, replayable by either build
+
+static const char *USAGE =
+"usage: fuzz [-runs=N] [-seed=N] [-max_len=N] [file or dir...]\n"
+"Replays the given inputs, then N generated ones (default 10000, -runs=0 to only\n"
+"replay). Limits: FUZZ_MAX_MESSAGE_US per message (default 1000), %d cached\n"
+"notes. Failing inputs are written to crash-<n>.\n";
+
+/** MIDI-shaped input : mostly notes on a few keys and channels, with pedals, bends,
+pressure, CCs, clock, stray data bytes and process runs mixed in */
+static std::vector<uint8_t> generate(std::mt19937 &rng, size_t maxLen) {
+	std::vector<uint8_t> in;
+	for (int i = 0; i < HEADER; i++)
+		in.push_back(rng() & 0xff);
+	int keys = 1 + rng() % 128;
+	int channels = 1 + rng() % 16;
+	size_t len = HEADER + rng() % (maxLen - HEADER + 1);
+	while (in.size() < len) {
+		uint8_t channel = rng() % channels;
+		switch (rng() % 12) {
+			case 0: case 1: case 2: case 3:
+				in.push_back(0x90 | channel);
+				in.push_back(rng() % keys);
+				in.push_back(rng() % 128);
+				break;
+			case 4: case 5:
+				in.push_back(0x80 | channel);
+				in.push_back(rng() % keys);
+				in.push_back(rng() % 128);
+				break;
+			case 6:
+				in.push_back(0xb0 | channel);
+				in.push_back((rng() & 1) ? 64 : rng() % 128);
+				in.push_back((rng() & 1) ? 127 * (rng() & 1) : rng() % 128);
+				break;
+			case 7:
+				in.push_back(0xe0 | channel);
+				in.push_back(rng() % 128);
+				in.push_back(rng() % 128);
+				break;
+			case 8:
+				in.push_back(((rng() & 1) ? 0xd0 : 0xa0) | channel);
+				in.push_back(rng() % 128);
+				in.push_back(rng() % 128);
+				break;
+			case 9:
+				in.push_back(0xf0 | (rng() % 16));
+				break;
+			case 10:
+				in.push_back(rng() % 256);
+				break;
+			default:
+				in.push_back(rng() % 16);// a short process run
+				break;
+		}
+	}
+	in.resize(len);
+	return in;
+}
+
+static std::vector<uint8_t> readFile(const std::string &path) {
+	std::vector<uint8_t> in;
+	FILE *file = std::fopen(path.c_str(), "rb");
+	if (!file) return in;
+	uint8_t buffer[4096];
+	size_t n;
+	while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+		in.insert(in.end(), buffer, buffer + n);
+	std::fclose(file);
+	return in;
+}
+
+static void listInputs(const std::string &path, std::vector<std::string> &files) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return;
+	if (!S_ISDIR(st.st_mode)) {
+		files.push_back(path);
+		return;
+	}
+	DIR *d = opendir(path.c_str());
+	if (!d) return;
+	while (struct dirent *entry = readdir(d)) {
+		if (entry->d_name[0] != '.') files.push_back(path + "/" + entry->d_name);
+	}
+	closedir(d);
+	std::sort(files.begin(), files.end());
+}
+
+int main(int argc, char **argv) {
+	LLVMFuzzerInitialize(&argc, &argv);
+	int64_t runs = 10000;
+	uint32_t seed = 1;
+	size_t maxLen = 512;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		if (a.compare(0, 6, "-runs=") == 0) runs = std::atoll(a.c_str() + 6);
+		else if (a.compare(0, 6, "-seed=") == 0) seed = std::strtoul(a.c_str() + 6, NULL, 10);
+		else if (a.compare(0, 9, "-max_len=") == 0) maxLen = std::max(HEADER + 1, std::atoi(a.c_str() + 9));
+		else if (a[0] == '-') {
+			std::fprintf(stderr, USAGE, static_cast<int>(fuzz::MAX_CACHED_NOTES));
+			return 1;
+		}
+		else listInputs(a, files);
+	}
+	int failed = 0;
+	for (const std::string &file : files) {
+		std::vector<uint8_t> in = readFile(file);
+		std::string error = run(in.data(), in.size());
+		if (error.empty()) continue;
+		std::printf("%s: %s\n", file.c_str(), error.c_str());
+		failed++;
+	}
+	std::mt19937 rng(seed);
+	for (int64_t r = 0; r < runs; r++) {
+		std::vector<uint8_t> in = generate(rng, maxLen);
+		std::string error = run(in.data(), in.size());
+		if (error.empty()) continue;
+		std::string path = string::f("crash-%d", failed);
+		FILE *file = std::fopen(path.c_str(), "wb");
+		if (file) {
+			std::fwrite(in.data(), 1, in.size(), file);
+			std::fclose(file);
+		}
+		std::printf("run %lld: %s\n  input written to %s\n", static_cast<long long>(r), error.c_str(), path.c_str());
+		failed++;
+	}
+	std::printf("%d inputs replayed, %lld generated, %d failed\n", static_cast<int>(files.size()), static_cast<long long>(runs), failed);
+	return failed ? 1 : 0;
+}
+#endif
@@ -0,0 +1,35 @@
+/*
+fuzz.hpp : hooks into the modules' internals for the processMessage fuzzer
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "harness.hpp"
+
+namespace fuzz {
+
+/** Fixed bounds : a module state past any of them is reported as a failure */
+static const size_t MAX_CACHED_NOTES = 128;// one per key, stolen or held
+static const size_t MAX_HELD_NOTES = 128;
+
+/** Built around each module's own .cpp, where the module struct lives. The message
+goes straight to processMessage(), the invariants return "" or what is wrong */
+void superMessage(Module *module, const midi::Message &msg);
+std::string superInvariants(Module *module);
+void duoMessage(Module *module, const midi::Message &msg);
+std::string duoInvariants(Module *module);
+
+}
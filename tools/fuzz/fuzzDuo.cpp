@@ -0,0 +1,41 @@
+/*
+fuzzDuo.cpp : Duo MIDI-CV side of the processMessage fuzzer
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+// the module struct lives in its translation unit, this one is built in place of DuoMIDI_CV.o
+#include "DuoMIDI_CV.cpp"
+#include "fuzz.hpp"
+
+namespace fuzz {
+
+void duoMessage(Module *module, const midi::Message &msg) {
+	static_cast<DuoMIDI_CV*>(module)->processMessage(msg);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+std::string duoInvariants(Module *module) {
+	DuoMIDI_CV *m = static_cast<DuoMIDI_CV*>(module);
+	if (m->heldNotes.size() > MAX_HELD_NOTES) return string::f("heldNotes holds %d notes", static_cast<int>(m->heldNotes.size()));
+	int voices = 16 + m->channels2;
+	if ((m->rotateIndex < -1) || (m->rotateIndex >= voices)) return string::f("rotateIndex %d of %d channels", m->rotateIndex, voices);
+	for (int c = 0; c < 32; c++) {
+		if (m->notes[c] > 127) return string::f("channel %d plays note %d", c, m->notes[c]);
+		if (m->bends[c] > 16383) return string::f("channel %d bend %d", c, m->bends[c]);
+	}
+	return "";
+}
+
+}
@@ -0,0 +1,47 @@
+/*
+fuzzSuper.cpp : Super MIDI 64 side of the processMessage fuzzer
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+// the module struct lives in its translation unit, this one is built in place of SuperMIDI64.o
+#include "SuperMIDI64.cpp"
+#include "fuzz.hpp"
+
+namespace fuzz {
+
+void superMessage(Module *module, const midi::Message &msg) {
+	static_cast<SuperMIDI64*>(module)->processMessage(msg);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+std::string superInvariants(Module *module) {
+	SuperMIDI64 *m = static_cast<SuperMIDI64*>(module);
+	if (m->cachedNotes.size() > MAX_CACHED_NOTES) return string::f("cachedNotes holds %d notes", static_cast<int>(m->cachedNotes.size()));
+	for (uint8_t note : m->cachedNotes)
+		if (note > 127) return string::f("cachedNotes holds note %d", note);
+	for (int c = 0; c < 16; c++)
+		if (m->cachedMPE[c].size() > MAX_CACHED_NOTES) return string::f("cachedMPE[%d] holds %d notes", c, static_cast<int>(m->cachedMPE[c].size()));
+	if ((m->numVo < 1) || (m->numVo > SuperMIDI64::MAX_VOICES)) return string::f("numVo %d", m->numVo);
+	int voices = m->MPEmode ? 16 : m->numVo;// MPE : a voice per member channel
+	if ((m->rotateIndex < -m->numVOper) || (m->rotateIndex >= voices)) return string::f("rotateIndex %d of %d voices", m->rotateIndex, voices);
+	if ((m->stealIndex < 0) || (m->stealIndex >= voices)) return string::f("stealIndex %d of %d voices", m->stealIndex, voices);
+	for (int i = 0; i < SuperMIDI64::MAX_VOICES; i++) {
+		if (m->notes[i] > 127) return string::f("voice %d plays note %d", i, m->notes[i]);
+		if ((i >= voices) && (m->gates[i] || m->pedalgates[i])) return string::f("gate on voice %d of %d", i, voices);
+	}
+	return "";
+}
+
+}
@@ -0,0 +1,432 @@
+/*
+golden.cpp : replays a corpus of MIDI scenarios through the modules and compares every
+output channel, sample by sample and bit for bit, with stored golden files
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "workload.hpp"
+#include <dirent.h>
+#include <array>
+
+static const char *USAGE =
+"usage: golden [check|update|list] [options] [scenario...]\n"
+"  check                 compare against the golden files (default)\n"
+"  update                rewrite the golden files from the current build\n"
+"  list                  print the scenarios\n"
+"      --corpus DIR      scenario .json files, default golden/scenarios\n"
+"      --expected DIR    golden files, default golden/expected\n"
+"      --max-diffs N     differences printed per scenario, default 12\n"
+"Scenarios are named by file name, plus /name for files holding several.\n";
+
+static const int MAX_CHANNELS = 16;
+
+/** One scenario from the corpus */
+struct Scenario {
+	std::string name;
+	std::string module;
+	json_t *config = NULL;
+	std::vector<std::pair<int, float>> params;// [id, value]
+	float sampleRate = 48000.f;
+	float seconds = 0.25f;
+	uint32_t seed = 1;
+	harness::Script script;
+
+	~Scenario() {
+		if (config) json_decref(config);
+	}
+};
+
+/** Output state, every channel's float bits plus the channel count in slot 16 */
+struct Frame {
+	std::vector<std::array<uint32_t, MAX_CHANNELS + 1>> outputs;
+};
+
+/** Golden file : a change record each time an output channel (or channel count,
+written as channel -1) differs from the frame before. All start at 0, 1 channel.
+Records are grouped under "@frame" lines, and a channel that also changed on the
+frame before is written as the difference of its float bits, so the smoothing
+filters' slow tails stay small */
+struct Change {
+	int64_t frame;
+	int output;
+	int channel;
+	uint32_t bits;
+};
+///////////////////////////////////////////////////////////////////////////////////////
+static uint32_t floatBits(float f) {
+	uint32_t bits;
+	std::memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+static float bitsFloat(uint32_t bits) {
+	float f;
+	std::memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static bool parseMessage(const char *text, midi::Message &msg) {
+	msg.size = 0;
+	const char *p = text;
+	while (*p) {
+		char *end;
+		long byte = std::strtol(p, &end, 16);
+		if (end == p) break;
+		if ((byte < 0) || (byte > 0xff) || (msg.size >= 3)) return false;
+		msg.bytes[msg.size++] = static_cast<uint8_t>(byte);
+		p = end;
+	}
+	return msg.size > 0;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+/** events : [[ms, "90 3c 64"], ...] and/or a named workload. mode, if given, is
+set over the config's poly mode */
+static bool loadScenario(json_t *sJ, const std::string &name, const std::string &mode, Scenario &s, std::string &error) {
+	s.name = name;
+	json_t *moduleJ = json_object_get(sJ, "module");
+	s.module = moduleJ ? json_string_value(moduleJ) : "SuperMIDI64";
+	json_t *configJ = json_object_get(sJ, "config");
+	s.config = configJ ? json_deep_copy(configJ) : json_object();
+	if (!mode.empty()) {
+		const std::vector<std::string> &modes = harness::polyModes(s.module);
+		int ix = std::find(modes.begin(), modes.end(), mode) - modes.begin();
+		if (ix == static_cast<int>(modes.size())) {
+			error = "unknown poly mode " + mode;
+			return false;
+		}
+		harness::setPolyMode(s.config, s.module, ix);
+	}
+	json_t *rateJ = json_object_get(sJ, "rate");
+	if (rateJ) s.sampleRate = json_number_value(rateJ);
+	json_t *secondsJ = json_object_get(sJ, "seconds");
+	if (secondsJ) s.seconds = json_number_value(secondsJ);
+	json_t *seedJ = json_object_get(sJ, "seed");
+	if (seedJ) s.seed = json_integer_value(seedJ);
+	json_t *paramsJ = json_object_get(sJ, "params");
+	size_t i;
+	json_t *itemJ;
+	json_array_foreach(paramsJ, i, itemJ) {
+		s.params.push_back(std::make_pair(static_cast<int>(json_integer_value(json_array_get(itemJ, 0))), static_cast<float>(json_number_value(json_array_get(itemJ, 1)))));
+	}
+	json_t *workloadJ = json_object_get(sJ, "workload");
+	if (workloadJ) {
+		if (!harness::makeWorkload(s.script, json_string_value(workloadJ), s.sampleRate, s.seconds, s.seed)) {
+			error = string::f("unknown workload %s", json_string_value(workloadJ));
+			return false;
+		}
+	}
+	json_t *eventsJ = json_object_get(sJ, "events");
+	json_array_foreach(eventsJ, i, itemJ) {
+		harness::Script::Event e;
+		double ms = json_number_value(json_array_get(itemJ, 0));
+		const char *text = json_string_value(json_array_get(itemJ, 1));
+		if (!text || !parseMessage(text, e.msg)) {
+			error = string::f("event %d: bad MIDI bytes", static_cast<int>(i));
+			return false;
+		}
+		e.frame = static_cast<int64_t>(ms * s.sampleRate / 1000.0 + 0.5);
+		s.script.events.push_back(e);
+	}
+	std::stable_sort(s.script.events.begin(), s.script.events.end(), [](const harness::Script::Event &a, const harness::Script::Event &b) {return a.frame < b.frame;});
+	s.script.frames = static_cast<int64_t>(s.seconds * s.sampleRate);
+	if (harness::polyModes(s.module).empty()) {
+		error = "unknown module " + s.module;
+		return false;
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+/** Every scenario in the corpus, sorted by name. A file holds one object or an array,
+and an object with "modes" : [...] is one scenario per poly mode */
+static bool loadCorpus(const std::string &dir, std::vector<Scenario*> &scenarios) {
+	DIR *d = opendir(dir.c_str());
+	if (!d) {
+		std::fprintf(stderr, "can't open corpus %s\n", dir.c_str());
+		return false;
+	}
+	std::vector<std::string> files;
+	while (struct dirent *entry = readdir(d)) {
+		std::string file = entry->d_name;
+		if ((file.size() > 5) && (file.compare(file.size() - 5, 5, ".json") == 0)) files.push_back(file);
+	}
+	closedir(d);
+	std::sort(files.begin(), files.end());
+	bool ok = true;
+	for (const std::string &file : files) {
+		json_t *rootJ = harness::loadJson(dir + "/" + file);
+		if (!rootJ) {
+			ok = false;
+			continue;
+		}
+		std::string base = file.substr(0, file.size() - 5);
+		std::vector<std::pair<json_t*, std::string>> items;
+		if (json_is_array(rootJ)) {
+			size_t i;
+			json_t *sJ;
+			json_array_foreach(rootJ, i, sJ) {
+				json_t *nameJ = json_object_get(sJ, "name");
+				items.push_back(std::make_pair(sJ, base + "/" + (nameJ ? json_string_value(nameJ) : string::f("%d", static_cast<int>(i)))));
+			}
+		}
+		else items.push_back(std::make_pair(rootJ, base));
+		for (const std::pair<json_t*, std::string> &item : items) {
+			std::vector<std::string> modes;
+			size_t i;
+			json_t *modesJ = json_object_get(item.first, "modes");
+			json_t *modeJ;
+			json_array_foreach(modesJ, i, modeJ) {
+				modes.push_back(json_string_value(modeJ));
+			}
+			if (modes.empty()) modes.push_back("");
+			for (const std::string &mode : modes) {
+				Scenario *s = new Scenario;
+				std::string error;
+				std::string name = item.second + (mode.empty() ? "" : "/" + mode);
+				if (!loadScenario(item.first, name, mode, *s, error)) {
+					std::fprintf(stderr, "%s: %s\n", name.c_str(), error.c_str());
+					delete s;
+					ok = false;
+					continue;
+				}
+				scenarios.push_back(s);
+			}
+		}
+		json_decref(rootJ);
+	}
+	return ok;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+/** Runs the scenario, calling onFrame(frame, state, rig) after each process() */
+template <class F>
+static void play(const Scenario &s, F onFrame) {
+	harness::init(s.sampleRate);
+	harness::Rig rig(s.module, 0, s.config);
+	for (const std::pair<int, float> &p : s.params)
+		if (p.first < static_cast<int>(rig.module->params.size())) rig.module->params[p.first].setValue(p.second);
+	std::srand(s.seed);// note drift draws from rand()
+	Frame state;
+	state.outputs.resize(rig.numOutputs());
+	size_t cursor = 0;
+	for (int64_t frame = 0; frame < s.script.frames; frame++) {
+		s.script.sendFrame(rig, frame, cursor);
+		rig.process();
+		for (int o = 0; o < rig.numOutputs(); o++) {
+			const engine::Output &out = rig.module->outputs[o];
+			for (int c = 0; c < MAX_CHANNELS; c++)
+				state.outputs[o][c] = (c < out.channels) ? floatBits(out.voltages[c]) : 0;
+			state.outputs[o][MAX_CHANNELS] = out.channels;
+		}
+		onFrame(frame, state, rig);
+	}
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static std::string goldenPath(const std::string &dir, const Scenario &s) {
+	std::string file = s.name;
+	std::replace(file.begin(), file.end(), '/', '.');
+	return dir + "/" + file + ".golden";
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static Frame initialFrame(int numOutputs) {
+	Frame f;
+	f.outputs.resize(numOutputs);
+	for (std::array<uint32_t, MAX_CHANNELS + 1> &o : f.outputs) {
+		o.fill(0);
+		o[MAX_CHANNELS] = 1;// the rig connects every output
+	}
+	return f;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static bool update(const Scenario &s, const std::string &dir) {
+	std::string path = goldenPath(dir, s);
+	FILE *file = std::fopen(path.c_str(), "w");
+	if (!file) {
+		std::fprintf(stderr, "can't write %s\n", path.c_str());
+		return false;
+	}
+	std::fprintf(file, "# golden 2 %s %s %.0f %lld\n", s.name.c_str(), s.module.c_str(), s.sampleRate, static_cast<long long>(s.script.frames));
+	std::fprintf(file, "# @frame, then output channel(-1 : count) float-bits, or +/- the last bits if it changed the frame before\n");
+	Frame last;
+	std::vector<std::array<int64_t, MAX_CHANNELS + 1>> lastFrame;
+	int changes = 0;
+	play(s, [&](int64_t frame, const Frame &state, harness::Rig &rig) {
+		if (last.outputs.empty()) {
+			last = initialFrame(rig.numOutputs());
+			lastFrame.resize(rig.numOutputs());
+			for (std::array<int64_t, MAX_CHANNELS + 1> &o : lastFrame)
+				o.fill(-2);
+		}
+		bool header = false;
+		for (int o = 0; o < rig.numOutputs(); o++) {
+			for (int c = 0; c <= MAX_CHANNELS; c++) {
+				uint32_t bits = state.outputs[o][c];
+				if (bits == last.outputs[o][c]) continue;
+				if (!header) std::fprintf(file, "@%lld\n", static_cast<long long>(frame));
+				header = true;
+				int channel = (c == MAX_CHANNELS) ? -1 : c;
+				int64_t step = static_cast<int64_t>(bits) - static_cast<int64_t>(last.outputs[o][c]);
+				if (lastFrame[o][c] == frame - 1) std::fprintf(file, "%d %d %+lld\n", o, channel, static_cast<long long>(step));
+				else std::fprintf(file, "%d %d %08x\n", o, channel, bits);
+				lastFrame[o][c] = frame;
+				changes++;
+			}
+		}
+		last = state;
+	});
+	std::fclose(file);
+	std::printf("%-40s %6d changes  %s\n", s.name.c_str(), changes, path.c_str());
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static bool readGolden(const std::string &path, std::vector<Change> &changes) {
+	FILE *file = std::fopen(path.c_str(), "r");
+	if (!file) return false;
+	std::map<std::pair<int, int>, uint32_t> last;
+	long long frame = 0;
+	char line[256];
+	while (std::fgets(line, sizeof(line), file)) {
+		if (line[0] == '#') continue;
+		if (line[0] == '@') {
+			frame = std::atoll(line + 1);
+			continue;
+		}
+		Change c;
+		char value[32];
+		if (std::sscanf(line, "%d %d %31s", &c.output, &c.channel, value) != 3) continue;
+		uint32_t &bits = last[std::make_pair(c.output, c.channel)];
+		if ((value[0] == '+') || (value[0] == '-')) bits += static_cast<uint32_t>(std::atoll(value));
+		else bits = static_cast<uint32_t>(std::strtoul(value, NULL, 16));
+		c.frame = frame;
+		c.bits = bits;
+		changes.push_back(c);
+	}
+	std::fclose(file);
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static std::string describe(uint32_t bits, bool count) {
+	if (count) return string::f("%u channels", bits);
+	return string::f("%+.6f (%08x)", bitsFloat(bits), bits);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+/** MIDI sent within a few ms before the frame, as context for a difference */
+static std::string recentMidi(const Scenario &s, int64_t frame) {
+	std::string text;
+	int64_t window = static_cast<int64_t>(s.sampleRate * 0.005f);
+	int shown = 0;
+	for (const harness::Script::Event &e : s.script.events) {
+		if (e.frame > frame) break;
+		if (e.frame < frame - window) continue;
+		if (shown++ == 6) {
+			text += " ...";
+			break;
+		}
+		text += string::f(" [%lld:", static_cast<long long>(e.frame));
+		for (int b = 0; b < e.msg.size; b++)
+			text += string::f(" %02x", e.msg.bytes[b]);
+		text += "]";
+	}
+	return text.empty() ? " (none)" : text;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static bool check(const Scenario &s, const std::string &dir, int maxDiffs) {
+	std::string path = goldenPath(dir, s);
+	std::vector<Change> changes;
+	if (!readGolden(path, changes)) {
+		std::printf("%-40s MISSING %s (run golden update)\n", s.name.c_str(), path.c_str());
+		return false;
+	}
+	Frame expected;
+	size_t cursor = 0;
+	int64_t diffs = 0;
+	int64_t firstFrame = -1;
+	std::map<std::string, int64_t> perOutput;
+	std::vector<std::string> lines;
+	play(s, [&](int64_t frame, const Frame &state, harness::Rig &rig) {
+		if (expected.outputs.empty()) expected = initialFrame(rig.numOutputs());
+		for (; (cursor < changes.size()) && (changes[cursor].frame == frame); cursor++) {
+			const Change &c = changes[cursor];
+			if (c.output < rig.numOutputs()) expected.outputs[c.output][(c.channel < 0) ? MAX_CHANNELS : c.channel] = c.bits;
+		}
+		for (int o = 0; o < rig.numOutputs(); o++) {
+			for (int c = 0; c <= MAX_CHANNELS; c++) {
+				uint32_t want = expected.outputs[o][c];
+				uint32_t got = state.outputs[o][c];
+				if (want == got) continue;
+				diffs++;
+				std::string where = rig.outputName(o) + ((c == MAX_CHANNELS) ? "" : string::f("[%d]", c + 1));
+				perOutput[rig.outputName(o)]++;
+				if (firstFrame < 0) firstFrame = frame;
+				if (static_cast<int>(lines.size()) < maxDiffs) {
+					bool count = (c == MAX_CHANNELS);
+					lines.push_back(string::f("    frame %lld (%.3f ms) %-14s expected %s got %s\n      midi:%s",
+						static_cast<long long>(frame), frame * 1000.0 / s.sampleRate, where.c_str(), describe(want, count).c_str(), describe(got, count).c_str(),
+						recentMidi(s, frame).c_str()));
+				}
+			}
+		}
+	});
+	if (diffs == 0) {
+		std::printf("%-40s ok\n", s.name.c_str());
+		return true;
+	}
+	std::printf("%-40s FAILED %lld differing samples from frame %lld\n", s.name.c_str(), static_cast<long long>(diffs), static_cast<long long>(firstFrame));
+	std::string summary;
+	for (const std::pair<const std::string, int64_t> &kv : perOutput)
+		summary += string::f(" %s:%lld", kv.first.c_str(), static_cast<long long>(kv.second));
+	std::printf("    by output:%s\n", summary.c_str());
+	for (const std::string &line : lines)
+		std::printf("%s\n", line.c_str());
+	if (diffs > static_cast<int64_t>(lines.size())) std::printf("    ...\n");
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+	std::string command = "check";
+	std::string corpus = "golden/scenarios";
+	std::string expected = "golden/expected";
+	int maxDiffs = 12;
+	std::vector<std::string> only;
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if ((a == "check") || (a == "update") || (a == "list")) command = a;
+		else if (a == "--corpus" && hasValue) corpus = argv[++i];
+		else if (a == "--expected" && hasValue) expected = argv[++i];
+		else if (a == "--max-diffs" && hasValue) maxDiffs = std::atoi(argv[++i]);
+		else if (!a.empty() && a[0] == '-') {
+			std::fputs(USAGE, stderr);
+			return 1;
+		}
+		else only.push_back(a);
+	}
+	std::vector<Scenario*> scenarios;
+	bool ok = loadCorpus(corpus, scenarios);
+	int failed = 0;
+	int run = 0;
+	for (Scenario *s : scenarios) {
+		bool wanted = only.empty();
+		for (const std::string &name : only)
+			wanted |= (s->name == name) || (s->name.compare(0, name.size() + 1, name + "/") == 0);
+		if (!wanted) continue;
+		run++;
+		if (command == "list") std::printf("%-40s %-12s %.0f Hz %.3f s %d events\n", s->name.c_str(), s->module.c_str(), s->sampleRate, s->seconds, static_cast<int>(s->script.events.size()));
+		else if (command == "update") failed += update(*s, expected) ? 0 : 1;
+		else failed += check(*s, expected, maxDiffs) ? 0 : 1;
+	}
+	for (Scenario *s : scenarios)
+		delete s;
+	if (command == "check") std::printf("%d scenarios, %d failed\n", run, failed);
+	return (ok && (failed == 0)) ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+/*
+harness.cpp : drives the plugin's modules headless, one sample at a time
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "harness.hpp"
+
+namespace harness {
+
+void init(float sampleRate, const std::string &pluginDir) {
+	static bool done = false;
+	if (done) {
+		APP->engine->setSampleRate(sampleRate);
+		return;
+	}
+	done = true;
+	MidiHub::get()->setCapacity(1 << 16);// scripted bursts are far denser than a cable
+	headlessInit(pluginDir, sampleRate);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+json_t *loadJson(const std::string &textOrPath) {
+	json_error_t error;
+	json_t *rootJ = (!textOrPath.empty() && (textOrPath[0] == '{')) ? json_loads(textOrPath.c_str(), 0, &error) : json_load_file(textOrPath.c_str(), 0, &error);
+	if (!rootJ) std::fprintf(stderr, "%s: JSON error line %d: %s\n", textOrPath.c_str(), error.line, error.text);
+	return rootJ;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+Rig::Rig(const std::string &slug, int deviceId, json_t *config) : deviceId(deviceId) {
+	model = pluginInstance->getModel(slug);
+	if (!model) {
+		std::fprintf(stderr, "unknown module %s\n", slug.c_str());
+		std::exit(1);
+	}
+	module = model->createModule();
+	for (engine::Output &output : module->outputs)
+		output.channels = 1;// connected, the module sets the real count
+	json_t *dataJ = config ? json_deep_copy(config) : json_object();
+	json_t *midiJ = json_object();
+	json_object_set_new(midiJ, "driver", json_integer(midi::HEADLESS_DRIVER));
+	json_object_set_new(midiJ, "deviceName", json_string(string::f("Harness %d", deviceId).c_str()));
+	json_object_set_new(midiJ, "channel", json_integer(-1));
+	json_object_set_new(dataJ, "midi", midiJ);
+	module->dataFromJson(dataJ);
+	json_decref(dataJ);
+	module->onAdd();// Rack adds a loaded module to the engine after fromJson
+	device = MidiHub::get()->acquire(midi::HEADLESS_DRIVER, deviceId);// the module holds the other reference
+	sampleRateChanged();
+}
+///////////////////////////////////////////////////////////////////////////////////////
+Rig::~Rig() {
+	delete module;
+	MidiHub::get()->release(device);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void Rig::sampleRateChanged() {
+	args.sampleRate = APP->engine->getSampleRate();
+	args.sampleTime = APP->engine->getSampleTime();
+	module->onSampleRateChange();
+}
+///////////////////////////////////////////////////////////////////////////////////////
+std::string Rig::outputName(int outputId) const {
+	static const char *groups = "ABCD";
+	if (model->slug == "SuperMIDI64") {
+		static const char *names[] = {"pitch", "y", "z", "vel", "rvel", "gate"};
+		if (outputId < 24) return string::f("%s_%c", names[outputId / 4], groups[outputId % 4]);
+		if (outputId == 24) return "pbend";
+		return string::f("cc%d", outputId - 24);// MIDI CC slot 1 ~ 20
+	}
+	if (model->slug == "DuoMIDI_CV") {
+		static const char *names[] = {"pitch1", "pitch2", "gate1", "gate2", "vel1", "vel2", "bentpitch1", "bentpitch2",
+			"retrig1", "retrig2", "mod1", "mod2", "pbend1", "pbend2", "aftertouch1", "aftertouch2",
+			"start", "stop", "continue", "clock", "clockdiv"};
+		if (outputId < static_cast<int>(sizeof(names) / sizeof(names[0]))) return names[outputId];
+	}
+	return string::f("out%d", outputId);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+const std::vector<std::string> &polyModes(const std::string &slug) {
+	static const std::vector<std::string> superModes = {"mpe", "mpe+", "rotate", "rotateout", "reuse", "reset", "reassign", "unison", "unisonlwr", "unisonupr"};
+	static const std::vector<std::string> duoModes = {"rotate", "reuse", "reset", "mpe"};
+	static const std::vector<std::string> none;
+	if (slug == "SuperMIDI64") return superModes;
+	if (slug == "DuoMIDI_CV") return duoModes;
+	return none;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void setPolyMode(json_t *configJ, const std::string &slug, int mode) {
+	json_object_set_new(configJ, (slug == "SuperMIDI64") ? "polyModeIx" : "polyMode", json_integer(mode));
+}
+///////////////////////////////////////////////////////////////////////////////////////
+std::vector<std::string> split(const std::string &list) {
+	std::vector<std::string> items;
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t comma = list.find(',', pos);
+		if (comma == std::string::npos) comma = list.size();
+		if (comma > pos) items.push_back(list.substr(pos, comma - pos));
+		pos = comma + 1;
+	}
+	return items;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+double percentile(std::vector<double> &sorted, double p) {
+	if (sorted.empty()) return 0.0;
+	size_t ix = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(ix, sorted.size() - 1)];
+}
+
+}
@@ -0,0 +1,84 @@
+/*
+harness.hpp : drives the plugin's modules headless, one sample at a time
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "plugin.hpp"
+#include "rtaudit.hpp"
+
+namespace harness {
+
+/** Sets up the headless context and the plugin once. pluginDir holds res/ */
+void init(float sampleRate, const std::string &pluginDir = "..");
+/** Parses a JSON object given inline ("{...}") or as a file path, NULL on error */
+json_t *loadJson(const std::string &textOrPath);
+
+/** One module instance with every output connected.
+Its first MIDI port is pointed at headless device deviceId, so messages sent here
+go through the MidiHub ring and the module's own drain, as from a real driver.
+config is the module's patch data (dataToJson format), applied before the port.
+*/
+struct Rig {
+	Model *model = NULL;
+	Module *module = NULL;
+	MidiHubDevice *device = NULL;
+	int deviceId = -1;
+	Module::ProcessArgs args;
+
+	Rig(const std::string &slug, int deviceId, json_t *config = NULL);
+	~Rig();
+	/** MIDI for the next process() call */
+	void send(const midi::Message &msg) {
+		device->onMessage(msg);
+	}
+	void send(uint8_t status, uint8_t data1, uint8_t data2) {
+		midi::Message msg;
+		msg.bytes[0] = status;
+		msg.bytes[1] = data1;
+		msg.bytes[2] = data2;
+		msg.size = ((status >> 4) == 0xc || (status >> 4) == 0xd) ? 2 : 3;
+		device->onMessage(msg);
+	}
+	void process() {
+		rtaudit::Scope scope;
+		module->process(args);
+	}
+	/** After APP->engine->setSampleRate() */
+	void sampleRateChanged();
+	int numOutputs() const {
+		return static_cast<int>(module->outputs.size());
+	}
+	/** Readable output name, "gate_B" or "cc7" style */
+	std::string outputName(int outputId) const;
+};
+
+/** Poly mode names, in the module's own order */
+const std::vector<std::string> &polyModes(const std::string &slug);
+/** Sets a poly mode (index into polyModes) in module patch data */
+void setPolyMode(json_t *configJ, const std::string &slug, int mode);
+/** Comma separated option values */
+std::vector<std::string> split(const std::string &list);
+
+/** Stopwatch in nanoseconds */
+inline int64_t nowNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Sorted samples, p in 0 ~ 1 */
+double percentile(std::vector<double> &sorted, double p);
+
+}
@@ -0,0 +1,280 @@
+/*
+rtaudit.cpp : real-time safety audit, flags allocations and locks inside process()
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "rtaudit.hpp"
+
+#ifdef RT_AUDIT
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <new>
+#include <set>
+#include <vector>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+
+namespace rtaudit {
+
+namespace {
+
+const int MAX_FRAMES = 24;
+const int SKIPPED_FRAMES = 3;// record(), violation() and the interposer
+
+thread_local int depth = 0;// > 0 inside process()
+thread_local bool busy = false;// recording : our own allocations and locks don't count
+
+struct Stack {
+	const char *kind = NULL;
+	std::vector<void*> frames;
+	int64_t count = 0;
+	std::set<int> sessions;
+};
+
+struct Session {
+	std::string name;
+	std::map<std::string, int64_t> kinds;
+	int64_t count = 0;
+};
+
+struct State {
+	std::mutex mutex;
+	std::vector<Session> sessions;
+	std::map<std::vector<void*>, Stack> stacks;
+
+	State() {
+		sessions.push_back(Session());
+		sessions.back().name = "(no session)";
+	}
+};
+
+State &state() {
+	static State *s = new State;// never destroyed, interposers can run during exit
+	return *s;
+}
+
+void record(const char *kind) {
+	void *frames[MAX_FRAMES];
+	int n = backtrace(frames, MAX_FRAMES);
+	std::vector<void*> key(frames + std::min(n, SKIPPED_FRAMES), frames + n);
+	key.insert(key.begin(), const_cast<char*>(kind));// same stack, different call : distinct
+	State &s = state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	int ix = static_cast<int>(s.sessions.size()) - 1;
+	Session &session = s.sessions.back();
+	session.kinds[kind]++;
+	session.count++;
+	Stack &stack = s.stacks[key];
+	if (stack.count == 0) {
+		stack.kind = kind;
+		stack.frames.assign(key.begin() + 1, key.end());
+	}
+	stack.count++;
+	stack.sessions.insert(ix);
+}
+
+void violation(const char *kind) {
+	if ((depth == 0) || busy) return;
+	busy = true;
+	record(kind);// its locals are freed before busy drops
+	busy = false;
+}
+
+template <class F>
+F next(const char *name) {
+	return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+
+/** "binary(mangled+0x1a) [0x...]" to "demangled +0x1a" */
+std::string symbolize(void *frame) {
+	char **symbols = backtrace_symbols(&frame, 1);
+	std::string text = symbols ? symbols[0] : "?";
+	std::free(symbols);
+	size_t open = text.find('(');
+	size_t plus = text.find('+', open);
+	if ((open == std::string::npos) || (plus == std::string::npos) || (plus == open + 1)) return text;
+	std::string mangled = text.substr(open + 1, plus - open - 1);
+	int status = 0;
+	char *demangled = abi::__cxa_demangle(mangled.c_str(), NULL, NULL, &status);
+	if (status != 0) return text;
+	std::string result = std::string(demangled) + " " + text.substr(plus, text.find(')', plus) - plus);
+	std::free(demangled);
+	return result;
+}
+
+}
+///////////////////////////////////////////////////////////////////////////////////////
+Scope::Scope() {
+	depth++;
+}
+Scope::~Scope() {
+	depth--;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void session(const std::string &name) {
+	busy = true;
+	State &s = state();
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.sessions.push_back(Session());
+		s.sessions.back().name = name;
+	}
+	busy = false;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+int64_t count() {
+	busy = true;
+	State &s = state();
+	int64_t n;
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		n = s.sessions.back().count;
+	}
+	busy = false;
+	return n;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void report(FILE *file) {
+	busy = true;
+	State &s = state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	int64_t total = 0;
+	for (const Session &session : s.sessions)
+		total += session.count;
+	// stacks that only differ below process() print the same : merged
+	std::map<std::string, Stack> printed;
+	for (const std::pair<const std::vector<void*>, Stack> &kv : s.stacks) {
+		std::string text;
+		for (void *frame : kv.second.frames) {
+			std::string symbol = symbolize(frame);
+			text += "    " + symbol + "\n";
+			if (symbol.find("::process(") != std::string::npos) break;// the module's process(), the rest is the tool
+		}
+		Stack &stack = printed[std::string(kv.second.kind) + " :\n" + text];
+		stack.kind = kv.second.kind;
+		stack.count += kv.second.count;
+		stack.sessions.insert(kv.second.sessions.begin(), kv.second.sessions.end());
+	}
+	std::vector<std::pair<const std::string, Stack>*> sorted;
+	for (std::pair<const std::string, Stack> &kv : printed)
+		sorted.push_back(&kv);
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<const std::string, Stack> *a, const std::pair<const std::string, Stack> *b) {return a->second.count > b->second.count;});
+	std::fprintf(file, "\nrt audit : %lld violations in process(), %d distinct call stacks\n", static_cast<long long>(total), static_cast<int>(printed.size()));
+	for (const Session &session : s.sessions) {
+		if (session.count == 0) continue;
+		std::fprintf(file, "  %-40s %8lld", session.name.c_str(), static_cast<long long>(session.count));
+		for (const std::pair<const std::string, int64_t> &kv : session.kinds)
+			std::fprintf(file, "  %s:%lld", kv.first.c_str(), static_cast<long long>(kv.second));
+		std::fprintf(file, "\n");
+	}
+	for (const std::pair<const std::string, Stack> *kv : sorted) {
+		const std::string &text = kv->first;
+		std::fprintf(file, "\n%s : %lld times in %d sessions\n%s", kv->second.kind, static_cast<long long>(kv->second.count), static_cast<int>(kv->second.sessions.size()),
+			text.substr(text.find('\n') + 1).c_str());
+	}
+	busy = false;
+}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+// interposers : the program's own definitions win over libc / libstdc++. new and
+// delete stay out of line, or gcc sees malloc() and free() paired with them here
+
+__attribute__((noinline)) void *operator new(size_t size) {
+	rtaudit::violation("operator new");
+	void *p = std::malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+__attribute__((noinline)) void *operator new[](size_t size) {
+	rtaudit::violation("operator new");
+	void *p = std::malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+__attribute__((noinline)) void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	rtaudit::violation("operator new");
+	return std::malloc(size ? size : 1);
+}
+__attribute__((noinline)) void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+	rtaudit::violation("operator new");
+	return std::malloc(size ? size : 1);
+}
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+	if (p) rtaudit::violation("operator delete");
+	std::free(p);
+}
+__attribute__((noinline)) void operator delete[](void *p) noexcept {
+	if (p) rtaudit::violation("operator delete");
+	std::free(p);
+}
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+	if (p) rtaudit::violation("operator delete");
+	std::free(p);
+}
+__attribute__((noinline)) void operator delete[](void *p, size_t) noexcept {
+	if (p) rtaudit::violation("operator delete");
+	std::free(p);
+}
+
+extern "C" {
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+	static int (*real)(pthread_mutex_t*) = NULL;
+	if (!real) real = rtaudit::next<int (*)(pthread_mutex_t*)>("pthread_mutex_lock");
+	rtaudit::violation("pthread_mutex_lock");
+	return real(mutex);
+}
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock) {
+	static int (*real)(pthread_rwlock_t*) = NULL;
+	if (!real) real = rtaudit::next<int (*)(pthread_rwlock_t*)>("pthread_rwlock_rdlock");
+	rtaudit::violation("pthread_rwlock_rdlock");
+	return real(rwlock);
+}
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock) {
+	static int (*real)(pthread_rwlock_t*) = NULL;
+	if (!real) real = rtaudit::next<int (*)(pthread_rwlock_t*)>("pthread_rwlock_wrlock");
+	rtaudit::violation("pthread_rwlock_wrlock");
+	return real(rwlock);
+}
+/** glibc's rand() is random() truncated, which locks the shared state on every call */
+int rand(void) {
+	rtaudit::violation("rand");
+	return static_cast<int>(random());
+}
+
+}
+
+#else
+
+namespace rtaudit {
+
+void session(const std::string &name) {}
+int64_t count() {
+	return 0;
+}
+void report(FILE *file) {}
+
+}
+
+#endif
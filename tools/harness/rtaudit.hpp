@@ -0,0 +1,53 @@
+/*
+rtaudit.hpp : real-time safety audit, flags allocations and locks inside process()
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/** Built with `make AUDIT=1` (RT_AUDIT). operator new / delete, pthread mutex and
+rwlock locks and rand() are intercepted for the whole program, and each call made
+while a thread is inside a Scope is a violation : counted in the current session,
+with its backtrace. Without RT_AUDIT, Scope is empty and nothing is intercepted */
+namespace rtaudit {
+
+#ifdef RT_AUDIT
+const bool enabled = true;
+
+/** The calling thread is in process() until the end of the scope */
+struct Scope {
+	Scope();
+	~Scope();
+};
+#else
+const bool enabled = false;
+
+struct Scope {
+	Scope() {}
+};
+#endif
+
+/** Starts counting a new session, e.g. one benchmark combination */
+void session(const std::string &name);
+/** Violations in the current session */
+int64_t count();
+/** Counts per session and kind, then each distinct call stack once, demangled */
+void report(FILE *file);
+
+}
@@ -0,0 +1,157 @@
+/*
+workload.cpp : scripted MIDI streams for the benchmarks, the same on every run
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "workload.hpp"
+#include <random>
+
+namespace harness {
+
+namespace {
+
+/** Writes one millisecond at a time. mt19937 output is fixed by the standard, the
+distributions are not, so values are taken from the raw generator */
+struct Writer {
+	Script &script;
+	float sampleRate;
+	std::mt19937 rng;
+	int ms = 0;
+	bool held[16][128] = {{false}};
+
+	Writer(Script &script, float sampleRate, uint32_t seed) : script(script), sampleRate(sampleRate), rng(seed) {}
+
+	int random(int lo, int hi) {// lo ~ hi inclusive
+		return lo + static_cast<int>(rng() % static_cast<uint32_t>(hi - lo + 1));
+	}
+	int64_t frame() const {
+		return static_cast<int64_t>(static_cast<double>(ms) * sampleRate / 1000.0);
+	}
+	void send(uint8_t status, uint8_t data1, uint8_t data2) {
+		Script::Event e;
+		e.frame = frame();
+		e.msg.bytes[0] = status;
+		e.msg.bytes[1] = data1 & 0x7f;
+		e.msg.bytes[2] = data2 & 0x7f;
+		e.msg.size = ((status >> 4) == 0xc || (status >> 4) == 0xd) ? 2 : 3;
+		script.events.push_back(e);
+	}
+	void noteOn(int channel, int note, int vel) {
+		if (held[channel][note]) noteOff(channel, note);
+		send(0x90 | channel, note, vel);
+		held[channel][note] = true;
+	}
+	void noteOff(int channel, int note) {
+		send(0x80 | channel, note, 64);
+		held[channel][note] = false;
+	}
+	void releaseAll() {
+		for (int c = 0; c < 16; c++)
+			for (int n = 0; n < 128; n++)
+				if (held[c][n]) noteOff(c, n);
+	}
+	void bend(int channel, int value) {
+		send(0xe0 | channel, value & 0x7f, value >> 7);
+	}
+};
+
+/** Nothing at all : the cost of an instance sitting in a patch */
+void idle(Writer &w, int ms) {}
+
+/** A new 64-note chord every 50 ms, spread over channels 2 ~ 16 */
+void chords64(Writer &w, int ms) {
+	if (ms % 50) return;
+	w.releaseAll();
+	int base = w.random(0, 63);
+	for (int i = 0; i < 64; i++)
+		w.noteOn(1 + (i % 15), base + i, w.random(1, 127));
+}
+
+/** MPE : a note held on each member channel 2 ~ 16, re-struck in turn, with a pitch
+bend on every channel each ms and Y (cc74) / Z (channel pressure) every 2 ms */
+void mpeBends(Writer &w, int ms) {
+	for (int c = 1; c < 16; c++) {
+		if ((ms % 200) == (c - 1) * 10) {
+			for (int n = 0; n < 128; n++)
+				if (w.held[c][n]) w.noteOff(c, n);
+			w.noteOn(c, w.random(36, 96), w.random(1, 127));
+		}
+		w.bend(c, 8192 + static_cast<int>(4000.f * std::sin((ms + c * 37) * 0.01f)) + w.random(-64, 64));
+		if ((ms % 2) == (c % 2)) w.send(0xb0 | c, 74, w.random(0, 127));
+		else w.send(0xd0 | c, w.random(0, 127), 0);
+	}
+}
+
+/** Every default CC slot (and channel pressure) on channel 1 each ms, over a held
+4-note chord. Includes cc64, so the sustain pedal toggles too */
+void ccFlood(Writer &w, int ms) {
+	static const int ccs[] = {1, 4, 7, 10, 11, 12, 13, 64, 70, 71, 74, 16, 17, 18, 19, 80, 81, 82, 83};
+	if (ms == 0) {
+		for (int n = 60; n < 68; n += 2)
+			w.noteOn(0, n, 100);
+	}
+	for (int cc : ccs)
+		w.send(0xb0, cc, w.random(0, 127));
+	w.send(0xd0, w.random(0, 127), 0);
+	w.bend(0, w.random(0, 16383));
+}
+
+struct Workload {
+	const char *name;
+	const char *help;
+	void (*write)(Writer &w, int ms);
+};
+const Workload WORKLOADS[] = {
+	{"idle", "no MIDI", idle},
+	{"chords64", "64-note chords every 50 ms", chords64},
+	{"mpe", "15 MPE voices, 15k bends/s + Y/Z", mpeBends},
+	{"ccflood", "20 CC slots + bend at 1 kHz each", ccFlood},
+};
+
+}
+///////////////////////////////////////////////////////////////////////////////////////
+const std::vector<std::string> &workloadNames() {
+	static std::vector<std::string> names;
+	if (names.empty())
+		for (const Workload &wl : WORKLOADS) names.push_back(wl.name);
+	return names;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+std::string workloadHelp() {
+	std::string help;
+	for (const Workload &wl : WORKLOADS)
+		help += string::f("    %-10s %s\n", wl.name, wl.help);
+	return help;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+bool makeWorkload(Script &script, const std::string &name, float sampleRate, float seconds, uint32_t seed) {
+	for (const Workload &wl : WORKLOADS) {
+		if (name != wl.name) continue;
+		script.name = name;
+		script.events.clear();
+		Writer w(script, sampleRate, seed);
+		int lastMs = std::max(1, static_cast<int>(seconds * 1000.f)) - 1;
+		for (; w.ms < lastMs; w.ms++)
+			wl.write(w, w.ms);
+		w.releaseAll();// last ms, the next pass starts from silence
+		script.frames = static_cast<int64_t>(seconds * sampleRate);
+		script.frames = std::max(script.frames, w.frame() + 1);
+		return true;
+	}
+	return false;
+}
+
+}
@@ -0,0 +1,51 @@
+/*
+workload.hpp : scripted MIDI streams for the benchmarks, the same on every run
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "harness.hpp"
+
+namespace harness {
+
+/** MIDI events on a sample grid, sorted by frame.
+Scripts are written per millisecond, so a workload sends the same messages at every
+sample rate, and they end with every note released so passes can be chained.
+*/
+struct Script {
+	struct Event {
+		int64_t frame;
+		midi::Message msg;
+	};
+	std::string name;
+	std::vector<Event> events;
+	int64_t frames = 0;
+
+	/** Sends the events of one frame, from cursor on, and advances it */
+	void sendFrame(Rig &rig, int64_t frame, size_t &cursor) const {
+		while ((cursor < events.size()) && (events[cursor].frame == frame))
+			rig.send(events[cursor++].msg);
+	}
+};
+
+/** Workload names, in the order listed by the tools */
+const std::vector<std::string> &workloadNames();
+/** Short description for the usage text */
+std::string workloadHelp();
+/** Builds a named workload, seconds long. Returns false for an unknown name */
+bool makeWorkload(Script &script, const std::string &name, float sampleRate, float seconds, uint32_t seed);
+
+}
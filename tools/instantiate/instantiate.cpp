@@ -0,0 +1,194 @@
+/*
+instantiate.cpp : patch-load cost per module, construction, first frame and removal of
+N instances with their panels, plus the SVG and font loads behind them
+
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "harness.hpp"
+
+static const char *USAGE =
+"usage: instantiate [options]\n"
+"  -m, --module LIST     default every module of the plugin\n"
+"  -n, --instances N     instances per patch load, default 12\n"
+"  -v, --visible N       instances on screen (drawn) in the first frame, default 4\n"
+"  -k, --loads N         patch loads per module, default 10\n"
+"      --csv FILE        also write the results as CSV\n"
+"Each load creates the modules from patch data, then their widgets, then steps them all\n"
+"and draws the visible ones once, as Rack's first frame does, then removes everything.\n"
+"Assets load through the stand-in window, which reads each SVG file once per miss.\n";
+
+struct Options {
+	std::vector<std::string> modules;
+	int instances = 12;
+	int visible = 4;
+	int loads = 10;
+	std::string csv;
+};
+
+/** One patch load */
+struct Load {
+	double createNs;// modules and widgets
+	double frameNs;// step all, draw the visible
+	double removeNs;
+	int widgets;// constructed by the load
+	int frameWidgets;// after the first frame
+	int svgLoads;// window cache misses
+	int fontLoads;
+};
+
+struct Result {
+	std::string module;
+	Load first;
+	double createNs;// median of the later loads
+	double frameNs;
+	double removeNs;
+	Load later;// asset loads and widgets of the last load
+};
+///////////////////////////////////////////////////////////////////////////////////////
+static int countWidgets(Widget *w) {
+	int n = 1;
+	for (Widget *child : w->children)
+		n += countWidgets(child);
+	return n;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static Load load(const Options &opt, Model *model, json_t *dataJ) {
+	Load r;
+	Window *window = APP->window;
+	int svgLoads = window->svgLoads;
+	int fontLoads = window->fontLoads;
+	std::vector<ModuleWidget*> widgets;
+	int64_t t0 = harness::nowNs();
+	for (int i = 0; i < opt.instances; i++) {
+		Module *module = model->createModule();
+		module->dataFromJson(dataJ);
+		module->onAdd();
+		widgets.push_back(model->createModuleWidget(module));
+	}
+	int64_t t1 = harness::nowNs();
+	r.widgets = 0;
+	for (ModuleWidget *w : widgets)
+		r.widgets += countWidgets(w);
+	int64_t t2 = harness::nowNs();
+	for (ModuleWidget *w : widgets)
+		w->step();
+	Widget::DrawArgs args;
+	args.clipBox = Rect(Vec(0.f, 0.f), Vec(INFINITY, INFINITY));
+	for (int i = 0; i < std::min(opt.visible, opt.instances); i++)
+		widgets[i]->draw(args);
+	int64_t t3 = harness::nowNs();
+	r.frameWidgets = 0;
+	for (ModuleWidget *w : widgets)
+		r.frameWidgets += countWidgets(w);
+	int64_t t4 = harness::nowNs();
+	for (ModuleWidget *w : widgets) {
+		w->module->onRemove();
+		delete w;// and its module
+	}
+	int64_t t5 = harness::nowNs();
+	r.createNs = static_cast<double>(t1 - t0);
+	r.frameNs = static_cast<double>(t3 - t2);
+	r.removeNs = static_cast<double>(t5 - t4);
+	r.svgLoads = window->svgLoads - svgLoads;
+	r.fontLoads = window->fontLoads - fontLoads;
+	return r;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if ((a == "-m" || a == "--module") && hasValue) opt.modules = harness::split(argv[++i]);
+		else if ((a == "-n" || a == "--instances") && hasValue) opt.instances = std::max(1, std::atoi(argv[++i]));
+		else if ((a == "-v" || a == "--visible") && hasValue) opt.visible = std::max(0, std::atoi(argv[++i]));
+		else if ((a == "-k" || a == "--loads") && hasValue) opt.loads = std::max(2, std::atoi(argv[++i]));
+		else if (a == "--csv" && hasValue) opt.csv = argv[++i];
+		else {
+			std::fputs(USAGE, stderr);
+			return 1;
+		}
+	}
+	harness::init(48000.f);
+	if (opt.modules.empty()) {
+		for (Model *model : pluginInstance->models)
+			opt.modules.push_back(model->slug);
+	}
+
+	std::printf("%d instances per load, %d drawn, %d loads, times per instance\n", opt.instances, std::min(opt.visible, opt.instances), opt.loads);
+	std::printf("%-12s %-6s %10s %10s %10s %9s %9s %5s %5s\n", "module", "load", "create us", "frame us", "remove us", "widgets", "drawn", "svgs", "fonts");
+	std::vector<Result> results;
+	for (const std::string &slug : opt.modules) {
+		Model *model = pluginInstance->getModel(slug);
+		if (!model) {
+			std::fprintf(stderr, "unknown module %s\n", slug.c_str());
+			return 1;
+		}
+		// patch data as Rack saves it, from a fresh instance
+		Module *source = model->createModule();
+		json_t *dataJ = source->dataToJson();
+		delete source;
+		if (!dataJ) dataJ = json_object();
+
+		Result r;
+		r.module = slug;
+		std::vector<double> create, frame, remove;
+		for (int k = 0; k < opt.loads; k++) {
+			Load l = load(opt, model, dataJ);
+			if (k == 0) {
+				r.first = l;
+				continue;
+			}
+			create.push_back(l.createNs);
+			frame.push_back(l.frameNs);
+			remove.push_back(l.removeNs);
+			r.later = l;
+		}
+		json_decref(dataJ);
+		std::sort(create.begin(), create.end());
+		std::sort(frame.begin(), frame.end());
+		std::sort(remove.begin(), remove.end());
+		r.createNs = harness::percentile(create, 0.5);
+		r.frameNs = harness::percentile(frame, 0.5);
+		r.removeNs = harness::percentile(remove, 0.5);
+
+		double n = opt.instances;
+		std::printf("%-12s %-6s %10.1f %10.1f %10.1f %9.1f %9.1f %5d %5d\n", slug.c_str(), "first", r.first.createNs / n / 1e3, r.first.frameNs / n / 1e3, r.first.removeNs / n / 1e3,
+			r.first.widgets / n, r.first.frameWidgets / n, r.first.svgLoads, r.first.fontLoads);
+		std::printf("%-12s %-6s %10.1f %10.1f %10.1f %9.1f %9.1f %5d %5d\n", "", "later", r.createNs / n / 1e3, r.frameNs / n / 1e3, r.removeNs / n / 1e3,
+			r.later.widgets / n, r.later.frameWidgets / n, r.later.svgLoads, r.later.fontLoads);
+		std::fflush(stdout);
+		results.push_back(r);
+	}
+
+	if (!opt.csv.empty()) {
+		FILE *file = std::fopen(opt.csv.c_str(), "w");
+		if (!file) {
+			std::fprintf(stderr, "can't write %s\n", opt.csv.c_str());
+			return 1;
+		}
+		std::fprintf(file, "module,instances,visible,firstCreateUs,firstFrameUs,firstSvgLoads,firstFontLoads,createUs,frameUs,removeUs,widgets,drawnWidgets,svgLoads,fontLoads\n");
+		for (const Result &r : results) {
+			double n = opt.instances;
+			std::fprintf(file, "%s,%d,%d,%.2f,%.2f,%d,%d,%.2f,%.2f,%.2f,%.1f,%.1f,%d,%d\n", r.module.c_str(), opt.instances, std::min(opt.visible, opt.instances),
+				r.first.createNs / n / 1e3, r.first.frameNs / n / 1e3, r.first.svgLoads, r.first.fontLoads, r.createNs / n / 1e3, r.frameNs / n / 1e3, r.removeNs / n / 1e3,
+				r.later.widgets / n, r.later.frameWidgets / n, r.later.svgLoads, r.later.fontLoads);
+		}
+		std::fclose(file);
+	}
+	return 0;
+}
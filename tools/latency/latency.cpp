@@ -0,0 +1,275 @@
+/*
+latency.cpp : MIDI-to-gate latency and jitter, per module, poly mode, engine block
+size and background message density
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "harness.hpp"
+#include <random>
+
+static const char *USAGE =
+"usage: latency [options]\n"
+"  -m, --module LIST     SuperMIDI64,DuoMIDI_CV (default both)\n"
+"  -p, --mode LIST       poly modes by name, default all of each module's\n"
+"  -b, --block LIST      engine block sizes in samples, default 1,16,64,256,1024\n"
+"  -D, --density LIST    background CC messages per second, default 0,1000,10000\n"
+"  -r, --rate HZ         sample rate, default 48000\n"
+"  -d, --seconds SEC     audio per run, default 5\n"
+"      --seed N          arrival times seed, default 1\n"
+"      --csv FILE        also write the results as CSV\n"
+"Probe notes (up to 100 per second, each held 4 ms or two blocks) arrive at random\n"
+"sub-sample times.\n"
+"The engine picks MIDI up at the start of each block, as Rack's audio thread does.\n"
+"Latency is in samples, from arrival to the first output frame showing the change;\n"
+"playback adds one more block of output buffering on top.\n";
+
+struct Options {
+	std::vector<std::string> modules;
+	std::vector<std::string> modes;
+	std::vector<int> blocks;
+	std::vector<int> densities;
+	float sampleRate = 48000.f;
+	float seconds = 5.f;
+	uint32_t seed = 1;
+	std::string csv;
+};
+
+/** A timed message; probes are the note-ons and note-offs being measured */
+struct Arrival {
+	double time;// in samples
+	midi::Message msg;
+	int probe;// -1 : background
+};
+
+struct Probe {
+	double on;
+	double off;
+	uint8_t note;
+	int64_t onPickup = -1;
+	int64_t offPickup = -1;
+	int64_t onSeen = -1;
+	int64_t offSeen = -1;
+	bool missed = false;
+};
+
+struct Result {
+	std::string module;
+	std::string mode;
+	int block;
+	int density;
+	std::vector<double> onLatency;
+	std::vector<double> offLatency;
+	std::vector<double> moduleFrames;// frames between pickup and the output, note-on and off
+	int missed = 0;
+};
+///////////////////////////////////////////////////////////////////////////////////////
+static midi::Message message(uint8_t status, uint8_t data1, uint8_t data2) {
+	midi::Message msg;
+	msg.bytes[0] = status;
+	msg.bytes[1] = data1;
+	msg.bytes[2] = data2;
+	msg.size = 3;
+	return msg;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+/** Gate / pitch output pairs, "gate_A" with "pitch_A", "gate1" with "pitch1" */
+static std::vector<std::pair<int, int>> gatePitchPairs(const harness::Rig &rig) {
+	std::vector<std::pair<int, int>> pairs;
+	for (int g = 0; g < rig.numOutputs(); g++) {
+		std::string name = rig.outputName(g);
+		if (name.compare(0, 4, "gate") != 0) continue;
+		std::string pitchName = "pitch" + name.substr(4);
+		for (int p = 0; p < rig.numOutputs(); p++)
+			if (rig.outputName(p) == pitchName) pairs.push_back(std::make_pair(g, p));
+	}
+	return pairs;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static bool sounding(const harness::Rig &rig, const std::vector<std::pair<int, int>> &pairs, uint8_t note) {
+	float pitch = (note - 60) / 12.f;
+	for (const std::pair<int, int> &gp : pairs) {
+		const engine::Output &gate = rig.module->outputs[gp.first];
+		const engine::Output &out = rig.module->outputs[gp.second];
+		for (int c = 0; c < std::min(gate.channels, out.channels); c++)
+			if ((gate.voltages[c] >= 1.f) && (std::fabs(out.voltages[c] - pitch) < 1.f / 24.f)) return true;
+	}
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static void run(const Options &opt, Result &r) {
+	const std::vector<std::string> &modes = harness::polyModes(r.module);
+	int mode = std::find(modes.begin(), modes.end(), r.mode) - modes.begin();
+	bool mpe = (r.mode.compare(0, 3, "mpe") == 0);
+	json_t *configJ = json_object();
+	harness::setPolyMode(configJ, r.module, mode);
+	if (r.module == "SuperMIDI64") {
+		json_object_set_new(configJ, "numVOout", json_integer(1));
+		json_object_set_new(configJ, "numVOper", json_integer(16));
+		json_object_set_new(configJ, "numVo", json_integer(16));
+	}
+	else json_object_set_new(configJ, "channels 1", json_integer(16));
+	harness::Rig rig(r.module, 0, configJ);
+	json_decref(configJ);
+	rtaudit::session(string::f("%s %s b%d d%d", r.module.c_str(), r.mode.c_str(), r.block, r.density));
+	std::vector<std::pair<int, int>> pairs = gatePitchPairs(rig);
+
+	// script : a probe note per slot at a random offset in its first half, held at
+	// least two blocks (shorter notes can start and end in the same block), background
+	// CC1 at random times. Notes cycle so consecutive probes differ
+	std::mt19937 rng(opt.seed);
+	double hold = std::max(opt.sampleRate * 0.004, 2.0 * r.block);
+	double slotLength = std::max(opt.sampleRate * 0.01, 2.5 * hold);
+	int64_t frames = static_cast<int64_t>(opt.seconds * opt.sampleRate);
+	std::vector<Probe> probes;
+	std::vector<Arrival> arrivals;
+	for (int slot = 0; (slot + 1) * slotLength < frames; slot++) {
+		Probe p;
+		p.on = (slot + 0.5 * (rng() / 4294967296.0)) * slotLength;
+		p.off = p.on + hold;
+		p.note = static_cast<uint8_t>(36 + (slot * 7) % 60);
+		uint8_t channel = mpe ? static_cast<uint8_t>(1 + slot % 15) : 0;
+		arrivals.push_back({p.on, message(0x90 | channel, p.note, 100), static_cast<int>(probes.size())});
+		arrivals.push_back({p.off, message(0x80 | channel, p.note, 64), static_cast<int>(probes.size())});
+		probes.push_back(p);
+	}
+	int64_t background = static_cast<int64_t>(r.density * opt.seconds);
+	for (int64_t i = 0; i < background; i++)
+		arrivals.push_back({(rng() / 4294967296.0) * frames, message(0xb0, 1, rng() & 0x7f), -1});
+	std::stable_sort(arrivals.begin(), arrivals.end(), [](const Arrival &a, const Arrival &b) {return a.time < b.time;});
+
+	size_t next = 0;
+	size_t firstOpen = 0;// probes before this are done
+	std::srand(opt.seed);
+	for (int64_t frame = 0; frame < frames; frame++) {
+		if ((frame % r.block) == 0) {// the block starts : everything that arrived so far goes in
+			while ((next < arrivals.size()) && (arrivals[next].time <= frame)) {
+				const Arrival &a = arrivals[next++];
+				rig.send(a.msg);
+				if (a.probe < 0) continue;
+				Probe &p = probes[a.probe];
+				if ((a.msg.bytes[0] >> 4) == 0x9) p.onPickup = frame;
+				else p.offPickup = frame;
+			}
+		}
+		rig.process();
+		for (size_t i = firstOpen; i < probes.size(); i++) {
+			Probe &p = probes[i];
+			if (p.onPickup < 0) break;// not arrived, nor any after it
+			if (p.missed) continue;
+			if (p.onSeen < 0) {
+				if (sounding(rig, pairs, p.note)) p.onSeen = frame;
+			}
+			else if ((p.offPickup >= 0) && (p.offSeen < 0)) {
+				if (!sounding(rig, pairs, p.note)) p.offSeen = frame;
+			}
+			if ((p.offSeen >= 0) && (i == firstOpen)) firstOpen++;
+			else if ((p.offSeen < 0) && (frame - p.onPickup > opt.sampleRate)) {// a second without the change : missed
+				r.missed++;
+				p.missed = true;
+				if (i == firstOpen) firstOpen++;
+			}
+		}
+	}
+	for (const Probe &p : probes) {
+		if (p.missed || (p.onSeen < 0) || (p.offSeen < 0)) continue;
+		r.onLatency.push_back(p.onSeen - p.on);
+		r.offLatency.push_back(p.offSeen - p.off);
+		r.moduleFrames.push_back(p.onSeen - p.onPickup);
+		r.moduleFrames.push_back(p.offSeen - p.offPickup);
+	}
+	std::sort(r.onLatency.begin(), r.onLatency.end());
+	std::sort(r.offLatency.begin(), r.offLatency.end());
+	std::sort(r.moduleFrames.begin(), r.moduleFrames.end());
+}
+///////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if ((a == "-m" || a == "--module") && hasValue) opt.modules = harness::split(argv[++i]);
+		else if ((a == "-p" || a == "--mode") && hasValue) opt.modes = harness::split(argv[++i]);
+		else if ((a == "-b" || a == "--block") && hasValue) {
+			for (const std::string &b : harness::split(argv[++i]))
+				opt.blocks.push_back(std::max(1, std::atoi(b.c_str())));
+		}
+		else if ((a == "-D" || a == "--density") && hasValue) {
+			for (const std::string &d : harness::split(argv[++i]))
+				opt.densities.push_back(std::max(0, std::atoi(d.c_str())));
+		}
+		else if ((a == "-r" || a == "--rate") && hasValue) opt.sampleRate = std::atof(argv[++i]);
+		else if ((a == "-d" || a == "--seconds") && hasValue) opt.seconds = std::max(0.1, std::atof(argv[++i]));
+		else if (a == "--seed" && hasValue) opt.seed = std::strtoul(argv[++i], NULL, 10);
+		else if (a == "--csv" && hasValue) opt.csv = argv[++i];
+		else {
+			std::fputs(USAGE, stderr);
+			return 1;
+		}
+	}
+	if (opt.modules.empty()) opt.modules = {"SuperMIDI64", "DuoMIDI_CV"};
+	if (opt.blocks.empty()) opt.blocks = {1, 16, 64, 256, 1024};
+	if (opt.densities.empty()) opt.densities = {0, 1000, 10000};
+	harness::init(opt.sampleRate);
+
+	std::printf("latency in samples at %.0f Hz: p50 / p99 / max, jitter = p99 - p50\n", opt.sampleRate);
+	std::printf("%-12s %-10s %5s %6s | %-23s | %-23s | %7s %6s\n", "module", "mode", "block", "msg/s", "note-on", "note-off", "module", "missed");
+	std::vector<Result> results;
+	for (const std::string &module : opt.modules) {
+		const std::vector<std::string> &modes = harness::polyModes(module);
+		if (modes.empty()) {
+			std::fprintf(stderr, "unknown module %s\n", module.c_str());
+			return 1;
+		}
+		for (const std::string &mode : modes) {
+			if (!opt.modes.empty() && (std::find(opt.modes.begin(), opt.modes.end(), mode) == opt.modes.end())) continue;
+			for (int block : opt.blocks) {
+				for (int density : opt.densities) {
+					Result r;
+					r.module = module;
+					r.mode = mode;
+					r.block = block;
+					r.density = density;
+					run(opt, r);
+					std::printf("%-12s %-10s %5d %6d | %6.1f %6.1f %6.1f %2.0f | %6.1f %6.1f %6.1f %2.0f | %3.0f/%-3.0f %6d\n", module.c_str(), mode.c_str(), block, density,
+						harness::percentile(r.onLatency, 0.5), harness::percentile(r.onLatency, 0.99), r.onLatency.empty() ? 0.0 : r.onLatency.back(),
+						harness::percentile(r.onLatency, 0.99) - harness::percentile(r.onLatency, 0.5),
+						harness::percentile(r.offLatency, 0.5), harness::percentile(r.offLatency, 0.99), r.offLatency.empty() ? 0.0 : r.offLatency.back(),
+						harness::percentile(r.offLatency, 0.99) - harness::percentile(r.offLatency, 0.5),
+						harness::percentile(r.moduleFrames, 0.99), r.moduleFrames.empty() ? 0.0 : r.moduleFrames.back(), r.missed);
+					std::fflush(stdout);
+					results.push_back(r);
+				}
+			}
+		}
+	}
+
+	if (!opt.csv.empty()) {
+		FILE *file = std::fopen(opt.csv.c_str(), "w");
+		if (!file) {
+			std::fprintf(stderr, "can't write %s\n", opt.csv.c_str());
+			return 1;
+		}
+		std::fprintf(file, "module,mode,block,density,onP50,onP99,onMax,offP50,offP99,offMax,moduleP99,moduleMax,missed\n");
+		for (Result &r : results)
+			std::fprintf(file, "%s,%s,%d,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.0f,%.0f,%d\n", r.module.c_str(), r.mode.c_str(), r.block, r.density,
+				harness::percentile(r.onLatency, 0.5), harness::percentile(r.onLatency, 0.99), r.onLatency.empty() ? 0.0 : r.onLatency.back(),
+				harness::percentile(r.offLatency, 0.5), harness::percentile(r.offLatency, 0.99), r.offLatency.empty() ? 0.0 : r.offLatency.back(),
+				harness::percentile(r.moduleFrames, 0.99), r.moduleFrames.empty() ? 0.0 : r.moduleFrames.back(), r.missed);
+		std::fclose(file);
+	}
+	rtaudit::report(stdout);
+	return 0;
+}
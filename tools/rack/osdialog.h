@@ -0,0 +1,31 @@
+/*
+osdialog.h : headless stand-in, every dialog is cancelled (tools/ harnesses only)
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+
+typedef enum {
+	OSDIALOG_OPEN,
+	OSDIALOG_OPEN_DIR,
+	OSDIALOG_SAVE,
+} osdialog_file_action;
+
+typedef struct osdialog_filters osdialog_filters;
+
+inline osdialog_filters *osdialog_filters_parse(const char *str) {return NULL;}
+inline void osdialog_filters_free(osdialog_filters *filters) {}
+inline char *osdialog_file(osdialog_file_action action, const char *path, const char *filename, osdialog_filters *filters) {return NULL;}
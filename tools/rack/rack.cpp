@@ -0,0 +1,62 @@
+/*
+rack.cpp : headless stand-in for the Rack v1 API (tools/ harnesses only)
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include <rack.hpp>
+
+namespace rack {
+
+static engine::Engine headlessEngine;
+static Window headlessWindow;
+static Context headlessContext;
+static Plugin headlessPlugin;
+
+Context *contextGet() {
+	return &headlessContext;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+void headlessInit(const std::string &pluginDir, float sampleRate) {
+	headlessEngine.setSampleRate(sampleRate);
+	headlessContext.engine = &headlessEngine;
+	headlessContext.window = &headlessWindow;
+	headlessPlugin.path = pluginDir;
+	::init(&headlessPlugin);
+}
+///////////////////////////////////////////////////////////////////////////////////////
+/** Reads the whole file, standing in for the parse cost of a real load */
+std::shared_ptr<Svg> Window::loadSvg(const std::string &filename) {
+	std::shared_ptr<Svg> svg = svgCache[filename].lock();
+	if (!svg) {
+		svg = std::make_shared<Svg>();
+		svg->path = filename;
+		FILE *file = std::fopen(filename.c_str(), "rb");
+		if (file) {
+			char buf[4096];
+			while (std::fread(buf, 1, sizeof(buf), file) > 0) {}
+			std::fclose(file);
+		}
+		svgCache[filename] = svg;
+		svgLoads++;
+	}
+	return svg;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+std::string asset::plugin(Plugin *plugin, const std::string &filename) {
+	return plugin->path + "/" + filename;
+}
+
+}
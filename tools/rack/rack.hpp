@@ -0,0 +1,769 @@
+/*
+rack.hpp : headless stand-in for the Rack v1 API, enough to build and run the plugin's
+modules without a window, audio device or MIDI driver (tools/ harnesses only)
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#pragma once
+/** Engine-side classes (Module, ports, dsp helpers, midi::Message) follow Rack v1
+behavior exactly, the harness results depend on them. Widgets keep their tree and
+boxes but draw nothing, nanovg calls are no-ops, and MIDI drivers have no devices:
+harnesses inject messages through the plugin's MidiHub devices instead.
+*/
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+#include <jansson.h>
+#include <xmmintrin.h>
+
+///////////////////////////////////////////////////////////////////////////////////////
+// nanovg, drawing is a no-op
+extern "C" {
+typedef struct NVGcontext NVGcontext;
+typedef struct NVGLUframebuffer NVGLUframebuffer;
+typedef struct NVGcolor {
+	float r, g, b, a;
+} NVGcolor;
+enum NVGalign {
+	NVG_ALIGN_LEFT = 1 << 0,
+	NVG_ALIGN_CENTER = 1 << 1,
+	NVG_ALIGN_RIGHT = 1 << 2,
+	NVG_ALIGN_TOP = 1 << 3,
+	NVG_ALIGN_MIDDLE = 1 << 4,
+	NVG_ALIGN_BOTTOM = 1 << 5,
+	NVG_ALIGN_BASELINE = 1 << 6,
+};
+enum NVGblendFactor {
+	NVG_ZERO = 1 << 0,
+	NVG_ONE = 1 << 1,
+};
+}
+inline NVGcolor nvgRGBA(unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+	NVGcolor c = {r / 255.f, g / 255.f, b / 255.f, a / 255.f};
+	return c;
+}
+inline NVGcolor nvgRGB(unsigned char r, unsigned char g, unsigned char b) {return nvgRGBA(r, g, b, 255);}
+inline void nvgBeginPath(NVGcontext*) {}
+inline void nvgRect(NVGcontext*, float, float, float, float) {}
+inline void nvgRoundedRect(NVGcontext*, float, float, float, float, float) {}
+inline void nvgFillColor(NVGcontext*, NVGcolor) {}
+inline void nvgFill(NVGcontext*) {}
+inline void nvgFontSize(NVGcontext*, float) {}
+inline void nvgFontFaceId(NVGcontext*, int) {}
+inline void nvgTextAlign(NVGcontext*, int) {}
+inline void nvgScissor(NVGcontext*, float, float, float, float) {}
+inline void nvgResetScissor(NVGcontext*) {}
+inline float nvgText(NVGcontext*, float x, float, const char*, const char*) {return x;}
+inline void nvgTextBox(NVGcontext*, float, float, float, const char*, const char*) {}
+inline void nvgGlobalCompositeBlendFunc(NVGcontext*, int, int) {}
+inline void nvgSave(NVGcontext*) {}
+inline void nvgRestore(NVGcontext*) {}
+
+#define GLFW_RELEASE 0
+#define GLFW_PRESS 1
+#define GLFW_MOUSE_BUTTON_LEFT 0
+#define GLFW_MOUSE_BUTTON_RIGHT 1
+
+///////////////////////////////////////////////////////////////////////////////////////
+// logger, the harnesses report on stdout so log lines go to stderr
+#define DEBUG(format, ...) ((void)0)
+#define INFO(format, ...) std::fprintf(stderr, "[info] " format "\n", ##__VA_ARGS__)
+#define WARN(format, ...) std::fprintf(stderr, "[warn] " format "\n", ##__VA_ARGS__)
+
+#define ENUMS(name, count) name, name ## _LAST = name + (count) - 1
+#define CHECKMARK_STRING "\xE2\x9C\x94"
+#define CHECKMARK(_cond) ((_cond) ? CHECKMARK_STRING : "")
+#define RIGHT_ARROW "\xE2\x96\xB8"
+
+namespace rack {
+///////////////////////////////////////////////////////////////////////////////////////
+namespace math {
+inline int clamp(int x, int a, int b) {return std::max(std::min(x, b), a);}
+inline float clamp(float x, float a, float b) {return std::fmax(std::fmin(x, b), a);}
+inline float rescale(float x, float xMin, float xMax, float yMin, float yMax) {return yMin + (x - xMin) / (xMax - xMin) * (yMax - yMin);}
+
+struct Vec {
+	float x = 0.f;
+	float y = 0.f;
+	Vec() {}
+	Vec(float x, float y) : x(x), y(y) {}
+	Vec plus(Vec b) const {return Vec(x + b.x, y + b.y);}
+	Vec minus(Vec b) const {return Vec(x - b.x, y - b.y);}
+	Vec mult(float s) const {return Vec(x * s, y * s);}
+	Vec div(float s) const {return Vec(x / s, y / s);}
+	Vec min(Vec b) const {return Vec(std::fmin(x, b.x), std::fmin(y, b.y));}
+	Vec max(Vec b) const {return Vec(std::fmax(x, b.x), std::fmax(y, b.y));}
+};
+struct Rect {
+	Vec pos;
+	Vec size;
+	Rect() {}
+	Rect(Vec pos, Vec size) : pos(pos), size(size) {}
+	bool isContaining(Vec v) const {return (pos.x <= v.x) && (v.x < pos.x + size.x) && (pos.y <= v.y) && (v.y < pos.y + size.y);}
+	Vec getCenter() const {return pos.plus(size.mult(0.5f));}
+};
+}
+using namespace math;
+
+///////////////////////////////////////////////////////////////////////////////////////
+namespace string {
+inline std::string f(const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	va_list args2;
+	va_copy(args2, args);
+	int size = std::vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	std::string s(size > 0 ? size : 0, '\0');
+	if (size > 0) std::vsnprintf(&s[0], size + 1, format, args2);
+	va_end(args2);
+	return s;
+}
+inline std::string directory(const std::string &path) {
+	size_t pos = path.find_last_of('/');
+	return (pos == std::string::npos) ? std::string(".") : path.substr(0, pos);
+}
+inline std::string filename(const std::string &path) {
+	size_t pos = path.find_last_of('/');
+	return (pos == std::string::npos) ? path : path.substr(pos + 1);
+}
+inline std::string filenameExtension(const std::string &filename) {
+	size_t pos = filename.find_last_of('.');
+	return (pos == std::string::npos) ? std::string() : filename.substr(pos + 1);
+}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+/** The float_4 subset of Rack v1's simd::Vector, SSE like Rack's own */
+namespace simd {
+struct float_4 {
+	__m128 v;
+	float_4() {}
+	float_4(__m128 v) : v(v) {}
+	float_4(float x) : v(_mm_set1_ps(x)) {}
+	float_4(float x1, float x2, float x3, float x4) : v(_mm_setr_ps(x1, x2, x3, x4)) {}
+	static float_4 zero() {return float_4(_mm_setzero_ps());}
+	static float_4 load(const float *x) {return float_4(_mm_loadu_ps(x));}
+	void store(float *x) {_mm_storeu_ps(x, v);}
+	float operator[](int i) const {
+		float x[4];
+		_mm_storeu_ps(x, v);
+		return x[i];
+	}
+};
+inline float_4 operator+(const float_4 &a, const float_4 &b) {return float_4(_mm_add_ps(a.v, b.v));}
+inline float_4 operator-(const float_4 &a, const float_4 &b) {return float_4(_mm_sub_ps(a.v, b.v));}
+inline float_4 operator*(const float_4 &a, const float_4 &b) {return float_4(_mm_mul_ps(a.v, b.v));}
+inline float_4 operator/(const float_4 &a, const float_4 &b) {return float_4(_mm_div_ps(a.v, b.v));}
+// comparisons give lane masks, all bits set where true
+inline float_4 operator<(const float_4 &a, const float_4 &b) {return float_4(_mm_cmplt_ps(a.v, b.v));}
+inline float_4 operator<=(const float_4 &a, const float_4 &b) {return float_4(_mm_cmple_ps(a.v, b.v));}
+inline float_4 operator>(const float_4 &a, const float_4 &b) {return float_4(_mm_cmpgt_ps(a.v, b.v));}
+inline float_4 operator>=(const float_4 &a, const float_4 &b) {return float_4(_mm_cmpge_ps(a.v, b.v));}
+inline float_4 operator==(const float_4 &a, const float_4 &b) {return float_4(_mm_cmpeq_ps(a.v, b.v));}
+inline float_4 operator&(const float_4 &a, const float_4 &b) {return float_4(_mm_and_ps(a.v, b.v));}
+inline float_4 operator|(const float_4 &a, const float_4 &b) {return float_4(_mm_or_ps(a.v, b.v));}
+/** a where mask is set, else b */
+inline float_4 ifelse(const float_4 &mask, const float_4 &a, const float_4 &b) {
+	return float_4(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)));
+}
+/** Lane i's mask in bit i */
+inline int movemask(const float_4 &a) {return _mm_movemask_ps(a.v);}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+namespace dsp {
+template <typename T = float>
+struct TExponentialFilter {
+	T out = 0.f;
+	T lambda = 0.f;
+	void reset() {out = 0.f;}
+	void setLambda(T lambda) {this->lambda = lambda;}
+	void setTau(T tau) {this->lambda = 1 / tau;}
+	T process(T deltaTime, T in) {
+		T y = out + (in - out) * lambda * deltaTime;
+		// no change means T reached its precision limit, jump to the input
+		out = (out == y) ? in : y;
+		return out;
+	}
+};
+typedef TExponentialFilter<> ExponentialFilter;
+
+struct PulseGenerator {
+	float remaining = 0.f;
+	void reset() {remaining = 0.f;}
+	bool process(float deltaTime) {
+		if (remaining > 0.f) {
+			remaining -= deltaTime;
+			return true;
+		}
+		return false;
+	}
+	void trigger(float duration = 1e-3f) {
+		if (duration > remaining) remaining = duration;
+	}
+};
+
+struct SchmittTrigger {
+	bool state = true;
+	void reset() {state = true;}
+	bool process(float in) {
+		if (state) {
+			if (in <= 0.f) state = false;
+		}else if (in >= 1.f) {
+			state = true;
+			return true;
+		}
+		return false;
+	}
+	bool isHigh() {return state;}
+};
+
+struct ClockDivider {
+	uint32_t clock = 0;
+	uint32_t division = 1;
+	void reset() {clock = 0;}
+	void setDivision(uint32_t division) {this->division = division;}
+	uint32_t getDivision() {return division;}
+	uint32_t getClock() {return clock;}
+	bool process() {
+		clock++;
+		if (clock >= division) {
+			clock = 0;
+			return true;
+		}
+		return false;
+	}
+};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+namespace midi {
+struct Message {
+	uint8_t size = 3;
+	uint8_t bytes[3] = {};
+	uint8_t getChannel() const {return bytes[0] & 0xf;}
+	void setChannel(uint8_t channel) {bytes[0] = (bytes[0] & 0xf0) | (channel & 0xf);}
+	uint8_t getStatus() const {return bytes[0] >> 4;}
+	void setStatus(uint8_t status) {bytes[0] = (bytes[0] & 0xf) | (status << 4);}
+	uint8_t getNote() const {return bytes[1];}
+	void setNote(uint8_t note) {bytes[1] = note & 0x7f;}
+	uint8_t getValue() const {return bytes[2];}
+	void setValue(uint8_t value) {bytes[2] = value & 0x7f;}
+};
+
+/** One driver with numbered devices that never send anything themselves.
+Modules select them from their patch JSON as usual, and the plugin's MidiHub then
+opens a hub device the harness writes into.
+*/
+static const int HEADLESS_DRIVER = 99;
+static const int HEADLESS_DEVICES = 256;
+
+struct Port {
+	int driverId = -1;
+	int deviceId = -1;
+	int channel = -1;
+	virtual ~Port() {}
+	void reset() {
+		setDriverId(-1);
+		channel = -1;
+	}
+	int getDriverId() {return driverId;}
+	void setDriverId(int driverId) {
+		setDeviceId(-1);
+		this->driverId = (driverId == HEADLESS_DRIVER) ? driverId : -1;
+	}
+	std::vector<int> getDriverIds() {return std::vector<int>(1, HEADLESS_DRIVER);}
+	std::string getDriverName(int driverId) {return (driverId == HEADLESS_DRIVER) ? std::string("Headless") : std::string("");}
+	int getDeviceId() {return deviceId;}
+	virtual void setDeviceId(int deviceId) {this->deviceId = deviceId;}
+	virtual std::vector<int> getDeviceIds() {
+		std::vector<int> ids;
+		if (driverId == HEADLESS_DRIVER)
+			for (int i = 0; i < HEADLESS_DEVICES; i++) ids.push_back(i);
+		return ids;
+	}
+	virtual std::string getDeviceName(int deviceId) {return (deviceId < 0) ? std::string("") : string::f("Harness %d", deviceId);}
+	int getChannel() {return channel;}
+	void setChannel(int channel) {this->channel = channel;}
+	std::string getChannelName(int channel) {return (channel < 0) ? std::string("All channels") : string::f("Channel %d", channel + 1);}
+	json_t *toJson() {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "driver", json_integer(driverId));
+		if (deviceId >= 0) json_object_set_new(rootJ, "deviceName", json_string(getDeviceName(deviceId).c_str()));
+		json_object_set_new(rootJ, "channel", json_integer(channel));
+		return rootJ;
+	}
+	void fromJson(json_t *rootJ) {
+		setDriverId(-1);
+		json_t *driverJ = json_object_get(rootJ, "driver");
+		if (driverJ) setDriverId(json_integer_value(driverJ));
+		json_t *deviceNameJ = json_object_get(rootJ, "deviceName");
+		if (deviceNameJ && (driverId == HEADLESS_DRIVER)) {
+			std::string deviceName = json_string_value(deviceNameJ);
+			for (int id : getDeviceIds()) {
+				if (getDeviceName(id) == deviceName) {
+					setDeviceId(id);
+					break;
+				}
+			}
+		}
+		json_t *channelJ = json_object_get(rootJ, "channel");
+		if (channelJ) channel = json_integer_value(channelJ);
+	}
+};
+struct Input : Port {
+	virtual void onMessage(Message message) {}
+};
+struct InputQueue : Input {
+	int queueMaxSize = 8192;
+	std::queue<Message> queue;
+	void onMessage(Message message) override {
+		if ((int) queue.size() >= queueMaxSize) return;
+		queue.push(message);
+	}
+	bool shift(Message *message) {
+		if (queue.empty()) return false;
+		*message = queue.front();
+		queue.pop();
+		return true;
+	}
+};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+struct Widget;
+namespace event {
+struct Base {
+	mutable bool consumed = false;
+	mutable bool propagating = true;
+	void consume(Widget *w) const {consumed = true;}
+	void stopPropagating() const {propagating = false;}
+	bool isConsumed() const {return consumed;}
+	bool isPropagating() const {return propagating;}
+};
+struct Position {
+	Vec pos;
+};
+struct Button : Base, Position {
+	int button = 0;
+	int action = 0;
+	int mods = 0;
+};
+struct Hover : Base, Position {};
+struct Leave : Base {};
+struct Action : Base {};
+struct Change : Base {};
+struct DragEnd : Base {};
+struct DoubleClick : Base {};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+struct Font {
+	int handle = 0;
+};
+struct Svg {
+	std::string path;
+};
+/** Caches like Rack v1 : weak references by path, a load happens again once nothing holds it */
+struct Window {
+	std::map<std::string, std::weak_ptr<Font>> fontCache;
+	std::map<std::string, std::weak_ptr<Svg>> svgCache;
+	int fontLoads = 0;// cache misses, for the instantiation benchmark
+	int svgLoads = 0;
+	std::shared_ptr<Font> loadFont(const std::string &filename) {
+		std::shared_ptr<Font> font = fontCache[filename].lock();
+		if (!font) {
+			font = std::make_shared<Font>();
+			fontCache[filename] = font;
+			fontLoads++;
+		}
+		return font;
+	}
+	std::shared_ptr<Svg> loadSvg(const std::string &filename);
+};
+
+///////////////////////////////////////////////////////////////////////////////////////
+struct Model;
+namespace engine {
+struct Param {
+	float value = 0.f;
+	float getValue() {return value;}
+	void setValue(float value) {this->value = value;}
+};
+struct Port {
+	float voltages[16] = {};
+	uint8_t channels = 0;// 0 : not connected, harnesses connect what they record
+	void setVoltage(float voltage, int channel = 0) {voltages[channel] = voltage;}
+	float getVoltage(int channel = 0) {return voltages[channel];}
+	float *getVoltages(int firstChannel = 0) {return &voltages[firstChannel];}
+	template <typename T>
+	T getVoltageSimd(int firstChannel) {return T::load(&voltages[firstChannel]);}
+	template <typename T>
+	void setVoltageSimd(T voltage, int firstChannel) {voltage.store(&voltages[firstChannel]);}
+	void setChannels(int channels) {
+		if (this->channels == 0) return;// disconnected ports stay at 0 channels
+		for (int c = channels; c < this->channels; c++)
+			voltages[c] = 0.f;
+		if (channels == 0) channels = 1;
+		this->channels = channels;
+	}
+	int getChannels() {return channels;}
+	bool isConnected() {return channels > 0;}
+};
+struct Output : Port {};
+struct Input : Port {};
+struct Light {
+	float value = 0.f;
+	void setBrightness(float brightness) {value = brightness;}
+	float getBrightness() {return value;}
+};
+
+struct Module {
+	int id = -1;
+	Model *model = NULL;
+	std::vector<Param> params;
+	std::vector<Input> inputs;
+	std::vector<Output> outputs;
+	std::vector<Light> lights;
+	struct Expander {
+		int moduleId = -1;
+		Module *module = NULL;
+		void *producerMessage = NULL;
+		void *consumerMessage = NULL;
+		bool messageFlipRequested = false;
+	};
+	Expander leftExpander;
+	Expander rightExpander;
+	struct ProcessArgs {
+		float sampleRate;
+		float sampleTime;
+	};
+
+	virtual ~Module() {}
+	void config(int numParams, int numInputs, int numOutputs, int numLights = 0) {
+		params.resize(numParams);
+		inputs.resize(numInputs);
+		outputs.resize(numOutputs);
+		lights.resize(numLights);
+	}
+	template <class TParamQuantity = void>
+	void configParam(int paramId, float minValue, float maxValue, float defaultValue, std::string label = "", std::string unit = "", float displayBase = 0.f, float displayMultiplier = 1.f, float displayOffset = 0.f) {
+		params[paramId].value = defaultValue;
+	}
+	virtual void process(const ProcessArgs &args) {}
+	virtual json_t *dataToJson() {return NULL;}
+	virtual void dataFromJson(json_t *rootJ) {}
+	virtual void onAdd() {}
+	virtual void onRemove() {}
+	virtual void onReset() {}
+	virtual void onRandomize() {}
+	virtual void onSampleRateChange() {}
+};
+
+/** Only the sample rate, harnesses step modules themselves */
+struct Engine {
+	float sampleRate = 44100.f;
+	float getSampleRate() {return sampleRate;}
+	float getSampleTime() {return 1.f / sampleRate;}
+	void setSampleRate(float sampleRate) {this->sampleRate = sampleRate;}
+	int getThreadCount() {return 1;}
+};
+}
+using engine::Module;
+
+struct Context {
+	engine::Engine *engine = NULL;
+	Window *window = NULL;
+};
+Context *contextGet();
+#define APP rack::contextGet()
+
+///////////////////////////////////////////////////////////////////////////////////////
+struct Widget {
+	Rect box;
+	Widget *parent = NULL;
+	std::list<Widget*> children;
+	bool visible = true;
+	struct DrawArgs {
+		NVGcontext *vg = NULL;
+		Rect clipBox;
+		NVGLUframebuffer *fb = NULL;
+	};
+
+	virtual ~Widget() {
+		clearChildren();
+	}
+	void addChild(Widget *child) {
+		child->parent = this;
+		children.push_back(child);
+	}
+	void removeChild(Widget *child) {
+		children.remove(child);
+		child->parent = NULL;
+	}
+	void clearChildren() {
+		for (Widget *child : children)
+			delete child;
+		children.clear();
+	}
+	void show() {visible = true;}
+	void hide() {visible = false;}
+	bool isVisible() {return visible;}
+	virtual void step() {
+		for (Widget *child : children)
+			child->step();
+	}
+	virtual void draw(const DrawArgs &args) {
+		for (Widget *child : children)
+			if (child->visible) child->draw(args);
+	}
+	virtual void onButton(const event::Button &e) {}
+	virtual void onHover(const event::Hover &e) {}
+	virtual void onLeave(const event::Leave &e) {}
+	virtual void onAction(const event::Action &e) {}
+	virtual void onChange(const event::Change &e) {}
+	virtual void onDragEnd(const event::DragEnd &e) {}
+	virtual void onDoubleClick(const event::DoubleClick &e) {}
+};
+struct OpaqueWidget : Widget {};
+struct TransparentWidget : Widget {};
+struct FramebufferWidget : Widget {
+	bool dirty = true;
+	float oversample = 1.f;
+	void step() override {
+		Widget::step();
+	}
+	void draw(const DrawArgs &args) override {
+		if (dirty) Widget::draw(args);// renders into the framebuffer only when dirty
+		dirty = false;
+	}
+};
+struct SvgWidget : Widget {
+	std::shared_ptr<Svg> svg;
+	void setSvg(std::shared_ptr<Svg> svg) {this->svg = svg;}
+};
+struct PanelShadow {
+	float opacity = 1.f;
+};
+struct ParamWidget : OpaqueWidget {
+	Module *module = NULL;
+	int paramId = -1;
+	virtual void reset() {}
+	virtual void randomize() {}
+};
+struct Knob : ParamWidget {
+	void onDragEnd(const event::DragEnd &e) override {}
+};
+struct SvgKnob : Knob {
+	float minAngle = -M_PI;
+	float maxAngle = M_PI;
+	SvgWidget sw;
+	PanelShadow shadowStore;
+	PanelShadow *shadow = &shadowStore;
+	void setSvg(std::shared_ptr<Svg> svg) {sw.setSvg(svg);}
+};
+struct Switch : ParamWidget {
+	bool momentary = false;
+};
+struct SvgSwitch : Switch {
+	std::vector<std::shared_ptr<Svg>> frames;
+	PanelShadow shadowStore;
+	PanelShadow *shadow = &shadowStore;
+	void addFrame(std::shared_ptr<Svg> svg) {frames.push_back(svg);}
+};
+struct PortWidget : OpaqueWidget {
+	Module *module = NULL;
+	int portId = -1;
+};
+struct SvgPort : PortWidget {
+	SvgWidget sw;
+	PanelShadow shadowStore;
+	PanelShadow *shadow = &shadowStore;
+	void setSvg(std::shared_ptr<Svg> svg) {sw.setSvg(svg);}
+};
+struct SvgScrew : Widget {};
+struct ScrewBlack : SvgScrew {};
+struct LightWidget : TransparentWidget {};
+struct ModuleLightWidget : LightWidget {
+	Module *module = NULL;
+	int firstLightId = -1;
+	std::vector<NVGcolor> baseColors;
+	void addBaseColor(NVGcolor baseColor) {baseColors.push_back(baseColor);}
+};
+struct GrayModuleLightWidget : ModuleLightWidget {};
+template <typename TBase = GrayModuleLightWidget>
+struct TinyLight : TBase {};
+
+/** Driver / device / channel choosers, nothing to choose from headless */
+struct MidiWidget : OpaqueWidget {
+	midi::Port *port = NULL;
+	void setMidiPort(midi::Port *port) {this->port = port;}
+};
+
+struct Menu : OpaqueWidget {};
+struct MenuEntry : OpaqueWidget {};
+struct MenuLabel : MenuEntry {
+	std::string text;
+};
+struct MenuSeparator : MenuEntry {};
+struct MenuItem : MenuEntry {
+	std::string text;
+	std::string rightText;
+	bool disabled = false;
+	virtual Menu *createChildMenu() {return NULL;}
+};
+template <class TMenuItem = MenuItem>
+TMenuItem *createMenuItem(std::string text, std::string rightText = "") {
+	TMenuItem *o = new TMenuItem;
+	o->text = text;
+	o->rightText = rightText;
+	return o;
+}
+template <class TMenuLabel = MenuLabel>
+TMenuLabel *createMenuLabel(std::string text) {
+	TMenuLabel *o = new TMenuLabel;
+	o->text = text;
+	return o;
+}
+
+struct ModuleWidget : OpaqueWidget {
+	Module *module = NULL;
+	SvgWidget *panel = NULL;
+	~ModuleWidget() {
+		delete module;// the harness hands the module over with the widget, as Rack does
+	}
+	void setModule(Module *module) {this->module = module;}
+	void setPanel(std::shared_ptr<Svg> svg) {
+		panel = new SvgWidget;
+		panel->setSvg(svg);
+		addChild(panel);
+	}
+	void addParam(ParamWidget *param) {addChild(param);}
+	void addInput(PortWidget *input) {addChild(input);}
+	void addOutput(PortWidget *output) {addChild(output);}
+	virtual void appendContextMenu(Menu *menu) {}
+};
+
+struct Plugin;
+struct Model {
+	Plugin *plugin = NULL;
+	std::string slug;
+	virtual ~Model() {}
+	virtual Module *createModule() = 0;
+	/** Takes ownership of module, which may be NULL (the module browser preview) */
+	virtual ModuleWidget *createModuleWidget(Module *module) = 0;
+};
+struct Plugin {
+	std::string path;// asset::plugin resolves against it
+	std::vector<Model*> models;
+	void addModel(Model *model) {
+		model->plugin = this;
+		models.push_back(model);
+	}
+	Model *getModel(const std::string &slug) {
+		for (Model *model : models)
+			if (model->slug == slug) return model;
+		return NULL;
+	}
+};
+
+template <class TModule, class TModuleWidget>
+Model *createModel(std::string slug) {
+	struct TModel : Model {
+		Module *createModule() override {
+			TModule *m = new TModule;
+			m->model = this;
+			return m;
+		}
+		ModuleWidget *createModuleWidget(Module *m) override {
+			TModule *tm = m ? dynamic_cast<TModule*>(m) : NULL;
+			ModuleWidget *mw = new TModuleWidget(tm);
+			return mw;
+		}
+	};
+	TModel *o = new TModel;
+	o->slug = slug;
+	return o;
+}
+template <class TWidget>
+TWidget *createWidget(Vec pos) {
+	TWidget *o = new TWidget;
+	o->box.pos = pos;
+	return o;
+}
+template <class TWidget>
+TWidget *createWidgetCentered(Vec pos) {
+	TWidget *o = createWidget<TWidget>(pos);
+	o->box.pos = o->box.pos.minus(o->box.size.div(2));
+	return o;
+}
+template <class TParamWidget>
+TParamWidget *createParam(Vec pos, Module *module, int paramId) {
+	TParamWidget *o = createWidget<TParamWidget>(pos);
+	o->module = module;
+	o->paramId = paramId;
+	return o;
+}
+template <class TPortWidget>
+TPortWidget *createInput(Vec pos, Module *module, int inputId) {
+	TPortWidget *o = createWidget<TPortWidget>(pos);
+	o->module = module;
+	o->portId = inputId;
+	return o;
+}
+template <class TPortWidget>
+TPortWidget *createOutput(Vec pos, Module *module, int outputId) {
+	TPortWidget *o = createWidget<TPortWidget>(pos);
+	o->module = module;
+	o->portId = outputId;
+	return o;
+}
+template <class TModuleLightWidget>
+TModuleLightWidget *createLight(Vec pos, Module *module, int firstLightId) {
+	TModuleLightWidget *o = createWidget<TModuleLightWidget>(pos);
+	o->module = module;
+	o->firstLightId = firstLightId;
+	return o;
+}
+
+static const float RACK_GRID_WIDTH = 15;
+static const float RACK_GRID_HEIGHT = 380;
+
+namespace asset {
+std::string plugin(Plugin *plugin, const std::string &filename);
+}
+}
+
+/** The plugin's entry point, called by the harness like Rack does at startup */
+void init(rack::Plugin *p);
+
+namespace rack {
+/** Harness setup : a context with an engine and a window, plugin assets from pluginDir */
+void headlessInit(const std::string &pluginDir, float sampleRate);
+}
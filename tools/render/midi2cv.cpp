@@ -0,0 +1,293 @@
+/*
+midi2cv.cpp : offline renderer, plays .mid files through the modules and writes every
+output channel as a WAV (or raw float) stem, jobs in parallel across cores
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "harness.hpp"
+#include <sys/stat.h>
+#include <thread>
+
+static const char *USAGE =
+"usage: midi2cv [options] file.mid...\n"
+"  -m, --module SLUG     SuperMIDI64 (default) or DuoMIDI_CV, repeatable\n"
+"  -c, --config JSON     module patch data, inline {...} or a file, repeatable\n"
+"  -t, --tracks          one job per track (format 1 tempo track kept in each)\n"
+"  -r, --rate HZ         sample rate, default 48000\n"
+"  -o, --out DIR         output directory, default render/\n"
+"  -f, --format wav|f32  32-bit float WAV (default) or headerless float\n"
+"  -s, --select LIST     only outputs whose name starts with one of a,b,c\n"
+"      --tail SEC        render after the last event, default 1\n"
+"      --max SEC         stop after this much audio, default 3600\n"
+"  -j, --jobs N          threads, default one per core\n"
+"Every file x track x module x config combination is one job, rendered by its\n"
+"own module instance. Stems are written as OUT/<job>/<output>_<channel>.wav\n";
+
+struct Options {
+	std::vector<std::string> files;
+	std::vector<std::string> modules;
+	std::vector<std::string> configs;
+	std::vector<std::string> select;
+	bool splitTracks = false;
+	float sampleRate = 48000.f;
+	std::string outDir = "render";
+	bool wav = true;
+	float tail = 1.f;
+	float maxSeconds = 3600.f;
+	int jobs = 0;
+};
+
+struct Job {
+	std::string file;
+	int track = -1;// -1 : all tracks
+	std::string module;
+	json_t *config = NULL;
+	std::string name;
+	// results
+	int64_t frames = 0;
+	int stems = 0;
+	double seconds = 0.0;
+	bool ok = false;
+};
+
+/** One output channel streamed to disk. Opened the first time the channel is
+active, the samples before that are written as zeros. */
+struct Stem {
+	FILE *file = NULL;
+	std::vector<float> buf;
+	int64_t written = 0;
+	bool wav = true;
+
+	bool open(const std::string &path, bool wav, int sampleRate, int64_t leadingZeros) {
+		this->wav = wav;
+		file = std::fopen(path.c_str(), "wb");
+		if (!file) return false;
+		if (wav) writeHeader(sampleRate, 0);
+		buf.reserve(4096);
+		for (int64_t i = 0; i < leadingZeros; i++)
+			push(0.f);
+		return true;
+	}
+	void push(float v) {
+		buf.push_back(v);
+		if (buf.size() == 4096) flush();
+	}
+	void flush() {
+		std::fwrite(buf.data(), sizeof(float), buf.size(), file);
+		written += buf.size();
+		buf.clear();
+	}
+	void writeHeader(int sampleRate, uint32_t frames) {
+		uint32_t dataBytes = frames * 4;
+		uint8_t h[44];
+		std::memcpy(h, "RIFF", 4);
+		put32(h + 4, 36 + dataBytes);
+		std::memcpy(h + 8, "WAVEfmt ", 8);
+		put32(h + 16, 16);
+		put16(h + 20, 3);// IEEE float
+		put16(h + 22, 1);
+		put32(h + 24, sampleRate);
+		put32(h + 28, sampleRate * 4);
+		put16(h + 32, 4);
+		put16(h + 34, 32);
+		std::memcpy(h + 36, "data", 4);
+		put32(h + 40, dataBytes);
+		std::fwrite(h, 1, sizeof(h), file);
+	}
+	void close(int sampleRate) {
+		flush();
+		if (wav) {
+			std::fseek(file, 0, SEEK_SET);
+			writeHeader(sampleRate, static_cast<uint32_t>(written));
+		}
+		std::fclose(file);
+	}
+	static void put16(uint8_t *p, uint16_t v) {
+		p[0] = v & 0xff;
+		p[1] = v >> 8;
+	}
+	static void put32(uint8_t *p, uint32_t v) {
+		for (int i = 0; i < 4; i++)
+			p[i] = (v >> (8 * i)) & 0xff;
+	}
+};
+///////////////////////////////////////////////////////////////////////////////////////
+static bool selected(const Options &opt, const std::string &name) {
+	if (opt.select.empty()) return true;
+	for (const std::string &s : opt.select)
+		if (name.compare(0, s.size(), s) == 0) return true;
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+static void render(const Options &opt, Job &job, int deviceId) {
+	std::string error;
+	SmfSong *song = SmfSong::load(job.file, &error);
+	if (!song) {
+		std::fprintf(stderr, "%s: %s\n", job.file.c_str(), error.c_str());
+		return;
+	}
+	if (job.track >= 0) {// keep the tempo track and this one
+		std::vector<SmfSong::Track> keep;
+		if (job.track > 0) keep.push_back(song->tracks[0]);
+		keep.push_back(song->tracks[job.track]);
+		song->tracks = keep;
+		song->rewind();
+	}
+	std::string dir = opt.outDir + "/" + job.name;
+	mkdir(opt.outDir.c_str(), 0777);
+	mkdir(dir.c_str(), 0777);
+
+	harness::Rig rig(job.module, deviceId, job.config);
+	SmfPlayer player;
+	player.incoming.store(song);
+	player.playing.store(true);
+	std::vector<std::vector<Stem>> stems(rig.numOutputs(), std::vector<Stem>(16));
+	std::vector<bool> wanted(rig.numOutputs());
+	for (int o = 0; o < rig.numOutputs(); o++)
+		wanted[o] = selected(opt, rig.outputName(o));
+
+	int64_t maxFrames = static_cast<int64_t>(opt.maxSeconds * opt.sampleRate);
+	int64_t tailFrames = static_cast<int64_t>(opt.tail * opt.sampleRate);
+	int64_t endFrame = -1;
+	int64_t start = harness::nowNs();
+	int64_t frame = 0;
+	for (; frame < maxFrames; frame++) {
+		player.process(opt.sampleRate, [&](const midi::Message &m) {rig.send(m);});
+		rig.process();
+		for (int o = 0; o < rig.numOutputs(); o++) {
+			if (!wanted[o]) continue;
+			engine::Output &out = rig.module->outputs[o];
+			for (int c = 0; c < 16; c++) {
+				Stem &stem = stems[o][c];
+				if (!stem.file) {
+					if (c >= out.channels) continue;
+					std::string path = dir + "/" + rig.outputName(o) + string::f("_%d", c + 1) + (opt.wav ? ".wav" : ".f32");
+					if (!stem.open(path, opt.wav, static_cast<int>(opt.sampleRate), frame)) {
+						std::fprintf(stderr, "can't write %s\n", path.c_str());
+						return;
+					}
+					job.stems++;
+				}
+				stem.push((c < out.channels) ? out.voltages[c] : 0.f);
+			}
+		}
+		if ((endFrame < 0) && !player.playing.load()) endFrame = frame + tailFrames;
+		if ((endFrame >= 0) && (frame >= endFrame)) break;
+	}
+	job.seconds = (harness::nowNs() - start) * 1e-9;
+	job.frames = frame;
+	for (std::vector<Stem> &outStems : stems)
+		for (Stem &stem : outStems)
+			if (stem.file) stem.close(static_cast<int>(opt.sampleRate));
+	job.ok = true;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if ((a == "-m" || a == "--module") && hasValue) opt.modules.push_back(argv[++i]);
+		else if ((a == "-c" || a == "--config") && hasValue) opt.configs.push_back(argv[++i]);
+		else if (a == "-t" || a == "--tracks") opt.splitTracks = true;
+		else if ((a == "-r" || a == "--rate") && hasValue) opt.sampleRate = std::atof(argv[++i]);
+		else if ((a == "-o" || a == "--out") && hasValue) opt.outDir = argv[++i];
+		else if ((a == "-f" || a == "--format") && hasValue) opt.wav = (std::string(argv[++i]) != "f32");
+		else if ((a == "-s" || a == "--select") && hasValue) opt.select = harness::split(argv[++i]);
+		else if (a == "--tail" && hasValue) opt.tail = std::atof(argv[++i]);
+		else if (a == "--max" && hasValue) opt.maxSeconds = std::atof(argv[++i]);
+		else if ((a == "-j" || a == "--jobs") && hasValue) opt.jobs = std::atoi(argv[++i]);
+		else if (!a.empty() && a[0] == '-') {
+			std::fputs(USAGE, stderr);
+			return 1;
+		}
+		else opt.files.push_back(a);
+	}
+	if (opt.files.empty()) {
+		std::fputs(USAGE, stderr);
+		return 1;
+	}
+	if (opt.modules.empty()) opt.modules.push_back("SuperMIDI64");
+	harness::init(opt.sampleRate);
+
+	std::vector<json_t*> configs;
+	for (const std::string &c : opt.configs) {
+		json_t *configJ = harness::loadJson(c);
+		if (!configJ) return 1;
+		configs.push_back(configJ);
+	}
+	if (configs.empty()) configs.push_back(NULL);
+
+	std::vector<Job> jobs;
+	for (const std::string &file : opt.files) {
+		std::string error;
+		SmfSong *song = SmfSong::load(file, &error);
+		if (!song) {
+			std::fprintf(stderr, "%s: %s\n", file.c_str(), error.c_str());
+			return 1;
+		}
+		int numTracks = static_cast<int>(song->tracks.size());
+		delete song;
+		std::string base = string::filename(file);
+		base = base.substr(0, base.find_last_of('.'));
+		for (int t = (opt.splitTracks ? 0 : -1); t < (opt.splitTracks ? numTracks : 0); t++) {
+			for (const std::string &module : opt.modules) {
+				for (size_t c = 0; c < configs.size(); c++) {
+					Job job;
+					job.file = file;
+					job.track = t;
+					job.module = module;
+					job.config = configs[c];
+					job.name = base + ((t >= 0) ? string::f("_t%d", t) : "") + "_" + module + ((configs.size() > 1) ? string::f("_c%d", static_cast<int>(c)) : "");
+					jobs.push_back(job);
+				}
+			}
+		}
+	}
+
+	int numThreads = (opt.jobs > 0) ? opt.jobs : std::max(1u, std::thread::hardware_concurrency());
+	numThreads = std::min(numThreads, static_cast<int>(jobs.size()));
+	std::atomic<int> nextJob{0};
+	int64_t start = harness::nowNs();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++) {
+		threads.push_back(std::thread([&]() {
+			int j;
+			while ((j = nextJob.fetch_add(1)) < static_cast<int>(jobs.size()))
+				render(opt, jobs[j], j % midi::HEADLESS_DEVICES);
+		}));
+	}
+	for (std::thread &thread : threads)
+		thread.join();
+	double wall = (harness::nowNs() - start) * 1e-9;
+
+	double audioSeconds = 0.0;
+	int failed = 0;
+	for (const Job &job : jobs) {
+		if (!job.ok) {
+			failed++;
+			std::printf("%-40s FAILED\n", job.name.c_str());
+			continue;
+		}
+		double audio = job.frames / opt.sampleRate;
+		audioSeconds += audio;
+		std::printf("%-40s %8.2f s audio %4d stems  %7.1fx real time\n", job.name.c_str(), audio, job.stems, job.seconds > 0.0 ? audio / job.seconds : 0.0);
+	}
+	std::printf("%d jobs on %d threads: %.2f s audio in %.2f s wall, %.1fx real time\n", static_cast<int>(jobs.size()), numThreads, audioSeconds, wall, wall > 0.0 ? audioSeconds / wall : 0.0);
+	for (json_t *configJ : configs)
+		if (configJ) json_decref(configJ);
+	return failed ? 1 : 0;
+}
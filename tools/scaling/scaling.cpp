@@ -0,0 +1,283 @@
+/*
+scaling.cpp : N module instances stepped by M engine threads, sharing one MIDI device,
+glibc's rand() state and the display publication, as in a large Rack patch
+
+Copyright (C) 2020 Anthony Lexander Matos
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https:www.gnu.org/licenses/>.
+*/
+#include "workload.hpp"
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+
+static const char *USAGE =
+"usage: scaling [options]\n"
+"  -m, --module SLUG     SuperMIDI64 (default) or DuoMIDI_CV\n"
+"  -n, --instances LIST  default 1,2,4,8,16\n"
+"  -t, --threads LIST    engine threads, default 1,2,4,8\n"
+"  -w, --workload NAME   default chords64:\n"
+"%s"
+"  -p, --mode NAME       poly mode, default rotate\n"
+"  -l, --layout OxV      Super MIDI 64 outputs x voices per output, default 4x16\n"
+"  -r, --rate HZ         default 48000\n"
+"  -d, --seconds SEC     audio per timed pass, default 0.5\n"
+"  -k, --repeats N       timed passes, the median is reported, default 3\n"
+"      --seed N          workload and rand() seed, default 1\n"
+"      --pin             pin engine thread i to core i\n"
+"      --csv FILE        also write the results as CSV\n"
+"Every instance listens to the same device. Each sample, the threads take instances\n"
+"from a shared counter and meet at a barrier, as Rack's engine does.\n";
+
+struct Options {
+	std::string module = "SuperMIDI64";
+	std::vector<int> instances;
+	std::vector<int> threads;
+	std::string workload = "chords64";
+	std::string mode = "rotate";
+	std::pair<int, int> layout = std::make_pair(4, 16);
+	float rate = 48000.f;
+	float seconds = 0.5f;
+	int repeats = 3;
+	uint32_t seed = 1;
+	bool pin = false;
+	std::string csv;
+};
+
+/** One engine thread's share of a pass */
+struct ThreadStats {
+	int64_t busyNs = 0;// processing instances
+	int64_t waitNs = 0;// at the end-of-sample barrier, for the slowest thread
+	int64_t processed = 0;// instance-samples
+};
+
+struct Result {
+	int instances;
+	int threads;
+	double frameNs;// wall time per engine sample
+	double instanceNs;// busy time per instance-sample
+	double imbalance;// busiest thread over the mean
+	double waitShare;// barrier wait over wall time, mean of the threads
+};
+
+///////////////////////////////////////////////////////////////////////////////////////
+/** Spins, then yields : more threads than cores must not stall the pass */
+struct Barrier {
+	int total;
+	std::atomic<int> count;
+	std::atomic<int> generation;
+
+	explicit Barrier(int total) : total(total), count(0), generation(0) {}
+	void wait() {
+		int gen = generation.load(std::memory_order_acquire);
+		if (count.fetch_add(1, std::memory_order_acq_rel) == total - 1) {
+			count.store(0, std::memory_order_relaxed);
+			generation.store(gen + 1, std::memory_order_release);
+			return;
+		}
+		for (int spins = 0; generation.load(std::memory_order_acquire) == gen; spins++)
+			if (spins > 2000) std::this_thread::yield();
+	}
+};
+///////////////////////////////////////////////////////////////////////////////////////
+/** A patch : the rigs, the engine threads and the shared device */
+struct Engine {
+	std::vector<harness::Rig*> rigs;
+	int numThreads;
+	Barrier start;
+	Barrier end;
+	std::atomic<int> next;
+	std::atomic<bool> quit;
+	std::vector<ThreadStats> stats;
+	std::vector<std::thread> workers;
+
+	Engine(const Options &opt, int instances, int threads) : numThreads(threads), start(threads), end(threads), next(0), quit(false) {
+		json_t *configJ = json_object();
+		const std::vector<std::string> &modes = harness::polyModes(opt.module);
+		harness::setPolyMode(configJ, opt.module, std::find(modes.begin(), modes.end(), opt.mode) - modes.begin());
+		if (opt.module == "SuperMIDI64") {
+			json_object_set_new(configJ, "numVOout", json_integer(opt.layout.first));
+			json_object_set_new(configJ, "numVOper", json_integer(opt.layout.second));
+			json_object_set_new(configJ, "numVo", json_integer(opt.layout.first * opt.layout.second));
+		}
+		else json_object_set_new(configJ, "channels 1", json_integer(16));
+		for (int i = 0; i < instances; i++)
+			rigs.push_back(new harness::Rig(opt.module, 0, configJ));// all on device 0
+		json_decref(configJ);
+		stats.resize(threads);
+		for (int t = 1; t < threads; t++)
+			workers.push_back(std::thread([this, t, &opt]() {
+				pin(opt, t);
+				while (step(t)) {}
+			}));
+		pin(opt, 0);
+	}
+	~Engine() {
+		quit = true;
+		start.wait();// releases the workers into the quit check
+		for (std::thread &w : workers)
+			w.join();
+		for (harness::Rig *rig : rigs)
+			delete rig;
+	}
+	static void pin(const Options &opt, int t) {
+		if (!opt.pin) return;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(t % std::thread::hardware_concurrency(), &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+	/** One sample on thread t, false once the engine quits */
+	bool step(int t) {
+		start.wait();
+		if (quit) return false;
+		ThreadStats &s = stats[t];
+		int64_t t0 = harness::nowNs();
+		int n = static_cast<int>(rigs.size());
+		for (int i = next.fetch_add(1, std::memory_order_relaxed); i < n; i = next.fetch_add(1, std::memory_order_relaxed)) {
+			rigs[i]->process();
+			s.processed++;
+		}
+		int64_t t1 = harness::nowNs();
+		end.wait();
+		s.busyNs += t1 - t0;
+		s.waitNs += harness::nowNs() - t1;
+		return true;
+	}
+	/** Wall ns for the script, thread 0 being the caller */
+	int64_t pass(const harness::Script &script, uint32_t seed) {
+		std::srand(seed);// note drift
+		for (ThreadStats &s : stats)
+			s = ThreadStats();
+		size_t cursor = 0;
+		int64_t begin = harness::nowNs();
+		for (int64_t frame = 0; frame < script.frames; frame++) {
+			script.sendFrame(*rigs[0], frame, cursor);// one device, every instance reads it
+			next.store(0, std::memory_order_relaxed);
+			step(0);
+		}
+		return harness::nowNs() - begin;
+	}
+};
+///////////////////////////////////////////////////////////////////////////////////////
+static Result measure(const Options &opt, const harness::Script &script, int instances, int threads) {
+	Engine engine(opt, instances, threads);
+	engine.pass(script, opt.seed);// warm-up
+	std::vector<std::pair<int64_t, std::vector<ThreadStats>>> passes;
+	for (int k = 0; k < opt.repeats; k++) {
+		int64_t wall = engine.pass(script, opt.seed);
+		passes.push_back(std::make_pair(wall, engine.stats));
+	}
+	std::sort(passes.begin(), passes.end(), [](const std::pair<int64_t, std::vector<ThreadStats>> &a, const std::pair<int64_t, std::vector<ThreadStats>> &b) {return a.first < b.first;});
+	const std::pair<int64_t, std::vector<ThreadStats>> &median = passes[passes.size() / 2];
+	Result r;
+	r.instances = instances;
+	r.threads = threads;
+	r.frameNs = static_cast<double>(median.first) / script.frames;
+	int64_t busy = 0, busiest = 0, wait = 0, processed = 0;
+	for (const ThreadStats &s : median.second) {
+		busy += s.busyNs;
+		busiest = std::max(busiest, s.busyNs);
+		wait += s.waitNs;
+		processed += s.processed;
+	}
+	r.instanceNs = processed ? static_cast<double>(busy) / processed : 0.0;
+	r.imbalance = busy ? static_cast<double>(busiest) * threads / busy : 1.0;
+	r.waitShare = static_cast<double>(wait) / threads / median.first;
+	return r;
+}
+///////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if ((a == "-m" || a == "--module") && hasValue) opt.module = argv[++i];
+		else if ((a == "-n" || a == "--instances") && hasValue) {
+			for (const std::string &n : harness::split(argv[++i]))
+				opt.instances.push_back(std::max(1, std::atoi(n.c_str())));
+		}
+		else if ((a == "-t" || a == "--threads") && hasValue) {
+			for (const std::string &t : harness::split(argv[++i]))
+				opt.threads.push_back(std::max(1, std::atoi(t.c_str())));
+		}
+		else if ((a == "-w" || a == "--workload") && hasValue) opt.workload = argv[++i];
+		else if ((a == "-p" || a == "--mode") && hasValue) opt.mode = argv[++i];
+		else if ((a == "-l" || a == "--layout") && hasValue) {
+			if ((std::sscanf(argv[++i], "%dx%d", &opt.layout.first, &opt.layout.second) != 2) || (opt.layout.first < 1) || (opt.layout.first > 4) || (opt.layout.second < 1) || (opt.layout.second > 16)) {
+				std::fprintf(stderr, "bad layout %s, 1~4 outputs x 1~16 voices\n", argv[i]);
+				return 1;
+			}
+		}
+		else if ((a == "-r" || a == "--rate") && hasValue) opt.rate = std::atof(argv[++i]);
+		else if ((a == "-d" || a == "--seconds") && hasValue) opt.seconds = std::atof(argv[++i]);
+		else if ((a == "-k" || a == "--repeats") && hasValue) opt.repeats = std::max(1, std::atoi(argv[++i]));
+		else if (a == "--seed" && hasValue) opt.seed = std::strtoul(argv[++i], NULL, 10);
+		else if (a == "--pin") opt.pin = true;
+		else if (a == "--csv" && hasValue) opt.csv = argv[++i];
+		else {
+			std::fprintf(stderr, USAGE, harness::workloadHelp().c_str());
+			return 1;
+		}
+	}
+	if (opt.instances.empty()) opt.instances = {1, 2, 4, 8, 16};
+	if (opt.threads.empty()) opt.threads = {1, 2, 4, 8};
+	const std::vector<std::string> &modes = harness::polyModes(opt.module);
+	if (modes.empty()) {
+		std::fprintf(stderr, "unknown module %s\n", opt.module.c_str());
+		return 1;
+	}
+	if (std::find(modes.begin(), modes.end(), opt.mode) == modes.end()) {
+		std::fprintf(stderr, "unknown poly mode %s\n", opt.mode.c_str());
+		return 1;
+	}
+	harness::init(opt.rate);
+	harness::Script script;
+	if (!harness::makeWorkload(script, opt.workload, opt.rate, opt.seconds, opt.seed)) {
+		std::fprintf(stderr, "unknown workload %s\n", opt.workload.c_str());
+		return 1;
+	}
+
+	std::printf("%s %s, %s, %.0f Hz, %u hardware threads\n", opt.module.c_str(), opt.mode.c_str(), opt.workload.c_str(), opt.rate, std::thread::hardware_concurrency());
+	std::printf("%9s %7s %11s %9s %14s %8s %10s %9s %11s %8s\n", "instances", "threads", "ns/sample", "realtime", "inst-samples/s", "speedup", "inst ns", "slowdown", "imbalance", "wait");
+	std::vector<Result> results;
+	for (int instances : opt.instances) {
+		double single = 0.0;// 1 thread, same instance count
+		double alone = 0.0;// per-instance cost with nothing else running
+		for (int threads : opt.threads) {
+			Result r = measure(opt, script, instances, threads);
+			if (alone == 0.0) alone = (instances == 1) ? r.instanceNs : measure(opt, script, 1, 1).instanceNs;
+			if (single == 0.0) single = (threads == 1) ? r.frameNs : measure(opt, script, instances, 1).frameNs;
+			std::printf("%9d %7d %11.1f %8.1fx %14.0f %7.2fx %10.1f %8.2fx %10.2fx %7.1f%%\n", instances, threads, r.frameNs, 1e9 / r.frameNs / opt.rate,
+				instances * 1e9 / r.frameNs, single / r.frameNs, r.instanceNs, r.instanceNs / alone, r.imbalance, 100.0 * r.waitShare);
+			std::fflush(stdout);
+			results.push_back(r);
+		}
+	}
+
+	if (!opt.csv.empty()) {
+		FILE *file = std::fopen(opt.csv.c_str(), "w");
+		if (!file) {
+			std::fprintf(stderr, "can't write %s\n", opt.csv.c_str());
+			return 1;
+		}
+		std::fprintf(file, "module,mode,workload,instances,threads,nsPerSample,instanceSamplesPerSecond,instanceNs,imbalance,waitShare\n");
+		for (const Result &r : results)
+			std::fprintf(file, "%s,%s,%s,%d,%d,%.2f,%.0f,%.2f,%.3f,%.4f\n", opt.module.c_str(), opt.mode.c_str(), opt.workload.c_str(), r.instances, r.threads,
+				r.frameNs, r.instances * 1e9 / r.frameNs, r.instanceNs, r.imbalance, r.waitShare);
+		std::fclose(file);
+	}
+	return 0;
+}